@@ -24,9 +24,6 @@ UniversalTelegramBot bot(BOTtoken, secured_client);
 unsigned long Bot_mtbs = 1000; // mean time between scan messages
 unsigned long Bot_lasttime;   // last time messages' scan has been done
 
-int bulk_messages_mtbs = 1500; // mean time between send messages, 1.5 seconds
-int messages_limit_per_second = 25; // Telegram API have limit for bulk messages ~30 messages per second
-
 const char subscribed_users_filename[] = "/subscribed_users.json";
 
 DynamicJsonBuffer jsonBuffer;
@@ -107,22 +104,39 @@ bool removeSubscribedUser(const char* chat_id) {
   return true;
 }
 
-void sendMessageToAllSubscribedUsers(const char* message) {
-  int users_processed = 0;
+// Users the bulk message is being sent to, walked by nextSubscribedUser()
+JsonObject::iterator subscribed_user;
+JsonObject::iterator subscribed_users_end;
 
-  JsonObject& users = getSubscribedUsers();
+const char* nextSubscribedUser() {
+  if (subscribed_user == subscribed_users_end)
+    return NULL;
 
-  for (JsonObject::iterator it=users.begin(); it!=users.end(); ++it) {
-    users_processed++;
+  const char* chat_id = subscribed_user->key;
+  ++subscribed_user;
+  return chat_id;
+}
 
-    if (users_processed < messages_limit_per_second)  {
-      const char* chat_id = it->key;
-      bot.sendMessage(chat_id, message, "");
-    } else {
-      delay(bulk_messages_mtbs);
-      users_processed = 0;
-    }
+void bulkMessageProgress(const char* chat_id, BroadcastResult result,
+                         const telegramBroadcast &progress) {
+  if (result == BROADCAST_BLOCKED) {
+    // The user blocked the bot, no point in sending more messages
+    Serial.printf("User %s blocked the bot\n", chat_id);
+  } else if (result == BROADCAST_FAILED) {
+    Serial.printf("Failed to send to %s\n", chat_id);
   }
+  Serial.printf("Bulk message sent to %u of %u users in %lu ms\n", progress.sent,
+                progress.processed, progress.elapsed_ms);
+}
+
+void sendMessageToAllSubscribedUsers(const char* message) {
+  JsonObject& users = getSubscribedUsers();
+
+  // The message is sent over a single connection, paced to Telegram's limit
+  // for bulk messages (~30 messages per second)
+  subscribed_user = users.begin();
+  subscribed_users_end = users.end();
+  bot.broadcast(message, nextSubscribedUser, "", bulkMessageProgress);
 }
 
 void handleNewMessages(int numNewMessages) {
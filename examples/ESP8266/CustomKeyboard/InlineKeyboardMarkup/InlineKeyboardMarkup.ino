@@ -19,6 +19,9 @@ char password[] = "YYYYYY"; // your network key
 WiFiClientSecure client;
 UniversalTelegramBot bot(BOTtoken, client);
 
+// Built once in setup(), sent with the options and again with every edit
+TelegramKeyboard keyboard;
+
 unsigned long Bot_mtbs = 1000; //mean time between scan messages
 unsigned long Bot_lasttime;   //last time messages' scan has been done
 
@@ -32,7 +35,13 @@ void handleNewMessages(int numNewMessages) {
       Serial.println(bot.messages[i].from_id);
       Serial.print("Data on the button: ");
       Serial.println(bot.messages[i].text);
-      bot.sendMessage(bot.messages[i].from_id, bot.messages[i].text, "");
+
+      // Stop the progress indicator on the button and show the pressed data
+      // in place of the original message, instead of sending a new one. An
+      // edit without a keyboard removes it, so it is passed again.
+      bot.answerCallbackQuery(bot.messages[i].query_id);
+      bot.editMessageText(bot.messages[i].chat_id, bot.messages[i].message_id,
+                          bot.messages[i].text, "", keyboard);
     } else {
       char* chat_id = bot.messages[i].chat_id;
       char* text = bot.messages[i].text;
@@ -42,8 +51,7 @@ void handleNewMessages(int numNewMessages) {
         from_name = (char*)"Guest\0";
 
       if (strcmp(text, "/options") == 0) {
-        static char keyboardJson[] = "[[{ \"text\" : \"Go to Google\", \"url\" : \"https://www.google.com\" }],[{ \"text\" : \"Send\", \"callback_data\" : \"This was sent by inline\" }]]";
-        bot.sendMessageWithInlineKeyboard(chat_id, "Choose from one of the following options", "", keyboardJson);
+        bot.sendMessage(chat_id, "Choose from one of the following options", "", keyboard);
       }
 
       if (strcmp(text, "/start") == 0) {
@@ -78,6 +86,10 @@ void setup() {
     delay(500);
   }
 
+  keyboard.addUrlButton("Go to Google", "https://www.google.com");
+  keyboard.addRow();
+  keyboard.addButton("Send", "This was sent by inline");
+
   Serial.println("\nWiFi connected");
   Serial.print("IP address: ");
   Serial.println(WiFi.localIP());
@@ -0,0 +1,97 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+
+#include "TelegramChunkedStream.h"
+
+// Larger chunks are not sent by any sane server, and would not fit anyway
+#define CHUNK_SIZE_DIGITS 8
+
+// Consume the framing that has arrived, up to the next data byte
+void TelegramChunkedStream::readFraming() {
+  while ((_state != CHUNK_DATA) && (_state != CHUNK_DONE) &&
+         (_state != CHUNK_FAILED) && _in.available()) {
+    char c = _in.read();
+    framingBytes++;
+
+    switch (_state) {
+      case CHUNK_SIZE:
+        if (isxdigit(c) && (_digits < CHUNK_SIZE_DIGITS)) {
+          _remaining = (_remaining << 4) |
+                       (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+          _digits++;
+        } else if ((c == ';') || (c == ' ') || (c == '\r')) {
+          _state = (_digits > 0) ? CHUNK_EXTENSION : CHUNK_FAILED;
+        } else {
+          _state = CHUNK_FAILED;
+        }
+        break;
+      case CHUNK_EXTENSION: // Chunk extensions are ignored
+        if (c == '\n') {
+          _state = (_remaining > 0) ? CHUNK_DATA : CHUNK_TRAILER;
+          _lineLength = 0;
+        }
+        break;
+      case CHUNK_DATA_END:
+        if (c == '\n') {
+          _state = CHUNK_SIZE;
+          _digits = 0;
+        } else if (c != '\r') {
+          _state = CHUNK_FAILED;
+        }
+        break;
+      case CHUNK_TRAILER: // Header lines until an empty one
+        if (c == '\n') {
+          if (_lineLength == 0)
+            _state = CHUNK_DONE;
+          _lineLength = 0;
+        } else if ((c != '\r') && (_lineLength < 255)) {
+          _lineLength++;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+int TelegramChunkedStream::available() {
+  readFraming();
+  if (_state != CHUNK_DATA)
+    return 0;
+
+  int length = _in.available();
+  return ((uint32_t)length > _remaining) ? (int)_remaining : length;
+}
+
+int TelegramChunkedStream::read() {
+  if (available() <= 0)
+    return -1;
+  if (--_remaining == 0)
+    _state = CHUNK_DATA_END;
+
+  return _in.read();
+}
+
+int TelegramChunkedStream::peek() {
+  return (available() > 0) ? _in.peek() : -1;
+}
@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+
+#ifndef TelegramChunkedStream_h
+#define TelegramChunkedStream_h
+
+#include <Arduino.h>
+
+/***************************************************************
+ * Body of a response sent with "Transfer-Encoding: chunked":  *
+ * reads the chunks from the stream as they arrive and gives   *
+ * back only their data, so the reader (readResponse() or the  *
+ * inflater) sees the body as if it had a Content-Length. The  *
+ * chunk framing is consumed in available(), never blocking.   *
+ ***************************************************************/
+class TelegramChunkedStream : public Stream {
+public:
+  explicit TelegramChunkedStream(Stream &in) : _in(in) {}
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t) { return 0; }
+
+  // The last (empty) chunk and the trailer were read
+  bool done() const { return _state == CHUNK_DONE; }
+  // The framing is not valid, the connection is out of step
+  bool failed() const { return _state == CHUNK_FAILED; }
+
+  uint32_t framingBytes = 0; // Bytes of chunk sizes, line breaks and trailer
+
+private:
+  enum State { CHUNK_SIZE, CHUNK_EXTENSION, CHUNK_DATA, CHUNK_DATA_END,
+               CHUNK_TRAILER, CHUNK_DONE, CHUNK_FAILED };
+
+  Stream &_in;
+  State _state = CHUNK_SIZE;
+  uint32_t _remaining = 0;  // Data bytes left in the chunk
+  uint8_t _digits = 0;      // Of the chunk size
+  uint8_t _lineLength = 0;  // Of the trailer line being read
+
+  void readFraming();
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramClientPool.h"
+
+TelegramClientPool::TelegramClientPool() {
+  _count = 0;
+  memset(_busy, 0, sizeof(_busy));
+  memset(stats, 0, sizeof(stats));
+  resetStats();
+}
+
+void TelegramClientPool::lock() {
+#ifdef TELEGRAM_POOL_LOCKING
+  _lock.lock();
+#endif
+}
+
+void TelegramClientPool::unlock() {
+#ifdef TELEGRAM_POOL_LOCKING
+  _lock.unlock();
+#endif
+}
+
+bool TelegramClientPool::addClient(TelegramLane lane, Client &client) {
+  lock();
+  bool added = (_count < POOL_CLIENTS) && (lane < LANE_COUNT);
+  if (added) {
+    _clients[_count] = &client;
+    _lanes[_count] = lane;
+    _busy[_count] = false;
+    _count++;
+    // Without a limit of its own, as many requests as clients
+    if (stats[lane].limit == stats[lane].clients)
+      stats[lane].limit++;
+    stats[lane].clients++;
+  }
+  unlock();
+
+  return added;
+}
+
+void TelegramClientPool::setLimit(TelegramLane lane, uint8_t max_in_flight) {
+  lock();
+  if (lane < LANE_COUNT)
+    stats[lane].limit = max_in_flight;
+  unlock();
+}
+
+// Lane that serves the requests of a lane. Called locked.
+TelegramLane TelegramClientPool::laneOf(TelegramLane lane) {
+  return (stats[lane].clients > 0) ? lane : LANE_SEND;
+}
+
+// Index of a free client of the lane, marked busy, or -1. Called locked.
+int TelegramClientPool::takeClient(TelegramLane lane) {
+  if (stats[lane].in_flight >= stats[lane].limit)
+    return -1;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((_lanes[i] == lane) && !_busy[i]) {
+      _busy[i] = true;
+      _acquiredAt[i] = micros();
+      stats[lane].acquired++;
+      stats[lane].in_flight++;
+      if (stats[lane].in_flight > stats[lane].peak_in_flight)
+        stats[lane].peak_in_flight = stats[lane].in_flight;
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+Client* TelegramClientPool::acquire(TelegramLane lane, unsigned long timeout) {
+  unsigned long start = millis();
+  bool waited = false;
+
+  if (lane >= LANE_COUNT)
+    return NULL;
+
+  while (true) {
+    lock();
+    TelegramLane serving = laneOf(lane);
+    if (stats[serving].clients == 0) {
+      unlock();
+      return NULL;
+    }
+    int i = takeClient(serving);
+    if (i >= 0) {
+      if (waited)
+        stats[serving].waited++;
+      unlock();
+      return _clients[i];
+    }
+    if (millis() - start >= timeout) {
+      stats[serving].rejected++;
+      unlock();
+      return NULL;
+    }
+    unlock();
+
+    waited = true;
+    delay(1);
+  }
+}
+
+void TelegramClientPool::release(Client *client) {
+  lock();
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((_clients[i] == client) && _busy[i]) {
+      _busy[i] = false;
+      stats[_lanes[i]].in_flight--;
+      stats[_lanes[i]].busy_us += micros() - _acquiredAt[i];
+      break;
+    }
+  }
+  unlock();
+}
+
+bool TelegramClientPool::hasClients(TelegramLane lane) {
+  if (lane >= LANE_COUNT)
+    return false;
+
+  lock();
+  bool has = stats[laneOf(lane)].clients > 0;
+  unlock();
+
+  return has;
+}
+
+uint8_t TelegramClientPool::utilization(TelegramLane lane) {
+  if (lane >= LANE_COUNT)
+    return 0;
+
+  lock();
+  if (stats[lane].clients == 0) {
+    unlock();
+    return 0;
+  }
+  // Busy time of all the clients of the lane, over the time they had
+  uint64_t available = (uint64_t)(micros() - _statsStart) * stats[lane].clients;
+  uint64_t busy = stats[lane].busy_us;
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((_lanes[i] == lane) && _busy[i])
+      busy += micros() - _acquiredAt[i];
+  }
+  unlock();
+
+  if (available == 0)
+    return 0;
+  return (busy >= available) ? 100 : (uint8_t)(busy * 100 / available);
+}
+
+void TelegramClientPool::resetStats() {
+  lock();
+  for (uint8_t lane = 0; lane < LANE_COUNT; lane++) {
+    stats[lane].acquired = 0;
+    stats[lane].waited = 0;
+    stats[lane].rejected = 0;
+    stats[lane].busy_us = 0;
+    stats[lane].peak_in_flight = stats[lane].in_flight;
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_busy[i])
+      _acquiredAt[i] = micros();
+  }
+  _statsStart = micros();
+  unlock();
+}
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramClientPool_h
+#define TelegramClientPool_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Several tasks can share a pool on multi-core (ESP32) and host builds
+#if !defined(ARDUINO) || defined(ESP32)
+#define TELEGRAM_POOL_LOCKING
+#include <mutex>
+#endif
+
+#ifndef POOL_CLIENTS
+#define POOL_CLIENTS 6
+#endif
+
+// Kind of traffic a client of the pool is kept for
+enum TelegramLane { LANE_POLL, LANE_SEND, LANE_UPLOAD, LANE_COUNT };
+
+struct telegramLaneStats {
+  uint8_t clients;
+  uint8_t limit;         // Most requests in flight at once
+  uint8_t in_flight;
+  uint8_t peak_in_flight;
+  uint32_t acquired;
+  uint32_t waited;       // Acquired after waiting for a free client
+  uint32_t rejected;     // No free client before the timeout
+  uint32_t busy_us;      // Total time the clients were in use
+};
+
+/***************************************************************
+ * Pool of transport clients, kept for a kind of traffic each  *
+ * (lane): the long poll, small sends and uploads, so a big    *
+ * upload does not hold back the alerts. Each client keeps its *
+ * own connection. Bots sharing a pool (i.e. one per task)     *
+ * take a client of the lane for every operation and give it  *
+ * back when done. A lane without clients uses the send lane.  *
+ ***************************************************************/
+class TelegramClientPool {
+public:
+  TelegramClientPool();
+
+  bool addClient(TelegramLane lane, Client &client);
+  void setLimit(TelegramLane lane, uint8_t max_in_flight);
+
+  // A free client of the lane, waiting up to timeout ms for one. NULL if
+  // none got free, or the pool has no clients at all.
+  Client* acquire(TelegramLane lane, unsigned long timeout);
+  void release(Client *client);
+  // True if acquire() serves the lane, with clients of its own or of the
+  // send lane
+  bool hasClients(TelegramLane lane);
+
+  // Percentage of the time the clients of the lane were in use, since the
+  // pool was created or resetStats() called (micros() wraps after ~70
+  // minutes, so reset at least that often)
+  uint8_t utilization(TelegramLane lane);
+  void resetStats();
+
+  telegramLaneStats stats[LANE_COUNT];
+
+private:
+  Client *_clients[POOL_CLIENTS];
+  uint8_t _lanes[POOL_CLIENTS];
+  bool _busy[POOL_CLIENTS];
+  unsigned long _acquiredAt[POOL_CLIENTS];
+  uint8_t _count;
+  unsigned long _statsStart;
+#ifdef TELEGRAM_POOL_LOCKING
+  std::mutex _lock;
+#endif
+  TelegramLane laneOf(TelegramLane lane);
+  int takeClient(TelegramLane lane);
+  void lock();
+  void unlock();
+};
+
+#endif
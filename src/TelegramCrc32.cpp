@@ -0,0 +1,43 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramCrc32.h"
+
+// Half byte at a time, so the table is just 64 bytes
+static const uint32_t CRC32_TABLE[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t crc32Update(uint32_t crc, const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = CRC32_TABLE[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+    crc = CRC32_TABLE[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+
+  return ~crc;
+}
@@ -0,0 +1,146 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramFileCache.h"
+#include "TelegramCrc32.h"
+
+const uint32_t FILE_CACHE_MAGIC = 0x54474631; // "TGF1"
+
+struct telegramFileCacheRecord {
+  uint32_t magic;
+  telegramFileCacheEntry entries[FILE_CACHE_ENTRIES];
+  uint32_t checksum;
+};
+
+TelegramFileCache::TelegramFileCache() {
+  _storage = NULL;
+  hits = 0;
+  misses = 0;
+  bytes_saved = 0;
+  clear();
+}
+
+void TelegramFileCache::clear() {
+  memset(_entries, 0, sizeof(_entries));
+  _sequence = 0;
+}
+
+uint32_t TelegramFileCache::contentHash(const uint8_t* data, size_t length) {
+  return crc32Update(0, data, length);
+}
+
+bool TelegramFileCache::begin(TelegramStorage &storage) {
+  telegramFileCacheRecord record;
+
+  if (storage.capacity() < sizeof(record))
+    return false;
+  _storage = &storage;
+
+  if (!storage.load(&record, sizeof(record)) || (record.magic != FILE_CACHE_MAGIC) ||
+      (record.checksum != crc32Update(0, &record, offsetof(telegramFileCacheRecord, checksum))))
+    return false;
+
+  memcpy(_entries, record.entries, sizeof(_entries));
+  _sequence = 0;
+  for (uint8_t i = 0; i < FILE_CACHE_ENTRIES; i++) {
+    _entries[i].file_id[FILE_CACHE_ID_LENGTH - 1] = '\0';
+    if (_entries[i].last_used > _sequence)
+      _sequence = _entries[i].last_used;
+  }
+
+  return true;
+}
+
+bool TelegramFileCache::save() {
+  telegramFileCacheRecord record;
+
+  if (_storage == NULL)
+    return false;
+
+  memset(&record, 0, sizeof(record));
+  record.magic = FILE_CACHE_MAGIC;
+  memcpy(record.entries, _entries, sizeof(_entries));
+  record.checksum = crc32Update(0, &record, offsetof(telegramFileCacheRecord, checksum));
+
+  return _storage->save(&record, sizeof(record));
+}
+
+telegramFileCacheEntry* TelegramFileCache::find(uint32_t hash, uint32_t size) {
+  for (uint8_t i = 0; i < FILE_CACHE_ENTRIES; i++) {
+    if ((_entries[i].size == size) && (_entries[i].hash == hash) && (size != 0))
+      return &_entries[i];
+  }
+
+  return NULL;
+}
+
+const char* TelegramFileCache::get(uint32_t hash, uint32_t size) {
+  telegramFileCacheEntry *entry = find(hash, size);
+
+  if (entry == NULL) {
+    misses++;
+    return NULL;
+  }
+  hits++;
+  bytes_saved += size;
+  entry->last_used = ++_sequence;
+
+  return entry->file_id;
+}
+
+bool TelegramFileCache::put(uint32_t hash, uint32_t size, const char* file_id) {
+  if ((size == 0) || (strlen(file_id) >= FILE_CACHE_ID_LENGTH))
+    return false;
+
+  // Take the entry of the same content, or a free one, or else the least
+  // recently used one
+  telegramFileCacheEntry *entry = find(hash, size);
+  for (uint8_t i = 0; (i < FILE_CACHE_ENTRIES) && (entry == NULL); i++) {
+    if (_entries[i].size == 0)
+      entry = &_entries[i];
+  }
+  if (entry == NULL) {
+    entry = &_entries[0];
+    for (uint8_t i = 1; i < FILE_CACHE_ENTRIES; i++) {
+      if (_entries[i].last_used < entry->last_used)
+        entry = &_entries[i];
+    }
+  }
+
+  memset(entry, 0, sizeof(*entry));
+  entry->hash = hash;
+  entry->size = size;
+  entry->last_used = ++_sequence;
+  strcpy(entry->file_id, file_id);
+  save();
+
+  return true;
+}
+
+void TelegramFileCache::remove(uint32_t hash, uint32_t size) {
+  telegramFileCacheEntry *entry = find(hash, size);
+
+  if (entry != NULL) {
+    memset(entry, 0, sizeof(*entry));
+    save();
+  }
+}
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramFileCache_h
+#define TelegramFileCache_h
+
+#include <Arduino.h>
+#include "TelegramStorage.h"
+
+#ifndef FILE_CACHE_ENTRIES
+#define FILE_CACHE_ENTRIES 8
+#endif
+const uint8_t FILE_CACHE_ID_LENGTH = 128;
+
+struct telegramFileCacheEntry {
+  uint32_t hash;
+  uint32_t size;      // 0: free entry
+  uint32_t last_used; // Sequence number of the last put or hit
+  char file_id[FILE_CACHE_ID_LENGTH];
+};
+
+/***************************************************************
+ * file_id of files already uploaded, keyed by a hash and the  *
+ * size of their content, so sending the same file again is a *
+ * small request with the file_id instead of a new upload.     *
+ * With a storage (begin()), the entries are saved whenever an *
+ * entry is added or removed, and loaded back after a restart. *
+ * Hits only update the order of eviction in memory, so they   *
+ * cause no writes.                                            *
+ ***************************************************************/
+class TelegramFileCache {
+public:
+  TelegramFileCache();
+
+  // Load the entries saved before, false if there were none (or they do not
+  // fit the storage, which then is not used)
+  bool begin(TelegramStorage &storage);
+
+  // The file_id of the content, NULL if not cached
+  const char* get(uint32_t hash, uint32_t size);
+  // Add or replace an entry, evicting the least recently used one if full
+  bool put(uint32_t hash, uint32_t size, const char* file_id);
+  // Forget an entry, i.e. after Telegram rejected its file_id
+  void remove(uint32_t hash, uint32_t size);
+  void clear();
+
+  // Hash of a content held in memory (CRC-32)
+  static uint32_t contentHash(const uint8_t* data, size_t length);
+
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t bytes_saved; // Upload bytes avoided by hits
+
+private:
+  telegramFileCacheEntry _entries[FILE_CACHE_ENTRIES];
+  uint32_t _sequence;
+  TelegramStorage *_storage;
+  telegramFileCacheEntry* find(uint32_t hash, uint32_t size);
+  bool save();
+};
+
+#endif
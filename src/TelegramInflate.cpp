@@ -0,0 +1,356 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramInflate.h"
+#include "TelegramCrc32.h"
+
+// Base values and extra bits of the length (257..285) and distance codes
+static const uint16_t LENGTH_BASE[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_BITS[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DISTANCE_BASE[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DISTANCE_BITS[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+// Order in which the code length code lengths are sent
+static const uint8_t CODE_LENGTH_ORDER[19] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Next compressed byte, waiting for it to arrive. -1 at the end of the data
+// or on timeout.
+int TelegramInflate::readByte() {
+  if (_inRemaining == 0) {
+    _error = true;
+    return -1;
+  }
+  while (!_in->available()) {
+    if (millis() - _start >= _timeout) {
+      _error = true;
+      return -1;
+    }
+    yield();
+  }
+  if (_inRemaining > 0)
+    _inRemaining--;
+  bytesIn++;
+
+  return _in->read();
+}
+
+// Read count bits, least significant first
+uint32_t TelegramInflate::readBits(uint8_t count) {
+  uint32_t value = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (_bitCount == 0) {
+      int b = readByte();
+      if (b < 0)
+        return 0;
+      _tag = b;
+      _bitCount = 8;
+    }
+    value |= (_tag & 1) << i;
+    _tag >>= 1;
+    _bitCount--;
+  }
+
+  return value;
+}
+
+// Canonical Huffman codes: the codes of each length are consecutive and
+// ordered by symbol, so the counts per length are enough to decode them
+void TelegramInflate::buildTree(inflateTree &tree, const uint8_t* lengths,
+                                uint16_t count) {
+  uint16_t offsets[16];
+
+  memset(tree.counts, 0, sizeof(tree.counts));
+  for (uint16_t i = 0; i < count; i++)
+    tree.counts[lengths[i]]++;
+  tree.counts[0] = 0;
+
+  uint16_t sum = 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    offsets[i] = sum;
+    sum += tree.counts[i];
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    if (lengths[i] != 0)
+      tree.symbols[offsets[lengths[i]]++] = i;
+  }
+}
+
+int TelegramInflate::decodeSymbol(const inflateTree &tree) {
+  int sum = 0;
+  int code = 0;
+  uint8_t length = 0;
+
+  // Walk down the code lengths until the code falls within those of a length
+  do {
+    code = 2 * code + readBits(1);
+    if (++length > 15) {
+      _error = true;
+      return -1;
+    }
+    sum += tree.counts[length];
+    code -= tree.counts[length];
+  } while (code >= 0);
+
+  return tree.symbols[sum + code];
+}
+
+void TelegramInflate::buildFixedTrees() {
+  uint8_t lengths[288];
+
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 256 - 144);
+  memset(lengths + 256, 7, 280 - 256);
+  memset(lengths + 280, 8, 288 - 280);
+  buildTree(_literals, lengths, 288);
+
+  memset(lengths, 5, 30);
+  buildTree(_distances, lengths, 30);
+}
+
+bool TelegramInflate::decodeTrees() {
+  uint8_t lengths[288 + 32];
+
+  uint16_t literals = readBits(5) + 257;
+  uint8_t distances = readBits(5) + 1;
+  uint8_t code_lengths = readBits(4) + 4;
+  if ((literals > 286) || (distances > 30))
+    return false;
+
+  // The code lengths are themselves Huffman coded, with this tree
+  memset(lengths, 0, 19);
+  for (uint8_t i = 0; i < code_lengths; i++)
+    lengths[CODE_LENGTH_ORDER[i]] = readBits(3);
+  buildTree(_literals, lengths, 19);
+
+  uint16_t count = 0;
+  while ((count < literals + distances) && !_error) {
+    int symbol = decodeSymbol(_literals);
+    uint8_t length = 0;
+    uint8_t repeat = 1;
+
+    if (symbol < 16) {
+      length = symbol;
+    } else if (symbol == 16) { // Repeat the previous length 3..6 times
+      if (count == 0)
+        return false;
+      length = lengths[count - 1];
+      repeat = readBits(2) + 3;
+    } else if (symbol == 17) { // 3..10 zeros
+      repeat = readBits(3) + 3;
+    } else if (symbol == 18) { // 11..138 zeros
+      repeat = readBits(7) + 11;
+    } else {
+      return false;
+    }
+    if (count + repeat > literals + distances)
+      return false;
+    memset(lengths + count, length, repeat);
+    count += repeat;
+  }
+  if (_error)
+    return false;
+
+  buildTree(_literals, lengths, literals);
+  buildTree(_distances, lengths + literals, distances);
+
+  return true;
+}
+
+bool TelegramInflate::inflateCodes() {
+  while (!_error) {
+    int symbol = decodeSymbol(_literals);
+    if (symbol < 0)
+      return false;
+
+    if (symbol < 256) {
+      if (_outLength + 1 >= _outSize)
+        return false;
+      _out[_outLength++] = (char)symbol;
+    } else if (symbol == 256) { // End of block
+      return true;
+    } else {
+      symbol -= 257;
+      if (symbol >= 29)
+        return false;
+      size_t length = LENGTH_BASE[symbol] + readBits(LENGTH_BITS[symbol]);
+      int distance_symbol = decodeSymbol(_distances);
+      if ((distance_symbol < 0) || (distance_symbol >= 30))
+        return false;
+      size_t distance = DISTANCE_BASE[distance_symbol] +
+                        readBits(DISTANCE_BITS[distance_symbol]);
+      if ((distance > _outLength) || (_outLength + length >= _outSize))
+        return false;
+
+      // Byte by byte, the copy may overlap what it writes
+      for (size_t i = 0; i < length; i++, _outLength++)
+        _out[_outLength] = _out[_outLength - distance];
+    }
+  }
+
+  return false;
+}
+
+bool TelegramInflate::inflateStored() {
+  alignToByte(); // Stored blocks start at a byte boundary
+
+  uint16_t length = readBits(16);
+  uint16_t inverted = readBits(16);
+  if ((uint16_t)~length != inverted)
+    return false;
+  if (_outLength + length >= _outSize)
+    return false;
+
+  for (uint16_t i = 0; (i < length) && !_error; i++)
+    _out[_outLength++] = (char)readBits(8);
+
+  return !_error;
+}
+
+// Skip the bits left of the current byte. More than a byte may be buffered,
+// when the first bytes are put back after looking for a zlib header.
+void TelegramInflate::alignToByte() {
+  readBits(_bitCount % 8);
+}
+
+bool TelegramInflate::readGzipHeader() {
+  // ID1 ID2 CM FLG MTIME(4) XFL OS
+  if ((readBits(8) != 0x1F) || (readBits(8) != 0x8B) || (readBits(8) != 8))
+    return false;
+  uint8_t flags = readBits(8);
+  readBits(32);
+  readBits(16);
+
+  if (flags & 0x04) { // FEXTRA
+    uint16_t length = readBits(16);
+    for (uint16_t i = 0; (i < length) && !_error; i++)
+      readBits(8);
+  }
+  if (flags & 0x08) { // FNAME, NUL terminated
+    while ((readBits(8) != 0) && !_error);
+  }
+  if (flags & 0x10) { // FCOMMENT, NUL terminated
+    while ((readBits(8) != 0) && !_error);
+  }
+  if (flags & 0x02) // FHCRC
+    readBits(16);
+
+  return !_error;
+}
+
+long TelegramInflate::inflate(Stream &in, long in_length, char* out, size_t out_size,
+                              InflateFormat format, unsigned long timeout) {
+  _in = &in;
+  _inRemaining = in_length;
+  _start = millis();
+  _timeout = timeout;
+  _tag = 0;
+  _bitCount = 0;
+  _error = false;
+  _out = out;
+  _outLength = 0;
+  _outSize = out_size;
+  bytesIn = 0;
+
+  if (out_size == 0)
+    return -1;
+  out[0] = '\0';
+
+  bool zlib = (format == INFLATE_ZLIB);
+  if (format == INFLATE_GZIP) {
+    if (!readGzipHeader())
+      return -1;
+  } else if (format == INFLATE_DEFLATE) {
+    // A zlib header (CM 8, header checksum) is not likely the start of the
+    // raw deflate data that some servers send instead
+    uint8_t cmf = readBits(8);
+    uint8_t flg = readBits(8);
+    if (((cmf & 0x0F) == 8) && ((((uint16_t)cmf << 8) | flg) % 31 == 0) && !(flg & 0x20)) {
+      zlib = true;
+    } else {
+      // Raw after all, put both bytes back
+      _tag = ((uint32_t)flg << 8) | cmf;
+      _bitCount = 16;
+    }
+  } else if (zlib) {
+    uint8_t cmf = readBits(8);
+    uint8_t flg = readBits(8);
+    if (((cmf & 0x0F) != 8) || ((((uint16_t)cmf << 8) | flg) % 31 != 0) || (flg & 0x20))
+      return -1;
+  }
+
+  bool last = false;
+  while (!last) {
+    last = readBits(1);
+    uint8_t type = readBits(2);
+    bool inflated;
+    if (type == 0) {
+      inflated = inflateStored();
+    } else if (type == 1) {
+      buildFixedTrees();
+      inflated = inflateCodes();
+    } else if (type == 2) {
+      inflated = decodeTrees() && inflateCodes();
+    } else {
+      inflated = false;
+    }
+    if (!inflated || _error)
+      return -1;
+  }
+  out[_outLength] = '\0';
+
+  // Check the trailer against the inflated data
+  if (format == INFLATE_GZIP) {
+    alignToByte();
+    uint32_t crc = readBits(32);
+    uint32_t size = readBits(32);
+    if (_error || (crc != crc32Update(0, out, _outLength)) || (size != (uint32_t)_outLength))
+      return -1;
+  } else if (zlib) {
+    alignToByte();
+    uint32_t adler = 0;
+    for (uint8_t i = 0; i < 4; i++)
+      adler = (adler << 8) | readBits(8);
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < _outLength; i++) {
+      a = (a + (uint8_t)out[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+    if (_error || (adler != ((b << 16) | a)))
+      return -1;
+  }
+
+  return _outLength;
+}
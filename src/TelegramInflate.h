@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef TelegramInflate_h
+#define TelegramInflate_h
+
+#include <Arduino.h>
+
+enum InflateFormat { INFLATE_RAW, INFLATE_ZLIB, INFLATE_GZIP, INFLATE_DEFLATE };
+
+struct inflateTree {
+  uint16_t counts[16];   // Number of codes of each length
+  uint16_t symbols[288]; // Symbols ordered by code
+};
+
+/***************************************************************
+ * Streaming inflater for gzip or deflate encoded responses.   *
+ * The compressed data is read straight from the stream as it  *
+ * arrives, and inflated into the output buffer, which is also *
+ * the window for back references, so no other buffer is       *
+ * needed. INFLATE_DEFLATE (the HTTP "deflate" encoding) is    *
+ * zlib, or raw deflate from servers that get it wrong.        *
+ ***************************************************************/
+class TelegramInflate {
+public:
+  // Inflate up to in_length bytes (-1: until the end of the data) of in into
+  // out (NUL terminated). Returns the inflated length, or -1 if the data is
+  // not valid, does not fit, or does not arrive before timeout ms.
+  long inflate(Stream &in, long in_length, char* out, size_t out_size,
+               InflateFormat format, unsigned long timeout);
+
+  uint32_t bytesIn; // Compressed bytes read by the last inflate()
+
+private:
+  inflateTree _literals;
+  inflateTree _distances;
+  Stream *_in;
+  long _inRemaining;
+  unsigned long _start;
+  unsigned long _timeout;
+  uint32_t _tag;
+  uint8_t _bitCount;
+  bool _error;
+  char *_out;
+  size_t _outLength;
+  size_t _outSize;
+
+  int readByte();
+  uint32_t readBits(uint8_t count);
+  int decodeSymbol(const inflateTree &tree);
+  void buildTree(inflateTree &tree, const uint8_t* lengths, uint16_t count);
+  void buildFixedTrees();
+  bool decodeTrees();
+  bool inflateCodes();
+  bool inflateStored();
+  bool readGzipHeader();
+  void alignToByte();
+};
+
+#endif
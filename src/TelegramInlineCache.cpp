@@ -0,0 +1,92 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramInlineCache.h"
+
+TelegramInlineCache::TelegramInlineCache(uint32_t ttl) {
+  _ttl = ttl;
+  hits = 0;
+  misses = 0;
+  clear();
+}
+
+void TelegramInlineCache::clear() {
+  for (uint8_t i = 0; i < INLINE_CACHE_ENTRIES; i++)
+    _entries[i].used = false;
+}
+
+uint32_t TelegramInlineCache::ttl() {
+  return _ttl;
+}
+
+bool TelegramInlineCache::expired(const telegramInlineCacheEntry &entry) {
+  return (millis() - entry.stored_at) >= _ttl * 1000UL;
+}
+
+const char* TelegramInlineCache::get(const char* query) {
+  for (uint8_t i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+    telegramInlineCacheEntry &entry = _entries[i];
+    if (entry.used && (strcmp(entry.query, query) == 0)) {
+      if (expired(entry)) {
+        entry.used = false;
+        break;
+      }
+      hits++;
+      return entry.results;
+    }
+  }
+
+  misses++;
+  return NULL;
+}
+
+const char* TelegramInlineCache::put(const char* query, const char* results) {
+  if ((strlen(query) >= INLINE_CACHE_QUERY_LENGTH) ||
+      (strlen(results) >= INLINE_CACHE_RESULTS_LENGTH))
+    return results;
+
+  // Take the entry of the same query, or a free or expired one, or else the
+  // oldest one
+  telegramInlineCacheEntry *entry = NULL;
+  for (uint8_t i = 0; (i < INLINE_CACHE_ENTRIES) && (entry == NULL); i++) {
+    if (_entries[i].used && (strcmp(_entries[i].query, query) == 0))
+      entry = &_entries[i];
+  }
+  for (uint8_t i = 0; (i < INLINE_CACHE_ENTRIES) && (entry == NULL); i++) {
+    if (!_entries[i].used || expired(_entries[i]))
+      entry = &_entries[i];
+  }
+  if (entry == NULL) {
+    entry = &_entries[0];
+    for (uint8_t i = 1; i < INLINE_CACHE_ENTRIES; i++) {
+      if (millis() - _entries[i].stored_at > millis() - entry->stored_at)
+        entry = &_entries[i];
+    }
+  }
+
+  strcpy(entry->query, query);
+  strcpy(entry->results, results);
+  entry->stored_at = millis();
+  entry->used = true;
+
+  return entry->results;
+}
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef TelegramInlineCache_h
+#define TelegramInlineCache_h
+
+#include <Arduino.h>
+
+#ifndef INLINE_CACHE_ENTRIES
+#define INLINE_CACHE_ENTRIES 4
+#endif
+#ifndef INLINE_CACHE_RESULTS_LENGTH
+#define INLINE_CACHE_RESULTS_LENGTH 512
+#endif
+const uint8_t INLINE_CACHE_QUERY_LENGTH = 64;
+
+struct telegramInlineCacheEntry {
+  char query[INLINE_CACHE_QUERY_LENGTH];
+  char results[INLINE_CACHE_RESULTS_LENGTH];
+  unsigned long stored_at;
+  bool used;
+};
+
+/***************************************************************
+ * Serialized answers to inline queries (the JSON array of     *
+ * InlineQueryResult), keyed by the query string, so popular   *
+ * queries are answered without building the results again.    *
+ * Entries expire after ttl seconds, which is also the         *
+ * cache_time to give Telegram when answering.                 *
+ ***************************************************************/
+class TelegramInlineCache {
+public:
+  TelegramInlineCache(uint32_t ttl = 300);
+
+  // The cached results of query, NULL if not cached or expired
+  const char* get(const char* query);
+  // Cache the results of query. Returns the results to answer with: the
+  // cached copy, or results itself if they could not be cached.
+  const char* put(const char* query, const char* results);
+  void clear();
+  uint32_t ttl();
+
+  uint32_t hits;
+  uint32_t misses;
+
+private:
+  telegramInlineCacheEntry _entries[INLINE_CACHE_ENTRIES];
+  uint32_t _ttl;
+  bool expired(const telegramInlineCacheEntry &entry);
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "UniversalTelegramBot.h"
+#include "TelegramKeyboard.h"
+#include "TelegramStringCodec.h"
+
+TelegramKeyboard::TelegramKeyboard(bool inline_keyboard) {
+  _inline = inline_keyboard;
+  _resize = false;
+  _oneTime = false;
+  _selective = false;
+  clear();
+}
+
+void TelegramKeyboard::clear() {
+  strcpy(_rows, "[[]]");
+  _length = 4;
+  _flashRows = NULL;
+  _newRow = false;
+}
+
+bool TelegramKeyboard::isInline() const {
+  return _inline;
+}
+
+void TelegramKeyboard::setResize(bool resize) {
+  _resize = resize;
+}
+
+void TelegramKeyboard::setOneTime(bool one_time) {
+  _oneTime = one_time;
+}
+
+void TelegramKeyboard::setSelective(bool selective) {
+  _selective = selective;
+}
+
+// Append to the rows, escaping as JSON string content if needed. Nothing is
+// appended if it does not fit.
+bool TelegramKeyboard::append(const char* data, size_t length, bool escape) {
+  size_t needed = escape ? jsonEscapedLength(data, length) : length;
+
+  if (_length + needed >= MAX_KEYBOARD_LENGTH)
+    return false;
+  if (escape)
+    jsonEscape(&_rows[_length], MAX_KEYBOARD_LENGTH - _length, data, length);
+  else
+    memcpy(&_rows[_length], data, length);
+  _length += needed;
+  _rows[_length] = '\0';
+
+  return true;
+}
+
+/***************************************************************
+ * The rows are kept closed ("[[...]]") after every button, so *
+ * they can be sent at any time: a new button replaces the     *
+ * closing "]]" and closes the rows again.                     *
+ ***************************************************************/
+bool TelegramKeyboard::appendButton(const char* text, const char* field,
+                                    const char* value) {
+  uint16_t length = _length;
+  bool empty_row = (_rows[_length - 3] == '[');
+
+  if (_flashRows != NULL) // Rows given at once can not be extended
+    return false;
+
+  _length -= 2;
+  bool appended = true;
+  if (_newRow && !empty_row)
+    appended = append("],[", 3, false);
+  else if (!empty_row)
+    appended = append(",", 1, false);
+
+  if (_inline || (strcmp(field, "") != 0)) {
+    appended = appended && append("{\"text\":\"", 9, false) &&
+               append(text, strlen(text), true) &&
+               append("\",\"", 3, false) &&
+               append(field, strlen(field), false) &&
+               append("\":\"", 3, false) &&
+               append(value, strlen(value), true) &&
+               append("\"}", 2, false);
+  } else {
+    // Reply keyboard buttons can be just their text
+    appended = appended && append("\"", 1, false) &&
+               append(text, strlen(text), true) &&
+               append("\"", 1, false);
+  }
+  appended = appended && append("]]", 2, false);
+
+  if (!appended) {
+    // Restore the rows as they were before this button
+    _length = length;
+    memcpy(&_rows[_length - 2], "]]", 3);
+    return false;
+  }
+
+  _newRow = false;
+  return true;
+}
+
+bool TelegramKeyboard::addButton(const char* text, const char* callback_data) {
+  if (_inline)
+    return appendButton(text, "callback_data",
+                        (strcmp(callback_data, "") != 0) ? callback_data : text);
+  return appendButton(text, "", "");
+}
+
+// URL buttons only exist on inline keyboards, Telegram rejects them on reply
+// keyboards
+bool TelegramKeyboard::addUrlButton(const char* text, const char* url) {
+  if (!_inline)
+    return false;
+  return appendButton(text, "url", url);
+}
+
+void TelegramKeyboard::addRow() {
+  _newRow = true;
+}
+
+bool TelegramKeyboard::setRows(const char* json) {
+  DynamicJsonBuffer jsonBuffer;
+  JsonArray &rows = jsonBuffer.parseArray(json);
+
+  clear();
+  if (!rows.success())
+    return false;
+  if (rows.measureLength() >= MAX_KEYBOARD_LENGTH)
+    return false;
+  _length = rows.printTo(_rows, MAX_KEYBOARD_LENGTH);
+
+  return true;
+}
+
+bool TelegramKeyboard::setRows(const __FlashStringHelper* json) {
+  clear();
+  _flashRows = (const char*)json;
+  _length = strlen_P(_flashRows);
+
+  return true;
+}
+
+uint8_t TelegramKeyboard::getSegments(telegramBodySegment* segments) const {
+  if (_inline) {
+    segments[0].data = "{\"inline_keyboard\":";
+  } else {
+    segments[0].data = "{\"keyboard\":";
+  }
+  segments[0].length = strlen(segments[0].data);
+  segments[0].escape = false;
+  segments[0].flash = false;
+
+  segments[1].data = (_flashRows != NULL) ? _flashRows : _rows;
+  segments[1].length = _length;
+  segments[1].escape = false;
+  segments[1].flash = (_flashRows != NULL);
+
+  // Telegram defaults the reply keyboard options to false, so to decrease the
+  // size of the payload they are only sent if needed. One literal per
+  // combination, so no buffer is needed.
+  static const char* const options[] = {
+    "}",
+    ",\"resize_keyboard\":true}",
+    ",\"one_time_keyboard\":true}",
+    ",\"resize_keyboard\":true,\"one_time_keyboard\":true}",
+    ",\"selective\":true}",
+    ",\"resize_keyboard\":true,\"selective\":true}",
+    ",\"one_time_keyboard\":true,\"selective\":true}",
+    ",\"resize_keyboard\":true,\"one_time_keyboard\":true,\"selective\":true}"
+  };
+  uint8_t option = 0;
+  if (!_inline)
+    option = (_resize ? 1 : 0) | (_oneTime ? 2 : 0) | (_selective ? 4 : 0);
+  segments[2].data = options[option];
+  segments[2].length = strlen(options[option]);
+  segments[2].escape = false;
+  segments[2].flash = false;
+
+  return MAX_KEYBOARD_SEGMENTS;
+}
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramKeyboard_h
+#define TelegramKeyboard_h
+
+#include <Arduino.h>
+
+const uint16_t MAX_KEYBOARD_LENGTH = 1024;
+const uint8_t MAX_KEYBOARD_SEGMENTS = 3;
+
+struct telegramBodySegment;
+
+/***************************************************************
+ * A reply or inline keyboard, kept serialized as the JSON     *
+ * reply_markup object, so it is written into the requests     *
+ * verbatim instead of being parsed again on every send.       *
+ * Buttons can be added one by one, or all the rows given at   *
+ * once as a JSON array of arrays. Rows given as a flash       *
+ * string (F("...")) are sent straight from flash.             *
+ ***************************************************************/
+class TelegramKeyboard {
+public:
+  TelegramKeyboard(bool inline_keyboard = true);
+
+  // Build the keyboard button by button
+  bool addButton(const char* text, const char* callback_data = "");
+  bool addUrlButton(const char* text, const char* url);
+  void addRow();
+
+  // Set all the rows at once, i.e. [["ledon","ledoff"],["status"]]
+  bool setRows(const char* json);
+  bool setRows(const __FlashStringHelper* json);
+
+  // Reply keyboard options
+  void setResize(bool resize);
+  void setOneTime(bool one_time);
+  void setSelective(bool selective);
+
+  void clear();
+  bool isInline() const;
+
+  // Segments of the serialized reply_markup object
+  uint8_t getSegments(telegramBodySegment* segments) const;
+
+private:
+  char _rows[MAX_KEYBOARD_LENGTH];
+  const char* _flashRows;
+  uint16_t _length;
+  bool _inline;
+  bool _newRow;
+  bool _resize;
+  bool _oneTime;
+  bool _selective;
+  bool appendButton(const char* text, const char* field, const char* value);
+  bool append(const char* data, size_t length, bool escape);
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "UniversalTelegramBot.h"
+#include "TelegramMessageTemplate.h"
+#include "TelegramStringCodec.h"
+
+TelegramMessageTemplate::TelegramMessageTemplate() {
+  _body[0] = '\0';
+  _length = 0;
+  _placeholders = 0;
+  _partEnd[0] = 0;
+  _keyboard = NULL;
+}
+
+// Append to the body, escaping as JSON string content if needed. Nothing is
+// appended if it does not fit.
+bool TelegramMessageTemplate::append(const char* data, size_t length, bool escape) {
+  size_t needed = escape ? jsonEscapedLength(data, length) : length;
+
+  if (_length + needed >= MAX_TEMPLATE_LENGTH)
+    return false;
+  if (escape)
+    jsonEscape(&_body[_length], MAX_TEMPLATE_LENGTH - _length, data, length);
+  else
+    memcpy(&_body[_length], data, length);
+  _length += needed;
+  _body[_length] = '\0';
+
+  return true;
+}
+
+/***************************************************************
+ * Serialize the static part of the body, which follows the    *
+ * chat_id (and keyboard):                                     *
+ *   [,"parse_mode":".."][,"disable_notification":true],       *
+ *   "text":"<part 0>  <part 1> .. <part n>"}                  *
+ * with the parts already escaped, so they are sent as is.     *
+ ***************************************************************/
+bool TelegramMessageTemplate::begin(const char* text, const char* parse_mode,
+                                    bool disable_notification) {
+  _length = 0;
+  _placeholders = 0;
+
+  bool serialized = true;
+  if (strcmp(parse_mode, "") != 0) {
+    serialized = append(",\"parse_mode\":\"", 15, false) &&
+                 append(parse_mode, strlen(parse_mode), true) &&
+                 append("\"", 1, false);
+  }
+  if (disable_notification)
+    serialized = serialized && append(",\"disable_notification\":true", 28, false);
+  serialized = serialized && append(",\"text\":\"", 9, false);
+
+  const char* part = text;
+  const char* placeholder;
+  while (serialized && ((placeholder = strstr(part, "{}")) != NULL) &&
+         (_placeholders < MAX_TEMPLATE_PLACEHOLDERS)) {
+    serialized = append(part, placeholder - part, true);
+    _partEnd[_placeholders++] = _length;
+    part = placeholder + 2;
+  }
+  serialized = serialized && append(part, strlen(part), true) &&
+               append("\"}", 2, false);
+  _partEnd[_placeholders] = _length;
+
+  if (!serialized) {
+    _length = 0;
+    _placeholders = 0;
+    _partEnd[0] = 0;
+  }
+
+  return serialized;
+}
+
+void TelegramMessageTemplate::setKeyboard(const TelegramKeyboard &keyboard) {
+  _keyboard = &keyboard;
+}
+
+uint8_t TelegramMessageTemplate::placeholders() const {
+  return _placeholders;
+}
+
+uint8_t TelegramMessageTemplate::getSegments(telegramBodySegment* segments,
+                                             const char* chat_id,
+                                             const char* const* values,
+                                             uint8_t count) const {
+  uint8_t n = 0;
+
+  if (_length == 0) // Not serialized
+    return 0;
+
+  segments[n++] = (telegramBodySegment){ "{\"chat_id\":\"", 12, false, false };
+  segments[n++] = (telegramBodySegment){ chat_id, strlen(chat_id), true, false };
+  segments[n++] = (telegramBodySegment){ "\"", 1, false, false };
+  if (_keyboard != NULL) {
+    segments[n++] = (telegramBodySegment){ ",\"reply_markup\":", 16, false, false };
+    n += _keyboard->getSegments(&segments[n]);
+  }
+
+  uint16_t start = 0;
+  for (uint8_t i = 0; i <= _placeholders; i++) {
+    segments[n++] = (telegramBodySegment){ &_body[start], (size_t)(_partEnd[i] - start),
+                                           false, false };
+    start = _partEnd[i];
+    if (i < _placeholders) {
+      const char* value = ((i < count) && (values[i] != NULL)) ? values[i] : "";
+      segments[n++] = (telegramBodySegment){ value, strlen(value), true, false };
+    }
+  }
+
+  return n;
+}
@@ -0,0 +1,72 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef TelegramMessageTemplate_h
+#define TelegramMessageTemplate_h
+
+#include <Arduino.h>
+
+#ifndef MAX_TEMPLATE_LENGTH
+#define MAX_TEMPLATE_LENGTH 1024
+#endif
+const uint8_t MAX_TEMPLATE_PLACEHOLDERS = 8;
+// {"chat_id":"<chat_id>", the keyboard, and the text parts and values
+const uint8_t MAX_TEMPLATE_SEGMENTS = 3 + 1 + 3 + 1 + 2 * MAX_TEMPLATE_PLACEHOLDERS;
+
+class TelegramKeyboard;
+struct telegramBodySegment;
+
+/***************************************************************
+ * A message sent many times with the same shape, where only   *
+ * some values in the text change, i.e.                        *
+ *   "Temperature: {} C, humidity: {} %"                       *
+ * The body of the request, but the chat_id and the values of  *
+ * the {} placeholders, is serialized and escaped once in      *
+ * begin(). Sending it then only escapes the values.           *
+ ***************************************************************/
+class TelegramMessageTemplate {
+public:
+  TelegramMessageTemplate();
+
+  bool begin(const char* text, const char* parse_mode = "",
+             bool disable_notification = false);
+  // The keyboard is not copied, it must live as long as the template
+  void setKeyboard(const TelegramKeyboard &keyboard);
+
+  uint8_t placeholders() const;
+
+  // Segments of the request body, none if begin() failed. Missing values
+  // are sent empty.
+  uint8_t getSegments(telegramBodySegment* segments, const char* chat_id,
+                      const char* const* values, uint8_t count) const;
+
+private:
+  char _body[MAX_TEMPLATE_LENGTH];
+  // End of each text part in _body, the first one includes the options
+  uint16_t _partEnd[MAX_TEMPLATE_PLACEHOLDERS + 1];
+  uint8_t _placeholders;
+  const TelegramKeyboard *_keyboard;
+  uint16_t _length;
+  bool append(const char* data, size_t length, bool escape);
+};
+
+#endif
@@ -0,0 +1,192 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramOutbox.h"
+#include "TelegramStringCodec.h"
+
+TelegramOutbox::TelegramOutbox(UniversalTelegramBot &bot, bool editInPlace,
+                               const char* parse_mode) {
+  _bot = &bot;
+  _editInPlace = editInPlace;
+  _parseMode = parse_mode;
+  _interval = 1000; // Telegram allows about one message per second to a chat
+  _sentAt = 0;
+  _heldAt = 0;
+  _hold = 0;
+  _next = 0;
+  memset(_entries, 0, sizeof(_entries));
+  memset(&stats, 0, sizeof(stats));
+}
+
+void TelegramOutbox::setInterval(unsigned long interval) {
+  _interval = interval;
+}
+
+/***************************************************************
+ * Post - queue an update, replacing the pending one of the    *
+ * same chat and slot. A new chat/slot takes a free entry, or  *
+ * the least recently used one that is not pending.            *
+ * Returns false if the update was dropped (all pending)       *
+ ***************************************************************/
+bool TelegramOutbox::post(const char* chat_id, uint8_t slot, const char* text) {
+  telegramOutboxEntry *entry = NULL;
+  telegramOutboxEntry *spare = NULL;
+
+  stats.posted++;
+  for (uint8_t i = 0; i < OUTBOX_SLOTS; i++) {
+    telegramOutboxEntry &e = _entries[i];
+    if (e.used && (e.slot == slot) && (strcmp(e.chat_id, chat_id) == 0)) {
+      entry = &e;
+      break;
+    }
+    if (!e.used) {
+      if ((spare == NULL) || spare->used)
+        spare = &e;
+    } else if (!e.pending && ((spare == NULL) ||
+               (spare->used && (e.used_at < spare->used_at)))) {
+      spare = &e;
+    }
+  }
+
+  if (entry == NULL) {
+    if (spare == NULL) {
+      stats.dropped++;
+      return false;
+    }
+    entry = spare;
+    memset(entry, 0, sizeof(*entry));
+    utf8Copy(entry->chat_id, chat_id, sizeof(entry->chat_id));
+    entry->slot = slot;
+    entry->used = true;
+  } else if (entry->pending) {
+    stats.coalesced++;
+  }
+
+  utf8Copy(entry->text, text, sizeof(entry->text));
+  entry->used_at = millis();
+  // Nothing to send if the slot's message already shows this text
+  if ((entry->message_id != 0) &&
+      (crc32Update(0, entry->text, strlen(entry->text)) == entry->sent_crc)) {
+    stats.unchanged++;
+    entry->pending = false;
+    return true;
+  }
+  entry->pending = true;
+
+  return true;
+}
+
+bool TelegramOutbox::send(telegramOutboxEntry &entry) {
+  SendResult result = SEND_REJECTED;
+  bool sent = false;
+
+  _bot->beginBatch();
+  if (_editInPlace && (entry.message_id != 0)) {
+    result = _bot->tryEditMessageText(entry.chat_id, entry.message_id, entry.text,
+                                      _parseMode);
+    if (result == SEND_OK) {
+      sent = true;
+      stats.edited++;
+    } else if ((result == SEND_REJECTED) && _bot->notModified()) {
+      // Already shows this text, i.e. an edit whose answer was lost
+      sent = true;
+      stats.unchanged++;
+    } else if (result == SEND_REJECTED) {
+      // The message was deleted (or can no longer be edited), send a new one
+      entry.message_id = 0;
+    }
+  }
+
+  if (!sent && (entry.message_id == 0)) {
+    _bot->last_sent_message_id = 0;
+    result = _bot->trySendMessage(entry.chat_id, entry.text, _parseMode);
+    if (result == SEND_OK) {
+      sent = true;
+      stats.sent++;
+      if (_editInPlace)
+        entry.message_id = _bot->last_sent_message_id;
+    }
+  }
+
+  if (sent) {
+    entry.pending = false;
+    entry.sent_crc = crc32Update(0, entry.text, strlen(entry.text));
+  } else {
+    stats.failed++; // Stays pending, to be sent again
+    if (_bot->lastRequest.http_status == 429) {
+      stats.rate_limited++;
+      _heldAt = millis();
+      _hold = _bot->retryAfter() * 1000;
+    }
+  }
+  _bot->endBatch();
+
+  return sent;
+}
+
+// Waiting for the retry_after of a 429
+bool TelegramOutbox::held() {
+  if ((_hold > 0) && (millis() - _heldAt < _hold))
+    return true;
+  _hold = 0;
+  return false;
+}
+
+bool TelegramOutbox::loop() {
+  if (held() || ((_sentAt != 0) && (millis() - _sentAt < _interval)))
+    return false;
+
+  // Round robin, so a slot updated very often does not starve the others
+  for (uint8_t i = 0; i < OUTBOX_SLOTS; i++) {
+    telegramOutboxEntry &entry = _entries[(_next + i) % OUTBOX_SLOTS];
+    if (entry.pending) {
+      _next = (_next + i + 1) % OUTBOX_SLOTS;
+      _sentAt = millis();
+      return send(entry);
+    }
+  }
+
+  return false;
+}
+
+uint8_t TelegramOutbox::flush() {
+  uint8_t sent = 0;
+
+  for (uint8_t i = 0; (i < OUTBOX_SLOTS) && !held(); i++) {
+    if (_entries[i].pending && send(_entries[i]))
+      sent++;
+  }
+  _sentAt = millis();
+
+  return sent;
+}
+
+uint8_t TelegramOutbox::pending() {
+  uint8_t count = 0;
+
+  for (uint8_t i = 0; i < OUTBOX_SLOTS; i++) {
+    if (_entries[i].pending)
+      count++;
+  }
+
+  return count;
+}
@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef TelegramOutbox_h
+#define TelegramOutbox_h
+
+#include <Arduino.h>
+#include "UniversalTelegramBot.h"
+
+#ifndef OUTBOX_SLOTS
+#define OUTBOX_SLOTS 4
+#endif
+#ifndef OUTBOX_TEXT_LENGTH
+#define OUTBOX_TEXT_LENGTH 256
+#endif
+const uint8_t OUTBOX_CHAT_ID_LENGTH = 32;
+
+struct telegramOutboxEntry {
+  char chat_id[OUTBOX_CHAT_ID_LENGTH];
+  uint8_t slot;
+  char text[OUTBOX_TEXT_LENGTH];
+  long message_id;      // Message showing this slot, to edit it in place
+  uint32_t sent_crc;    // CRC-32 of the text shown by that message
+  unsigned long used_at;
+  bool used;
+  bool pending;
+};
+
+struct telegramOutboxStats {
+  uint32_t posted;     // Updates given to post()
+  uint32_t coalesced;  // Replaced by a newer update before being sent
+  uint32_t unchanged;  // Not sent, the message already shows that text
+  uint32_t sent;       // Sent as new messages
+  uint32_t edited;     // Sent by editing the slot's message
+  uint32_t failed;
+  uint32_t dropped;    // No free entry, all were pending
+  uint32_t rate_limited; // 429 responses, nothing is sent for retry_after
+};
+
+/***************************************************************
+ * An outbox of status updates, keyed by chat and slot (i.e.   *
+ * one slot per sensor). A newer update replaces the pending   *
+ * one of its slot, so only the latest value is sent, no       *
+ * faster than the interval. With editInPlace, each slot keeps *
+ * a single message which is edited with the new value.        *
+ * Updates are sent one attempt at a time, so loop() does not  *
+ * block; after a 429 the outbox waits as long as Telegram     *
+ * asks.                                                       *
+ ***************************************************************/
+class TelegramOutbox {
+public:
+  TelegramOutbox(UniversalTelegramBot &bot, bool editInPlace = true,
+                 const char* parse_mode = "");
+
+  bool post(const char* chat_id, uint8_t slot, const char* text);
+  // Send one pending update if the interval has passed since the last send.
+  // Returns true if something was sent.
+  bool loop();
+  // Send all the pending updates now (until a 429), returns how many were sent
+  uint8_t flush();
+  uint8_t pending();
+  void setInterval(unsigned long interval);
+
+  telegramOutboxStats stats;
+
+private:
+  UniversalTelegramBot *_bot;
+  telegramOutboxEntry _entries[OUTBOX_SLOTS];
+  const char* _parseMode;
+  unsigned long _interval;
+  unsigned long _sentAt;
+  unsigned long _heldAt;
+  unsigned long _hold;  // ms from _heldAt, after a 429
+  uint8_t _next;
+  bool _editInPlace;
+  bool send(telegramOutboxEntry &entry);
+  bool held();
+};
+
+#endif
@@ -0,0 +1,181 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramPosixClient.h"
+
+#ifndef ARDUINO
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+TelegramPosixClient::TelegramPosixClient() {
+  _socket = -1;
+}
+
+TelegramPosixClient::~TelegramPosixClient() {
+  stop();
+}
+
+bool TelegramPosixClient::connectAddress(const struct sockaddr* address,
+                                         socklen_t length) {
+  stop();
+  _socket = socket(address->sa_family, SOCK_STREAM, 0);
+  if (_socket < 0)
+    return false;
+  if (::connect(_socket, address, length) != 0) {
+    stop();
+    return false;
+  }
+  // Requests are written in pieces, do not hold them back
+  int one = 1;
+  setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  return true;
+}
+
+int TelegramPosixClient::connect(IPAddress ip, uint16_t port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  uint8_t* bytes = (uint8_t*)&address.sin_addr.s_addr;
+  for (uint8_t i = 0; i < 4; i++)
+    bytes[i] = ip[i];
+
+  return connectAddress((struct sockaddr*)&address, sizeof(address));
+}
+
+int TelegramPosixClient::connect(const char* host, uint16_t port) {
+  struct addrinfo hints;
+  struct addrinfo* addresses;
+  char service[8];
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &addresses) != 0)
+    return false;
+
+  bool connected = false;
+  for (struct addrinfo* a = addresses; (a != NULL) && !connected; a = a->ai_next)
+    connected = connectAddress(a->ai_addr, a->ai_addrlen);
+  freeaddrinfo(addresses);
+
+  return connected;
+}
+
+size_t TelegramPosixClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t TelegramPosixClient::write(const uint8_t* buf, size_t size) {
+  size_t written = 0;
+
+  while ((_socket >= 0) && (written < size)) {
+    ssize_t sent = send(_socket, buf + written, size - written, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      stop();
+      break;
+    }
+    written += sent;
+  }
+
+  return written;
+}
+
+int TelegramPosixClient::available() {
+  int count = 0;
+
+  if ((_socket < 0) || (ioctl(_socket, FIONREAD, &count) != 0))
+    return 0;
+
+  return count;
+}
+
+int TelegramPosixClient::read() {
+  uint8_t b;
+
+  if (read(&b, 1) != 1)
+    return -1;
+
+  return b;
+}
+
+int TelegramPosixClient::read(uint8_t* buf, size_t size) {
+  if (available() <= 0) // Like the Arduino clients, never block
+    return -1;
+
+  ssize_t received = recv(_socket, buf, size, MSG_DONTWAIT);
+  if (received <= 0)
+    return -1;
+
+  return received;
+}
+
+int TelegramPosixClient::peek() {
+  uint8_t b;
+
+  if ((available() <= 0) || (recv(_socket, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 1))
+    return -1;
+
+  return b;
+}
+
+void TelegramPosixClient::flush() {
+}
+
+void TelegramPosixClient::stop() {
+  if (_socket >= 0) {
+    close(_socket);
+    _socket = -1;
+  }
+}
+
+// Connected until the server closes the connection and everything it sent
+// has been read
+uint8_t TelegramPosixClient::connected() {
+  uint8_t b;
+
+  if (_socket < 0)
+    return false;
+  if (available() > 0)
+    return true;
+
+  ssize_t received = recv(_socket, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (received == 0 || ((received < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+    stop();
+    return false;
+  }
+
+  return true;
+}
+
+TelegramPosixClient::operator bool() {
+  return _socket >= 0;
+}
+#endif
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef TelegramPosixClient_h
+#define TelegramPosixClient_h
+
+#ifndef ARDUINO
+#include <Arduino.h>
+#include <Client.h>
+#include <sys/socket.h>
+
+/***************************************************************
+ * Plain TCP client over POSIX sockets, for builds on a host   *
+ * (Linux) machine, i.e. to run the bot against a local Bot    *
+ * API server or a stand-in server (see setServer()).          *
+ ***************************************************************/
+class TelegramPosixClient : public Client {
+public:
+  TelegramPosixClient();
+  ~TelegramPosixClient();
+
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char* host, uint16_t port);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t* buf, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+  operator bool();
+
+  using Print::write;
+
+private:
+  int _socket;
+  bool connectAddress(const struct sockaddr* address, socklen_t length);
+};
+#endif
+
+#endif
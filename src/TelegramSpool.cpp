@@ -0,0 +1,297 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "TelegramSpool.h"
+#include "TelegramCrc32.h"
+
+const uint8_t SPOOL_MAGIC = 0xA5;
+const uint8_t SPOOL_MESSAGE = 1;
+const uint8_t SPOOL_DONE = 2;
+
+TelegramSpool::TelegramSpool(UniversalTelegramBot &bot, TelegramLogStorage &storage,
+                             SpoolDropPolicy policy) {
+  _bot = &bot;
+  _storage = &storage;
+  _policy = policy;
+  _head = 0;
+  _pending = 0;
+  _nextSequence = 1;
+  _doneSequence = 0;
+  _retryInterval = 5000;
+  _retryDelay = 0;
+  _failedAt = 0;
+  _lastDrainSent = 0;
+  _lastDrainMs = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void TelegramSpool::setRetryInterval(unsigned long interval) {
+  _retryInterval = interval;
+}
+
+uint32_t TelegramSpool::pending() {
+  return _pending;
+}
+
+float TelegramSpool::drainRate() {
+  if (_lastDrainMs == 0)
+    return 0;
+  return _lastDrainSent * 1000.0f / _lastDrainMs;
+}
+
+static uint32_t recordCrc(telegramSpoolHeader header, const char* payload) {
+  header.crc = 0;
+  uint32_t crc = crc32Update(0, &header, sizeof(header));
+  return crc32Update(crc, payload, header.length);
+}
+
+// Read and check the record at position, its payload into _record
+bool TelegramSpool::readRecord(size_t position, telegramSpoolHeader &header) {
+  if (!_storage->read(position, &header, sizeof(header)))
+    return false;
+  if ((header.magic != SPOOL_MAGIC) || (header.length > SPOOL_RECORD_LENGTH))
+    return false;
+  if (!_storage->read(position + sizeof(header), _record, header.length))
+    return false;
+  _record[header.length] = '\0';
+
+  return header.crc == recordCrc(header, _record);
+}
+
+bool TelegramSpool::appendRecord(uint8_t type, uint32_t sequence, const char* payload,
+                                 uint16_t length) {
+  uint8_t record[sizeof(telegramSpoolHeader) + SPOOL_RECORD_LENGTH];
+  telegramSpoolHeader header;
+
+  header.magic = SPOOL_MAGIC;
+  header.type = type;
+  header.length = length;
+  header.sequence = sequence;
+  header.crc = recordCrc(header, payload);
+  // Appended in a single write, so a reset can only tear the last record
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), payload, length);
+
+  return _storage->append(record, sizeof(header) + length);
+}
+
+/***************************************************************
+ * Scan the log: the messages after the last done record are   *
+ * pending. A record torn by a reset in the middle of an       *
+ * append ends the log, and is cut off.                        *
+ ***************************************************************/
+uint32_t TelegramSpool::begin() {
+  telegramSpoolHeader header;
+  size_t position = 0;
+
+  _storage->recover();
+  size_t size = _storage->size();
+
+  _doneSequence = 0;
+  _nextSequence = 1;
+  while ((position < size) && readRecord(position, header)) {
+    if ((header.type == SPOOL_DONE) && (header.sequence > _doneSequence))
+      _doneSequence = header.sequence;
+    if (header.sequence >= _nextSequence)
+      _nextSequence = header.sequence + 1;
+    position += sizeof(header) + header.length;
+  }
+  if (position < size)
+    _storage->truncate(position);
+
+  // Count the messages still to send, and skip those already sent
+  _head = 0;
+  _pending = 0;
+  bool head_found = false;
+  for (size_t p = 0; (p < position) && readRecord(p, header);
+       p += sizeof(header) + header.length) {
+    if ((header.type == SPOOL_MESSAGE) && (header.sequence > _doneSequence)) {
+      _pending++;
+      head_found = true;
+    }
+    if (!head_found)
+      _head = p + sizeof(header) + header.length;
+  }
+  if (_pending == 0) {
+    _storage->truncate(0);
+    _head = 0;
+  }
+  stats.high_water = _storage->size();
+
+  return _pending;
+}
+
+// Drop the records already consumed from the storage
+void TelegramSpool::compact() {
+  if ((_head > 0) && _storage->discard(_head))
+    _head = 0;
+}
+
+// Drop the oldest pending message, by discarding the log up to its end so
+// it is gone after a reset too. False if there is none, or the storage
+// could not discard it (then nothing changed).
+bool TelegramSpool::dropOldest() {
+  telegramSpoolHeader header;
+  size_t size = _storage->size();
+  size_t position = _head;
+
+  while ((position < size) && readRecord(position, header)) {
+    position += sizeof(header) + header.length;
+    if ((header.type == SPOOL_MESSAGE) && (header.sequence > _doneSequence)) {
+      if (!_storage->discard(position))
+        return false;
+      _head = 0;
+      _doneSequence = header.sequence;
+      _pending--;
+      stats.dropped++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TelegramSpool::sendMessage(const char* chat_id, const char* text,
+                                const char* parse_mode) {
+  size_t chat_id_length = strlen(chat_id);
+  size_t parse_mode_length = strlen(parse_mode);
+  size_t text_length = strlen(text);
+
+  if ((chat_id_length >= SPOOL_CHAT_ID_LENGTH) ||
+      (parse_mode_length >= SPOOL_PARSE_MODE_LENGTH) ||
+      (text_length > SPOOL_TEXT_LENGTH))
+    return false;
+
+  uint16_t length = chat_id_length + 1 + parse_mode_length + 1 + text_length;
+  memcpy(_record, chat_id, chat_id_length + 1);
+  memcpy(_record + chat_id_length + 1, parse_mode, parse_mode_length + 1);
+  memcpy(_record + chat_id_length + parse_mode_length + 2, text, text_length);
+
+  size_t needed = sizeof(telegramSpoolHeader) + length;
+  if (_storage->size() + needed > _storage->capacity()) {
+    compact();
+    while ((_storage->size() + needed > _storage->capacity()) &&
+           (_policy == SPOOL_DROP_OLDEST) && dropOldest())
+      ;
+    if (_storage->size() + needed > _storage->capacity()) {
+      stats.dropped++;
+      return false;
+    }
+    // Compacting reused _record, build it again
+    memcpy(_record, chat_id, chat_id_length + 1);
+    memcpy(_record + chat_id_length + 1, parse_mode, parse_mode_length + 1);
+    memcpy(_record + chat_id_length + parse_mode_length + 2, text, text_length);
+  }
+
+  if (!appendRecord(SPOOL_MESSAGE, _nextSequence, _record, length))
+    return false;
+  _nextSequence++;
+  _pending++;
+  stats.queued++;
+  if (_storage->size() > stats.high_water)
+    stats.high_water = _storage->size();
+
+  return true;
+}
+
+void TelegramSpool::backOff() {
+  _failedAt = millis();
+  if (_retryDelay == 0)
+    _retryDelay = _retryInterval;
+  else if (_retryDelay < SPOOL_MAX_RETRY_INTERVAL / 2)
+    _retryDelay *= 2;
+  else
+    _retryDelay = SPOOL_MAX_RETRY_INTERVAL;
+}
+
+uint16_t TelegramSpool::loop() {
+  telegramSpoolHeader header;
+  uint16_t sent = 0;
+
+  if (_pending == 0)
+    return 0;
+  if ((_retryDelay > 0) && (millis() - _failedAt < _retryDelay))
+    return 0;
+
+  unsigned long start = millis();
+  size_t size = _storage->size();
+  bool failed = false;
+  unsigned long retry_after = 0;
+  uint32_t done_before = _doneSequence;
+  stats.drains++;
+  _bot->beginBatch();
+
+  while ((sent < SPOOL_BATCH) && (_head < size) && readRecord(_head, header)) {
+    size_t next = _head + sizeof(header) + header.length;
+    if ((header.type != SPOOL_MESSAGE) || (header.sequence <= _doneSequence)) {
+      _head = next;
+      continue;
+    }
+
+    const char* chat_id = _record;
+    const char* parse_mode = chat_id + strlen(chat_id) + 1;
+    const char* text = parse_mode + strlen(parse_mode) + 1;
+
+    SendResult result = _bot->trySendMessage(chat_id, text, parse_mode);
+    if (result == SEND_OK) {
+      sent++;
+      stats.sent++;
+    } else if (result == SEND_REJECTED) {
+      stats.rejected++; // Sending it again will not help
+    } else {
+      // No response (not connected, or the connection was lost), rate
+      // limited or server error: keep it for the next attempt
+      if (result == SEND_OFFLINE)
+        stats.offline++;
+      else if (_bot->lastRequest.http_status == 429)
+        retry_after = _bot->retryAfter() * 1000;
+      failed = true;
+      break;
+    }
+    _head = next;
+    _doneSequence = header.sequence;
+    _pending--;
+  }
+
+  if (_pending == 0) {
+    // All sent, start the log over
+    _storage->truncate(0);
+    _head = 0;
+  } else if (_doneSequence != done_before) {
+    // Keep the progress across a reset
+    appendRecord(SPOOL_DONE, _doneSequence, "", 0);
+  }
+  _bot->endBatch(_pending == 0);
+
+  if (failed) {
+    backOff();
+    if (retry_after > _retryDelay)
+      _retryDelay = retry_after;
+  } else {
+    _retryDelay = 0;
+  }
+  _lastDrainSent = sent;
+  _lastDrainMs = millis() - start;
+  stats.drain_ms += _lastDrainMs;
+
+  return sent;
+}
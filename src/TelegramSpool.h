@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramSpool_h
+#define TelegramSpool_h
+
+#include <Arduino.h>
+#include "UniversalTelegramBot.h"
+
+#ifndef SPOOL_TEXT_LENGTH
+#define SPOOL_TEXT_LENGTH 1024
+#endif
+#ifndef SPOOL_BATCH
+#define SPOOL_BATCH 16
+#endif
+const uint8_t SPOOL_CHAT_ID_LENGTH = 32;
+const uint8_t SPOOL_PARSE_MODE_LENGTH = 16;
+const uint16_t SPOOL_RECORD_LENGTH = SPOOL_CHAT_ID_LENGTH + SPOOL_PARSE_MODE_LENGTH +
+                                     SPOOL_TEXT_LENGTH;
+const unsigned long SPOOL_MAX_RETRY_INTERVAL = 60000;
+
+// What to do with a new message when the spool is full
+enum SpoolDropPolicy { SPOOL_DROP_NEWEST, SPOOL_DROP_OLDEST };
+
+// Header of a record of the spool, followed by length bytes of payload. A
+// message payload is "<chat_id>\0<parse_mode>\0<text>"; a done record has no
+// payload, and marks all the messages up to its sequence as sent.
+struct telegramSpoolHeader {
+  uint8_t magic;
+  uint8_t type;
+  uint16_t length;
+  uint32_t sequence;
+  uint32_t crc; // CRC-32 of the header (with crc 0) and the payload
+};
+
+struct telegramSpoolStats {
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t dropped;    // By the drop policy, the spool being full
+  uint32_t rejected;   // Refused by Telegram (i.e. chat not found), not retried
+  uint32_t drains;     // Batches sent (one connection each)
+  uint32_t drain_ms;   // Total time spent sending batches
+  uint32_t offline;    // Drains stopped by a failed connection
+  uint32_t high_water; // Most bytes stored at once
+};
+
+/***************************************************************
+ * Outbound spool: sendMessage() only appends the message to a *
+ * log in storage (a file, or RAM), so it returns at once even *
+ * with WiFi down, and the message survives a reset if the log *
+ * does. loop() sends the spooled messages in order, up to     *
+ * SPOOL_BATCH at a time on one kept-alive connection, once    *
+ * the server can be reached again. Failed attempts back off   *
+ * from the retry interval up to a minute. Messages are sent   *
+ * at least once: a reset in the middle of a batch may send    *
+ * some of them again.                                         *
+ ***************************************************************/
+class TelegramSpool {
+public:
+  TelegramSpool(UniversalTelegramBot &bot, TelegramLogStorage &storage,
+                SpoolDropPolicy policy = SPOOL_DROP_NEWEST);
+
+  // Recover the messages left in the storage, returns how many
+  uint32_t begin();
+  // Spool a message. False if it is too long or dropped (spool full).
+  bool sendMessage(const char* chat_id, const char* text, const char* parse_mode = "");
+  // Send a batch of spooled messages when due, returns how many were sent
+  uint16_t loop();
+  uint32_t pending();
+  void setRetryInterval(unsigned long interval);
+  // Messages per second sent by the last batch
+  float drainRate();
+
+  telegramSpoolStats stats;
+
+private:
+  UniversalTelegramBot *_bot;
+  TelegramLogStorage *_storage;
+  SpoolDropPolicy _policy;
+  char _record[SPOOL_RECORD_LENGTH + 1];
+  size_t _head;           // Offset of the first record not consumed
+  uint32_t _pending;
+  uint32_t _nextSequence;
+  uint32_t _doneSequence; // Messages up to this one were sent
+  unsigned long _retryInterval;
+  unsigned long _retryDelay;
+  unsigned long _failedAt;
+  uint32_t _lastDrainSent;
+  uint32_t _lastDrainMs;
+  bool readRecord(size_t position, telegramSpoolHeader &header);
+  bool appendRecord(uint8_t type, uint32_t sequence, const char* payload, uint16_t length);
+  bool dropOldest();
+  void compact();
+  void backOff();
+};
+
+#endif
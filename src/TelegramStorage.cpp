@@ -0,0 +1,406 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "TelegramStorage.h"
+
+#ifndef ARDUINO
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(ESP8266) || defined(ESP32)
+#include <EEPROM.h>
+#endif
+
+#if defined(ESP32)
+#include <esp_attr.h>
+// Not initialized at boot, so it keeps its content across software resets
+// and deep sleep. The bot validates the record with a checksum.
+RTC_NOINIT_ATTR static uint8_t rtc_storage[RTC_STORAGE_END];
+#endif
+
+/***************************************************************
+ * Memory log                                                  *
+ ***************************************************************/
+TelegramMemoryLog::TelegramMemoryLog(uint8_t* buffer, size_t size) {
+  _buffer = buffer;
+  _capacity = size;
+  _size = 0;
+}
+
+size_t TelegramMemoryLog::capacity() {
+  return _capacity;
+}
+
+size_t TelegramMemoryLog::size() {
+  return _size;
+}
+
+bool TelegramMemoryLog::append(const void* data, size_t length) {
+  if (length > _capacity - _size)
+    return false;
+  memcpy(_buffer + _size, data, length);
+  _size += length;
+
+  return true;
+}
+
+bool TelegramMemoryLog::read(size_t position, void* data, size_t length) {
+  if ((position > _size) || (length > _size - position))
+    return false;
+  memcpy(data, _buffer + position, length);
+
+  return true;
+}
+
+bool TelegramMemoryLog::truncate(size_t length) {
+  if (length < _size)
+    _size = length;
+
+  return true;
+}
+
+bool TelegramMemoryLog::discard(size_t length) {
+  if (length >= _size) {
+    _size = 0;
+  } else {
+    memmove(_buffer, _buffer + length, _size - length);
+    _size -= length;
+  }
+
+  return true;
+}
+
+#if defined(ESP8266) || defined(ESP32)
+
+/***************************************************************
+ * RTC memory storage                                          *
+ ***************************************************************/
+TelegramRTCStorage::TelegramRTCStorage(uint16_t offset) {
+  _offset = offset;
+}
+
+size_t TelegramRTCStorage::capacity() {
+  if ((_offset < RTC_STORAGE_START) || (_offset >= RTC_STORAGE_END))
+    return 0;
+  return RTC_STORAGE_END - _offset;
+}
+
+bool TelegramRTCStorage::load(void* data, size_t length) {
+  if (length > capacity())
+    return false;
+
+#if defined(ESP8266)
+  // RTC user memory is accessed in aligned 4 bytes blocks
+  uint32_t block[RTC_STORAGE_END / 4];
+  if (!ESP.rtcUserMemoryRead(_offset / 4, block, (length + 3) & ~3))
+    return false;
+  memcpy(data, block, length);
+#else
+  memcpy(data, &rtc_storage[_offset], length);
+#endif
+
+  return true;
+}
+
+bool TelegramRTCStorage::save(const void* data, size_t length) {
+  if (length > capacity())
+    return false;
+
+#if defined(ESP8266)
+  uint32_t block[RTC_STORAGE_END / 4];
+  memset(block, 0, sizeof(block));
+  memcpy(block, data, length);
+  return ESP.rtcUserMemoryWrite(_offset / 4, block, (length + 3) & ~3);
+#else
+  memcpy(&rtc_storage[_offset], data, length);
+  return true;
+#endif
+}
+
+/***************************************************************
+ * EEPROM storage                                              *
+ ***************************************************************/
+TelegramEEPROMStorage::TelegramEEPROMStorage(int address, size_t size) {
+  _address = address;
+  _size = size;
+}
+
+size_t TelegramEEPROMStorage::capacity() {
+  return _size;
+}
+
+bool TelegramEEPROMStorage::load(void* data, size_t length) {
+  if (length > _size)
+    return false;
+
+  // EEPROM.begin() was called by the sketch
+  for (size_t i = 0; i < length; i++)
+    ((uint8_t*)data)[i] = EEPROM.read(_address + i);
+
+  return true;
+}
+
+bool TelegramEEPROMStorage::save(const void* data, size_t length) {
+  if (length > _size)
+    return false;
+
+  for (size_t i = 0; i < length; i++)
+    EEPROM.write(_address + i, ((const uint8_t*)data)[i]);
+
+  // Only written to flash if some byte has changed
+  return EEPROM.commit();
+}
+
+/***************************************************************
+ * Flash file system log                                       *
+ ***************************************************************/
+TelegramFSLog::TelegramFSLog(fs::FS &fs, const char* path, size_t capacity) {
+  _fs = &fs;
+  strncpy(_path, path, sizeof(_path));
+  _path[sizeof(_path)-1] = '\0';
+  _capacity = capacity;
+}
+
+size_t TelegramFSLog::capacity() {
+  return _capacity;
+}
+
+size_t TelegramFSLog::size() {
+  File file = _fs->open(_path, "r");
+  if (!file)
+    return 0;
+  size_t length = file.size();
+  file.close();
+
+  return length;
+}
+
+bool TelegramFSLog::append(const void* data, size_t length) {
+  if (length > _capacity - size())
+    return false;
+
+  File file = _fs->open(_path, "a");
+  if (!file)
+    return false;
+  bool appended = (file.write((const uint8_t*)data, length) == length);
+  file.close();
+
+  return appended;
+}
+
+bool TelegramFSLog::read(size_t position, void* data, size_t length) {
+  File file = _fs->open(_path, "r");
+  if (!file)
+    return false;
+  bool read = file.seek(position) &&
+              (file.read((uint8_t*)data, length) == length);
+  file.close();
+
+  return read;
+}
+
+// Rewrite the file with only its bytes [from, to), through a temporary file
+// so a reset in the middle does not lose the log. Not every file system
+// renames over an existing file, so the log is removed first: a reset
+// between the two leaves only the temporary file, which recover() renames.
+bool TelegramFSLog::keep(size_t from, size_t to) {
+  char tmp_path[sizeof(_path) + 4];
+  uint8_t buffer[128];
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+  File in = _fs->open(_path, "r");
+  File out = _fs->open(tmp_path, "w");
+  bool copied = in && out && in.seek(from);
+  while (copied && (from < to)) {
+    size_t length = (to - from < sizeof(buffer)) ? to - from : sizeof(buffer);
+    copied = (in.read(buffer, length) == length) && (out.write(buffer, length) == length);
+    from += length;
+  }
+  if (in)
+    in.close();
+  if (out)
+    out.close();
+  if (!copied)
+    return false;
+
+  _fs->remove(_path);
+  return _fs->rename(tmp_path, _path);
+}
+
+// The temporary file of keep() is the whole log if the log is missing, and
+// an unfinished copy otherwise
+void TelegramFSLog::recover() {
+  char tmp_path[sizeof(_path) + 4];
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+  if (!_fs->exists(tmp_path))
+    return;
+  if (_fs->exists(_path))
+    _fs->remove(tmp_path);
+  else
+    _fs->rename(tmp_path, _path);
+}
+
+bool TelegramFSLog::truncate(size_t length) {
+  if (length >= size())
+    return true;
+  return keep(0, length);
+}
+
+bool TelegramFSLog::discard(size_t length) {
+  size_t total = size();
+  if (length >= total)
+    return !_fs->exists(_path) || _fs->remove(_path);
+  return keep(length, total);
+}
+
+#endif
+
+#ifndef ARDUINO
+
+/***************************************************************
+ * File log                                                    *
+ ***************************************************************/
+TelegramFileLog::TelegramFileLog(const char* path, size_t capacity) {
+  strncpy(_path, path, sizeof(_path));
+  _path[sizeof(_path)-1] = '\0';
+  _capacity = capacity;
+}
+
+size_t TelegramFileLog::capacity() {
+  return _capacity;
+}
+
+size_t TelegramFileLog::size() {
+  struct stat info;
+  if (stat(_path, &info) != 0)
+    return 0;
+
+  return info.st_size;
+}
+
+bool TelegramFileLog::append(const void* data, size_t length) {
+  if (length > _capacity - size())
+    return false;
+
+  FILE* file = fopen(_path, "ab");
+  if (file == NULL)
+    return false;
+  bool appended = (fwrite(data, 1, length, file) == length);
+  appended = (fclose(file) == 0) && appended;
+
+  return appended;
+}
+
+bool TelegramFileLog::read(size_t position, void* data, size_t length) {
+  FILE* file = fopen(_path, "rb");
+  if (file == NULL)
+    return false;
+  bool read = (fseek(file, position, SEEK_SET) == 0) &&
+              (fread(data, 1, length, file) == length);
+  fclose(file);
+
+  return read;
+}
+
+bool TelegramFileLog::truncate(size_t length) {
+  if (length >= size())
+    return true;
+  return ::truncate(_path, length) == 0;
+}
+
+bool TelegramFileLog::discard(size_t length) {
+  size_t total = size();
+  if (length >= total)
+    return (remove(_path) == 0) || (total == 0);
+
+  // Copy the rest to a temporary file and rename it over the log
+  char tmp_path[sizeof(_path) + 4];
+  uint8_t buffer[512];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+  FILE* in = fopen(_path, "rb");
+  FILE* out = fopen(tmp_path, "wb");
+  bool copied = (in != NULL) && (out != NULL) && (fseek(in, length, SEEK_SET) == 0);
+  size_t read;
+  while (copied && ((read = fread(buffer, 1, sizeof(buffer), in)) > 0))
+    copied = (fwrite(buffer, 1, read, out) == read);
+  if (in != NULL)
+    fclose(in);
+  if (out != NULL)
+    copied = (fclose(out) == 0) && copied;
+
+  return copied && (rename(tmp_path, _path) == 0);
+}
+
+// rename() replaces the log at once, so a temporary file left by a reset is
+// an unfinished copy; the log is only missing if it was removed by hand
+void TelegramFileLog::recover() {
+  char tmp_path[sizeof(_path) + 4];
+  struct stat info;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+  if (stat(tmp_path, &info) != 0)
+    return;
+  if (stat(_path, &info) == 0)
+    remove(tmp_path);
+  else
+    rename(tmp_path, _path);
+}
+
+/***************************************************************
+ * File storage                                                *
+ ***************************************************************/
+TelegramFileStorage::TelegramFileStorage(const char* path) {
+  strncpy(_path, path, sizeof(_path));
+  _path[sizeof(_path)-1] = '\0';
+}
+
+size_t TelegramFileStorage::capacity() {
+  return SIZE_MAX;
+}
+
+bool TelegramFileStorage::load(void* data, size_t length) {
+  FILE* file = fopen(_path, "rb");
+  if (file == NULL)
+    return false;
+  bool loaded = (fread(data, 1, length, file) == length);
+  fclose(file);
+
+  return loaded;
+}
+
+bool TelegramFileStorage::save(const void* data, size_t length) {
+  // Write to a temporary file and rename it, so a crash in the middle of the
+  // write does not leave a truncated record behind
+  char tmp_path[sizeof(_path) + 4];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", _path);
+
+  FILE* file = fopen(tmp_path, "wb");
+  if (file == NULL)
+    return false;
+  bool saved = (fwrite(data, 1, length, file) == length);
+  saved = (fclose(file) == 0) && saved;
+
+  return saved && (rename(tmp_path, _path) == 0);
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramStorage_h
+#define TelegramStorage_h
+
+#include <Arduino.h>
+#if defined(ESP8266) || defined(ESP32)
+#include <FS.h>
+#endif
+
+// Small persistent blob storage used by the bot to keep its state (i.e. the
+// update offset) across restarts. A backend stores a single record of at
+// most capacity() bytes.
+class TelegramStorage {
+public:
+  virtual ~TelegramStorage() {}
+  virtual size_t capacity() = 0;
+  virtual bool load(void* data, size_t length) = 0;
+  virtual bool save(const void* data, size_t length) = 0;
+};
+
+// Append-only storage, for the outbound spool (TelegramSpool). Records are
+// appended at the end and consumed from the start.
+class TelegramLogStorage {
+public:
+  virtual ~TelegramLogStorage() {}
+  virtual size_t capacity() = 0;
+  virtual size_t size() = 0;
+  virtual bool append(const void* data, size_t length) = 0;
+  virtual bool read(size_t position, void* data, size_t length) = 0;
+  // Keep only the first length bytes (i.e. cut a record torn by a reset)
+  virtual bool truncate(size_t length) = 0;
+  // Drop the first length bytes (the records already consumed)
+  virtual bool discard(size_t length) = 0;
+  // Finish or undo what a reset interrupted (i.e. a rewrite of the log),
+  // before the log is first read
+  virtual void recover() {}
+};
+
+// RAM, i.e. a buffer in PSRAM. Lost on reset, but it rides out an outage.
+class TelegramMemoryLog : public TelegramLogStorage {
+public:
+  TelegramMemoryLog(uint8_t* buffer, size_t size);
+  size_t capacity();
+  size_t size();
+  bool append(const void* data, size_t length);
+  bool read(size_t position, void* data, size_t length);
+  bool truncate(size_t length);
+  bool discard(size_t length);
+
+private:
+  uint8_t* _buffer;
+  size_t _capacity;
+  size_t _size;
+};
+
+#if defined(ESP8266) || defined(ESP32)
+// RTC memory: survives deep sleep and software resets (i.e. after an OTA
+// update), but not a power loss. No wear, so it can be written every time.
+// Records go between RTC_STORAGE_START and RTC_STORAGE_END: on ESP8266 the
+// first 128 bytes of the RTC user memory hold the eboot command the core
+// writes for an OTA update, so they are left alone.
+#if defined(ESP8266)
+const uint16_t RTC_STORAGE_START = 128;
+#else
+const uint16_t RTC_STORAGE_START = 0;
+#endif
+const uint16_t RTC_STORAGE_END = 512;
+
+class TelegramRTCStorage : public TelegramStorage {
+public:
+  // offset: byte offset in the RTC user memory (multiple of 4 on ESP8266),
+  // at least RTC_STORAGE_START
+  TelegramRTCStorage(uint16_t offset = RTC_STORAGE_START);
+  size_t capacity();
+  bool load(void* data, size_t length);
+  bool save(const void* data, size_t length);
+
+private:
+  uint16_t _offset;
+};
+
+// EEPROM (emulated in a flash sector on ESP8266/ESP32). Each save erases and
+// rewrites the sector, so use it with a save interval in the bot. The sketch
+// owns the EEPROM: call EEPROM.begin() with a size covering address + size
+// before using the storage, and keep it open (EEPROM.end() frees the buffer).
+class TelegramEEPROMStorage : public TelegramStorage {
+public:
+  TelegramEEPROMStorage(int address, size_t size);
+  size_t capacity();
+  bool load(void* data, size_t length);
+  bool save(const void* data, size_t length);
+
+private:
+  int _address;
+  size_t _size;
+};
+#endif
+
+#if defined(ESP8266) || defined(ESP32)
+// File in a flash file system (SPIFFS or LittleFS), up to capacity bytes.
+// Appends only write the new record; discard() rewrites the rest of the
+// file, which the spool does once everything before it was sent.
+class TelegramFSLog : public TelegramLogStorage {
+public:
+  TelegramFSLog(fs::FS &fs, const char* path, size_t capacity);
+  size_t capacity();
+  size_t size();
+  bool append(const void* data, size_t length);
+  bool read(size_t position, void* data, size_t length);
+  bool truncate(size_t length);
+  bool discard(size_t length);
+  void recover();
+
+private:
+  fs::FS *_fs;
+  char _path[32];
+  size_t _capacity;
+  bool keep(size_t from, size_t to);
+};
+#endif
+
+#ifndef ARDUINO
+// Plain file log, for builds on a host (Linux) machine
+class TelegramFileLog : public TelegramLogStorage {
+public:
+  TelegramFileLog(const char* path, size_t capacity);
+  size_t capacity();
+  size_t size();
+  bool append(const void* data, size_t length);
+  bool read(size_t position, void* data, size_t length);
+  bool truncate(size_t length);
+  bool discard(size_t length);
+  void recover();
+
+private:
+  char _path[256];
+  size_t _capacity;
+};
+#endif
+
+#ifndef ARDUINO
+// Plain file, for builds on a host (Linux) machine
+class TelegramFileStorage : public TelegramStorage {
+public:
+  TelegramFileStorage(const char* path);
+  size_t capacity();
+  bool load(void* data, size_t length);
+  bool save(const void* data, size_t length);
+
+private:
+  char _path[256];
+};
+#endif
+
+#endif
@@ -0,0 +1,648 @@
+/*
+   Copyright (c) 2018 Brian Lough. All right reserved.
+
+   UniversalTelegramBot - Library to create your own Telegram Bot using
+   ESP8266 or ESP32 on Arduino IDE.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "TelegramStringCodec.h"
+
+/***************************************************************
+ * Word at a time scanning. With ONES = 0x0101..01 and         *
+ * HIGHS = 0x8080..80, (w - ONES * n) & ~w & HIGHS is non zero *
+ * if any byte of w is lower than n (n <= 128); with n = 1     *
+ * that is "any byte is zero", so XORing w with a repeated     *
+ * character first tests for that character.                  *
+ ***************************************************************/
+typedef size_t codec_word_t;
+
+static const codec_word_t ONES = (codec_word_t)-1 / 0xFF;
+static const codec_word_t HIGHS = ONES * 0x80;
+
+static inline bool wordHasLess(codec_word_t w, uint8_t n) {
+  return ((w - ONES * n) & ~w & HIGHS) != 0;
+}
+
+static inline bool wordHasByte(codec_word_t w, uint8_t c) {
+  return wordHasLess(w ^ (ONES * c), 1);
+}
+
+static inline codec_word_t loadWord(const char* p) {
+  codec_word_t w;
+  // p is word aligned here, so this is a single load on every target
+  memcpy(&w, __builtin_assume_aligned(p, sizeof(codec_word_t)), sizeof(w));
+  return w;
+}
+
+static inline bool isWordAligned(const char* p) {
+  return ((uintptr_t)p % sizeof(codec_word_t)) == 0;
+}
+
+static inline bool needsEscape(char c) {
+  return ((uint8_t)c < 0x20) || (c == '"') || (c == '\\');
+}
+
+// Number of leading bytes of s that can be copied without escaping
+static size_t cleanRunLength(const char* s, size_t length) {
+  size_t i = 0;
+
+  while ((i < length) && !isWordAligned(s + i)) {
+    if (needsEscape(s[i]))
+      return i;
+    i++;
+  }
+  while (i + sizeof(codec_word_t) <= length) {
+    codec_word_t w = loadWord(s + i);
+    if (wordHasLess(w, 0x20) || wordHasByte(w, '"') || wordHasByte(w, '\\'))
+      break;
+    i += sizeof(codec_word_t);
+  }
+  while ((i < length) && !needsEscape(s[i]))
+    i++;
+
+  return i;
+}
+
+// Number of leading bytes of s before the first backslash
+static size_t unescapedRunLength(const char* s, size_t length) {
+  size_t i = 0;
+
+  while ((i < length) && !isWordAligned(s + i)) {
+    if (s[i] == '\\')
+      return i;
+    i++;
+  }
+  while (i + sizeof(codec_word_t) <= length) {
+    if (wordHasByte(loadWord(s + i), '\\'))
+      break;
+    i += sizeof(codec_word_t);
+  }
+  while ((i < length) && (s[i] != '\\'))
+    i++;
+
+  return i;
+}
+
+// Write the escape sequence of c into seq, returns its length
+static inline size_t escapeSequence(char c, char* seq) {
+  static const char hex[] = "0123456789abcdef";
+
+  seq[0] = '\\';
+  switch (c) {
+    case '"': seq[1] = '"'; return 2;
+    case '\\': seq[1] = '\\'; return 2;
+    case '\b': seq[1] = 'b'; return 2;
+    case '\f': seq[1] = 'f'; return 2;
+    case '\n': seq[1] = 'n'; return 2;
+    case '\r': seq[1] = 'r'; return 2;
+    case '\t': seq[1] = 't'; return 2;
+  }
+  seq[1] = 'u';
+  seq[2] = '0';
+  seq[3] = '0';
+  seq[4] = hex[((uint8_t)c >> 4) & 0x0F];
+  seq[5] = hex[(uint8_t)c & 0x0F];
+  return 6;
+}
+
+size_t jsonEscapedLength(const char* src, size_t length) {
+  char seq[6];
+  size_t escaped_length = 0;
+  size_t i = 0;
+
+  while (i < length) {
+    size_t run = cleanRunLength(src + i, length - i);
+    escaped_length += run;
+    i += run;
+    if (i < length) {
+      escaped_length += escapeSequence(src[i], seq);
+      i++;
+    }
+  }
+
+  return escaped_length;
+}
+
+size_t jsonEscape(char* dst, size_t dst_size, const char* src, size_t length) {
+  char seq[6];
+  size_t written = 0;
+  size_t i = 0;
+
+  if (dst_size == 0)
+    return 0;
+  dst_size--; // Room for the NUL terminator
+
+  // Bytes are copied or escaped one at a time until a clean run reaches a
+  // word, the rest of the run is then found a word at a time and copied in
+  // bulk. Texts full of markup and line breaks rarely get there.
+  size_t clean = 0;
+  while ((i < length) && (dst_size - written >= sizeof(codec_word_t) + sizeof(seq))) {
+    char c = src[i];
+    if (needsEscape(c)) {
+      written += escapeSequence(c, dst + written);
+      i++;
+      clean = 0;
+      continue;
+    }
+    dst[written++] = c;
+    i++;
+    if (++clean == sizeof(codec_word_t)) {
+      size_t run = cleanRunLength(src + i, length - i);
+      if (run > dst_size - written)
+        break;
+      memcpy(dst + written, src + i, run);
+      written += run;
+      i += run;
+      clean = 0;
+    }
+  }
+  // Near the end of dst. An UTF-8 character started above is finished below,
+  // there is still room for it.
+
+  while (i < length) {
+    size_t run = cleanRunLength(src + i, length - i);
+    if (run > dst_size - written) {
+      run = utf8Truncate(src + i, run, dst_size - written);
+      memcpy(dst + written, src + i, run);
+      written += run;
+      break;
+    }
+    memcpy(dst + written, src + i, run);
+    written += run;
+    i += run;
+
+    if (i < length) {
+      size_t seq_length = escapeSequence(src[i], seq);
+      if (seq_length > dst_size - written)
+        break;
+      memcpy(dst + written, seq, seq_length);
+      written += seq_length;
+      i++;
+    }
+  }
+  dst[written] = '\0';
+
+  return written;
+}
+
+size_t jsonEscapeTo(Print &out, const char* src, size_t length) {
+  char seq[6];
+  size_t written = 0;
+  size_t i = 0;
+
+  while (i < length) {
+    size_t run = cleanRunLength(src + i, length - i);
+    if (run > 0)
+      written += out.write((const uint8_t*)src + i, run);
+    i += run;
+
+    if (i < length) {
+      size_t seq_length = escapeSequence(src[i], seq);
+      written += out.write((const uint8_t*)seq, seq_length);
+      i++;
+    }
+  }
+
+  return written;
+}
+
+static int hexValue(char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F'))
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Parse the 4 hex digits of a \uXXXX escape, -1 if not valid
+static long parseHex4(const char* s, size_t length) {
+  long value = 0;
+
+  if (length < 4)
+    return -1;
+  for (uint8_t i = 0; i < 4; i++) {
+    int digit = hexValue(s[i]);
+    if (digit < 0)
+      return -1;
+    value = (value << 4) | digit;
+  }
+
+  return value;
+}
+
+static inline size_t encodeUtf8(uint32_t code_point, char* out) {
+  if (code_point < 0x80) {
+    out[0] = (char)code_point;
+    return 1;
+  }
+  if (code_point < 0x800) {
+    out[0] = (char)(0xC0 | (code_point >> 6));
+    out[1] = (char)(0x80 | (code_point & 0x3F));
+    return 2;
+  }
+  if (code_point < 0x10000) {
+    out[0] = (char)(0xE0 | (code_point >> 12));
+    out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code_point & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (code_point >> 18));
+  out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (code_point & 0x3F));
+  return 4;
+}
+
+// Decode the escape sequence at src[i] (the backslash, followed by at least
+// one byte) into out, at most 4 bytes. Moves i past the sequence and returns
+// the length of the decoded character.
+static inline size_t decodeEscape(const char* src, size_t length, size_t &i, char* out) {
+  char escaped = src[i + 1];
+
+  i += 2;
+  switch (escaped) {
+    case 'b': out[0] = '\b'; return 1;
+    case 'f': out[0] = '\f'; return 1;
+    case 'n': out[0] = '\n'; return 1;
+    case 'r': out[0] = '\r'; return 1;
+    case 't': out[0] = '\t'; return 1;
+    case 'u': {
+      long code_point = parseHex4(src + i, length - i);
+      if (code_point < 0) {
+        out[0] = 'u';
+        return 1;
+      }
+      i += 4;
+      if ((code_point >= 0xD800) && (code_point <= 0xDBFF)) {
+        // High surrogate, must be followed by a low one
+        long low = -1;
+        if ((i + 6 <= length) && (src[i] == '\\') && (src[i + 1] == 'u'))
+          low = parseHex4(src + i + 2, length - i - 2);
+        if ((low >= 0xDC00) && (low <= 0xDFFF)) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+          i += 6;
+        } else {
+          code_point = 0xFFFD;
+        }
+      } else if ((code_point >= 0xDC00) && (code_point <= 0xDFFF)) {
+        code_point = 0xFFFD; // Lone low surrogate
+      }
+      return encodeUtf8((uint32_t)code_point, out);
+    }
+  }
+  // '"', '\\', '/' and unknown escapes stand for themselves
+  out[0] = escaped;
+  return 1;
+}
+
+size_t jsonUnescape(char* dst, size_t dst_size, const char* src, size_t length) {
+  char decoded[4];
+  size_t written = 0;
+  size_t i = 0;
+
+  if (dst_size == 0)
+    return 0;
+  dst_size--; // Room for the NUL terminator
+
+  // As in jsonEscape(), a byte at a time until a run reaches a word
+  size_t plain = 0;
+  while ((i < length) && (dst_size - written >= sizeof(codec_word_t) + sizeof(decoded))) {
+    char c = src[i];
+    if (c == '\\') {
+      if ((i + 1) >= length) { // Nothing after the backslash
+        i = length;
+        break;
+      }
+      written += decodeEscape(src, length, i, dst + written);
+      plain = 0;
+      continue;
+    }
+    dst[written++] = c;
+    i++;
+    if (++plain == sizeof(codec_word_t)) {
+      size_t run = unescapedRunLength(src + i, length - i);
+      if (run > dst_size - written)
+        break;
+      memcpy(dst + written, src + i, run);
+      written += run;
+      i += run;
+      plain = 0;
+    }
+  }
+  // Near the end of dst. An UTF-8 character started above is finished below,
+  // there is still room for it.
+
+  while (i < length) {
+    size_t run = unescapedRunLength(src + i, length - i);
+    if (run > dst_size - written) {
+      run = utf8Truncate(src + i, run, dst_size - written);
+      memcpy(dst + written, src + i, run);
+      written += run;
+      break;
+    }
+    memcpy(dst + written, src + i, run);
+    written += run;
+    i += run;
+
+    if ((i + 1) >= length) // Nothing after the backslash
+      break;
+
+    size_t decoded_length = decodeEscape(src, length, i, decoded);
+    if (decoded_length > dst_size - written)
+      break;
+    memcpy(dst + written, decoded, decoded_length);
+    written += decoded_length;
+  }
+  dst[written] = '\0';
+
+  return written;
+}
+
+size_t jsonDecodeUnicodeEscapes(char* json, size_t length) {
+  size_t read = 0;
+  size_t written = 0;
+
+  while (read < length) {
+    size_t run = unescapedRunLength(json + read, length - read);
+    if (written != read)
+      memmove(json + written, json + read, run);
+    written += run;
+    read += run;
+    if (read >= length)
+      break;
+
+    // Escape sequence, json[read] is the backslash
+    long code_point = -1;
+    size_t escape_length = 2;
+    if ((read + 1 < length) && (json[read + 1] == 'u')) {
+      code_point = parseHex4(json + read + 2, length - read - 2);
+      escape_length = 6;
+      if ((code_point >= 0xD800) && (code_point <= 0xDBFF)) {
+        long low = -1;
+        if ((read + 12 <= length) && (json[read + 6] == '\\') && (json[read + 7] == 'u'))
+          low = parseHex4(json + read + 8, length - read - 8);
+        if ((low >= 0xDC00) && (low <= 0xDFFF)) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+          escape_length = 12;
+        } else {
+          code_point = 0xFFFD;
+        }
+      } else if ((code_point >= 0xDC00) && (code_point <= 0xDFFF)) {
+        code_point = 0xFFFD;
+      }
+    }
+
+    if ((code_point < 0x20) || (code_point == '"') || (code_point == '\\')) {
+      // Not a \u escape, or one that must stay escaped: copy it as is
+      if (escape_length > length - read)
+        escape_length = length - read;
+      if (written != read)
+        memmove(json + written, json + read, escape_length);
+      written += escape_length;
+    } else {
+      written += encodeUtf8((uint32_t)code_point, json + written);
+    }
+    read += escape_length;
+  }
+  json[written] = '\0';
+
+  return written;
+}
+
+size_t utf8Truncate(const char* s, size_t length, size_t max_length) {
+  if (length <= max_length)
+    return length;
+
+  // s[max_length] is the first byte left out: if it continues an UTF-8
+  // character, leave out the whole character
+  size_t n = max_length;
+  while ((n > 0) && (((uint8_t)s[n] & 0xC0) == 0x80))
+    n--;
+
+  return n;
+}
+
+size_t utf8Copy(char* dst, const char* src, size_t dst_size) {
+  if (dst_size == 0)
+    return 0;
+  if (src == NULL) {
+    dst[0] = '\0';
+    return 0;
+  }
+
+  size_t length = utf8Truncate(src, strnlen(src, dst_size), dst_size - 1);
+  memcpy(dst, src, length);
+  dst[length] = '\0';
+
+  return length;
+}
+
+TextMarkup textMarkup(const char* parse_mode) {
+  if (parse_mode == NULL)
+    return MARKUP_NONE;
+  if (strcasecmp(parse_mode, "HTML") == 0)
+    return MARKUP_HTML;
+  if (strcasecmp(parse_mode, "MarkdownV2") == 0)
+    return MARKUP_MARKDOWN_V2;
+  if (strcasecmp(parse_mode, "Markdown") == 0)
+    return MARKUP_MARKDOWN;
+  return MARKUP_NONE;
+}
+
+// What is open at a position of a text, a part can only end where nothing is
+struct markupState {
+  int16_t depth;   // HTML elements, or Markdown spans, open
+  bool inTag;      // <...>
+  bool inEntity;   // &...;
+  bool code;       // `...`
+  bool pre;        // ```...```
+  bool escaped;    // After a MarkdownV2 backslash
+  uint8_t link;    // 1: [text], 2: between ] and (, 3: (url)
+  uint8_t pending; // Bytes left of a token being read (``` __ ||)
+  uint8_t spans;   // Markdown spans open, one bit per marker
+};
+
+static bool markupClosed(const markupState &state) {
+  return (state.depth <= 0) && !state.inTag && !state.inEntity && !state.code &&
+         !state.pre && !state.escaped && (state.link == 0) && (state.pending == 0);
+}
+
+static void toggleSpan(markupState &state, uint8_t bit) {
+  state.spans ^= bit;
+  state.depth += (state.spans & bit) ? 1 : -1;
+}
+
+static void updateMarkup(markupState &state, const char* s, size_t remaining,
+                         TextMarkup markup) {
+  char c = s[0];
+  char next = (remaining > 1) ? s[1] : '\0';
+
+  if (state.pending > 0) {
+    state.pending--;
+    return;
+  }
+
+  if (markup == MARKUP_HTML) {
+    if (state.inTag) {
+      if (c == '>')
+        state.inTag = false;
+    } else if (c == '<') {
+      state.inTag = true;
+      if (next == '/') {
+        if (state.depth > 0)
+          state.depth--;
+      } else {
+        state.depth++;
+      }
+    } else if (c == '&') {
+      state.inEntity = true;
+    } else if (state.inEntity && !isalnum((uint8_t)c) && (c != '#')) {
+      state.inEntity = false; // ';' or not an entity after all
+    }
+    return;
+  }
+
+  // Markdown
+  if (state.escaped) {
+    state.escaped = false;
+    return;
+  }
+  if ((c == '\\') && (markup == MARKUP_MARKDOWN_V2)) {
+    state.escaped = true;
+    return;
+  }
+  if ((c == '`') && (next == '`') && (remaining > 2) && (s[2] == '`') && !state.code) {
+    state.pre = !state.pre;
+    state.pending = 2;
+    return;
+  }
+  if (state.pre)
+    return;
+  if (c == '`') {
+    state.code = !state.code;
+    return;
+  }
+  if (state.code)
+    return;
+
+  switch (c) {
+    case '*': toggleSpan(state, 0x01); break;
+    case '_':
+      if ((markup == MARKUP_MARKDOWN_V2) && (next == '_')) {
+        toggleSpan(state, 0x02); // Underline
+        state.pending = 1;
+      } else {
+        toggleSpan(state, 0x04);
+      }
+      break;
+    case '~':
+      if (markup == MARKUP_MARKDOWN_V2)
+        toggleSpan(state, 0x08);
+      break;
+    case '|':
+      if ((markup == MARKUP_MARKDOWN_V2) && (next == '|')) {
+        toggleSpan(state, 0x10); // Spoiler
+        state.pending = 1;
+      }
+      break;
+    case '[':
+      if (state.link == 0)
+        state.link = 1;
+      break;
+    case ']':
+      if (state.link == 1)
+        state.link = (next == '(') ? 2 : 0;
+      break;
+    case '(':
+      if (state.link == 2)
+        state.link = 3;
+      break;
+    case ')':
+      if (state.link == 3)
+        state.link = 0;
+      break;
+  }
+}
+
+size_t textPartLength(const char* text, size_t length, size_t max_units,
+                      TextMarkup markup) {
+  // Fast path: UTF-8 is never fewer bytes than UTF-16 code units
+  if (length <= max_units)
+    return length;
+
+  markupState state;
+  memset(&state, 0, sizeof(state));
+  // Where the part could end: at a line break, a space or anywhere, with no
+  // markup open, and at a line break or space regardless of the markup
+  size_t closed_line = 0, closed_space = 0, closed_any = 0;
+  size_t open_line = 0, open_space = 0;
+  size_t units = 0;
+  size_t i = 0;
+
+  while (i < length) {
+    uint8_t lead = (uint8_t)text[i];
+    size_t char_length = (lead < 0xC0) ? 1 : (lead < 0xE0) ? 2 : (lead < 0xF0) ? 3 : 4;
+    if (char_length > length - i)
+      char_length = length - i;
+    size_t char_units = (char_length == 4) ? 2 : 1;
+    if (units + char_units > max_units)
+      break;
+
+    if (i > 0) {
+      bool line = (text[i] == '\n');
+      bool space = (text[i] == ' ');
+      if (markupClosed(state)) {
+        closed_any = i;
+        if (line) closed_line = i;
+        if (space) closed_space = i;
+      }
+      if (line) open_line = i;
+      if (space) open_space = i;
+    }
+    if (markup != MARKUP_NONE)
+      updateMarkup(state, text + i, length - i, markup);
+
+    i += char_length;
+    units += char_units;
+  }
+  if (i >= length)
+    return length;
+
+  // The character that did not fit may itself be a good place to cut
+  bool closed = markupClosed(state);
+  if (text[i] == '\n') {
+    open_line = i;
+    if (closed) closed_line = i;
+  } else if (text[i] == ' ') {
+    open_space = i;
+    if (closed) closed_space = i;
+  }
+  if (closed)
+    closed_any = i;
+
+  // Parts much shorter than allowed would make many more messages
+  size_t half = i / 2;
+  const size_t cuts[] = { closed_line, closed_space, closed_any, open_line, open_space };
+  for (uint8_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+    if ((cuts[c] >= half) && (cuts[c] > 0))
+      return cuts[c];
+  }
+
+  return i;
+}
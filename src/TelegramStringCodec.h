@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2018 Brian Lough. All right reserved.
+
+UniversalTelegramBot - Library to create your own Telegram Bot using
+ESP8266 or ESP32 on Arduino IDE.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef TelegramStringCodec_h
+#define TelegramStringCodec_h
+
+#include <Arduino.h>
+
+// JSON string escaping/unescaping for message texts. Clean runs of text
+// (no quote, backslash or control character) are found a machine word at a
+// time (4 bytes on ESP8266/ESP32, 8 bytes on 64 bit hosts) and copied in
+// bulk. UTF-8 text is passed through as is.
+
+// Length of the string once escaped (without the surrounding quotes)
+size_t jsonEscapedLength(const char* src, size_t length);
+
+// Escape src into dst (NUL terminated). Stops before an escape sequence or
+// UTF-8 character that does not fit. Returns the number of bytes written.
+size_t jsonEscape(char* dst, size_t dst_size, const char* src, size_t length);
+
+// Escape src straight into a stream. Returns the number of bytes written.
+size_t jsonEscapeTo(Print &out, const char* src, size_t length);
+
+// Unescape the content of a JSON string (without the surrounding quotes) into
+// dst (NUL terminated), decoding \uXXXX escapes and surrogate pairs to UTF-8.
+// Truncates only on UTF-8 character boundaries. Returns the bytes written.
+size_t jsonUnescape(char* dst, size_t dst_size, const char* src, size_t length);
+
+// Decode, in place, the \uXXXX escapes (and surrogate pairs) of a whole JSON
+// document to UTF-8, which is never longer than the escape. Escapes of
+// quotes, backslashes and control characters are kept, so the document stays
+// valid JSON. Returns the new length (the document is NUL terminated).
+size_t jsonDecodeUnicodeEscapes(char* json, size_t length);
+
+// Length of the longest prefix of s, not longer than max_length, that does
+// not end in the middle of an UTF-8 character
+size_t utf8Truncate(const char* s, size_t length, size_t max_length);
+
+// Copy a NUL terminated string into dst, truncating it on an UTF-8 character
+// boundary if it does not fit. src may be NULL (copies an empty string).
+size_t utf8Copy(char* dst, const char* src, size_t dst_size);
+
+// Markup of a message text, from its parse_mode ("HTML", "Markdown" or
+// "MarkdownV2"; anything else is plain text)
+enum TextMarkup { MARKUP_NONE, MARKUP_HTML, MARKUP_MARKDOWN, MARKUP_MARKDOWN_V2 };
+TextMarkup textMarkup(const char* parse_mode);
+
+// Length in bytes of the first part of a text that is too long for a single
+// message, at most max_units UTF-16 code units (as Telegram counts them). The
+// cut is made on an UTF-8 character boundary where no tag, entity or markup
+// span is open, preferably at a line break, else at a space. Only if there
+// is no such boundary in the second half of the part, markup may be split.
+// Returns length if the whole text fits.
+size_t textPartLength(const char* text, size_t length, size_t max_units,
+                      TextMarkup markup);
+
+#endif
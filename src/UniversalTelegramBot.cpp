@@ -34,153 +34,624 @@
  */
 
 #include "UniversalTelegramBot.h"
+#include "TelegramStringCodec.h"
+#include "TelegramChunkedStream.h"
+
+// Request body segments: a string literal or a string written as is, and a
+// string escaped as JSON string content
+#define BODY_LITERAL(s) ((telegramBodySegment){ s, sizeof(s) - 1, false, false })
+#define BODY_RAW(s) ((telegramBodySegment){ s, strlen(s), false, false })
+#define BODY_STRING(s) ((telegramBodySegment){ s, strlen(s), true, false })
+
+// Persistent state saved through beginOffsetStore()
+const uint32_t OFFSET_RECORD_MAGIC = 0x54474f31; // "TGO1"
+
+struct telegramOffsetRecord {
+  uint32_t magic;
+  int32_t offset;
+  int32_t recent[RECENT_UPDATES_LENGTH];
+  uint8_t recent_next;
+  uint32_t checksum;
+};
+
+// FNV-1a
+static uint32_t fnv1a(const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Checksum of the record, excluding the checksum itself
+static uint32_t offsetRecordChecksum(const telegramOffsetRecord &record) {
+  return fnv1a(&record, offsetof(telegramOffsetRecord, checksum));
+}
+
+// Bot identity saved through getMe(TelegramStorage&), valid for the token it
+// was asked with
+const uint32_t IDENTITY_RECORD_MAGIC = 0x54474931; // "TGI1"
+
+struct telegramIdentityRecord {
+  uint32_t magic;
+  uint32_t token_hash;
+  char name[CACHED_NAME_LENGTH];
+  char user_name[CACHED_USER_NAME_LENGTH];
+  uint32_t checksum;
+};
+
+static uint32_t identityRecordChecksum(const telegramIdentityRecord &record) {
+  return fnv1a(&record, offsetof(telegramIdentityRecord, checksum));
+}
+
+// Takes a client of the pool for the lane while in scope
+class TelegramLaneScope {
+public:
+  TelegramLaneScope(UniversalTelegramBot &bot, TelegramLane lane) : _bot(bot) {
+    _bot.enterLane(lane);
+  }
+  ~TelegramLaneScope() {
+    _bot.leaveLane();
+  }
+
+private:
+  UniversalTelegramBot &_bot;
+};
 
 UniversalTelegramBot::UniversalTelegramBot(const char* token, Client &client) {
   _token[0] = '\0';
   name[0] = '\0';
   userName[0] = '\0';
+  last_sent_file_id[0] = '\0';
   _msg[0] = '\0';
 
   strncpy(_token, token, TOKEN_LENGTH);
   _token[TOKEN_LENGTH-1] = '\0';
   this->client = &client;
+  _ownClient = &client;
+  memset(_recentUpdates, 0, sizeof(_recentUpdates));
+  memset(&startup, 0, sizeof(startup));
+  _createdAt = millis();
+  resetStats();
 }
 
-char* UniversalTelegramBot::sendGetToTelegram(const char* command) {
-  char http_get_cmd[256]; http_get_cmd[0] = '\0';
-  unsigned long now;
-  bool avail;
-
-  // Connect with api.telegram.org if not already connected
-  if (!client->connected()) {
-    if (_debug)
-      Serial.println(F("[BOT]Connecting to server"));
-    if (!client->connect(HOST, SSL_PORT)) {
-      if (_debug)
-        Serial.println(F("[BOT]Conection error"));
-    }
+/***************************************************************
+ * Request instrumentation: every request to the API opens a   *
+ * telegramRequestStats record which is completed by the       *
+ * transport functions and closed by finishRequest()           *
+ ***************************************************************/
+void UniversalTelegramBot::setStatsSink(StatsSink sink) {
+  _statsSink = sink;
+}
+
+void UniversalTelegramBot::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+  memset(&lastRequest, 0, sizeof(lastRequest));
+  _requestOpen = false;
+}
+
+void UniversalTelegramBot::beginRequest(const char* command) {
+  // A previous request that nobody closed (i.e. a raw call to
+  // sendGetToTelegram) is accounted for now
+  if (_requestOpen)
+    finishRequest(checkForOkResponse(_msg));
+
+  memset(&lastRequest, 0, sizeof(lastRequest));
+
+  // Keep just the API method name: "bot<token>/getUpdates?offset=.." -> "getUpdates"
+  const char* method = strrchr(command, '/');
+  method = (method != NULL) ? method + 1 : command;
+  size_t len = strcspn(method, "? ");
+  if (len >= MAX_METHOD_LENGTH)
+    len = MAX_METHOD_LENGTH - 1;
+  memcpy(lastRequest.method, method, len);
+  lastRequest.method[len] = '\0';
+
+  _requestStart = micros();
+  _requestOpen = true;
+}
+
+void UniversalTelegramBot::finishRequest(bool ok) {
+  if (!_requestOpen)
+    return;
+  _requestOpen = false;
+
+  lastRequest.ok = ok;
+  // GET requests have no HTTP headers in the response, so take the API error
+  // code from the body instead (i.e. {"ok":false,"error_code":429,...})
+  if (!ok && lastRequest.http_status == 0) {
+    const char* error_code = strstr(_msg, "\"error_code\":");
+    if (error_code != NULL)
+      lastRequest.http_status = atoi(error_code + strlen("\"error_code\":"));
   }
-  if (client->connected()) {
-    if (_debug)
-      Serial.println(F(".... connected to server"));
 
-    char c;
-    int ch_count = 0;
-    snprintf_P(http_get_cmd, 256, "GET /%s", command);
-	http_get_cmd[255] = '\0';
-    client->println(http_get_cmd);
-    now = millis();
-    avail = false;
-    memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-    while (millis() - now < (unsigned long)(longPoll * 1000 + waitForResponse)) {
-      while (client->available()) {
-        c = client->read();
-        // Serial.write(c);
-        if (ch_count < MAX_MESSAGE_LENGTH) {
-          _msg[ch_count] = c;
-          ch_count++;
-          if(ch_count != MAX_MESSAGE_LENGTH)
-            _msg[ch_count] = '\0';
-        }
-        avail = true;
+  stats.requests++;
+  if (!ok)
+    stats.failures++;
+  if (lastRequest.http_status == 429)
+    stats.rate_limited++;
+  stats.bytes_out += lastRequest.bytes_out;
+  stats.bytes_in += lastRequest.bytes_in;
+  updateJsonHighWater();
+
+  if (_statsSink != NULL)
+    _statsSink(lastRequest, stats);
+}
+
+/***************************************************************
+ * Transport hooks: with a host resolver, the address of the   *
+ * server is cached for its TTL, so reconnections skip the DNS *
+ * lookup. The connect hooks let the application save and      *
+ * restore the TLS session of its client (i.e. setSession() of *
+ * BearSSL::WiFiClientSecure), which this library can not do   *
+ * through the Client interface.                               *
+ ***************************************************************/
+// Use another server than api.telegram.org, i.e. a local Bot API server or a
+// stand-in for testing (with a plain TCP client)
+void UniversalTelegramBot::setServer(const char* host, uint16_t port) {
+  _host = host;
+  _port = port;
+  flushDnsCache();
+  closeClient();
+}
+
+void UniversalTelegramBot::setHostResolver(HostResolver resolver, uint32_t ttl) {
+  _hostResolver = resolver;
+  _dnsTtl = ttl;
+  flushDnsCache();
+}
+
+void UniversalTelegramBot::setConnectHooks(ConnectHook beforeConnect,
+                                           ConnectHook afterConnect) {
+  _beforeConnect = beforeConnect;
+  _afterConnect = afterConnect;
+}
+
+void UniversalTelegramBot::flushDnsCache() {
+  _dnsCached = false;
+}
+
+bool UniversalTelegramBot::resolveHost(IPAddress &address) {
+  if (_dnsCached && (millis() - _dnsResolvedAt < _dnsTtl * 1000UL)) {
+    stats.dns_cache_hits++;
+    address = _hostAddress;
+    return true;
+  }
+
+  unsigned long start = micros();
+  uint32_t ttl = _dnsTtl;
+  stats.dns_lookups++;
+  _dnsCached = _hostResolver(_host, _hostAddress, ttl);
+  lastRequest.resolve_us = micros() - start;
+  if (!_dnsCached) {
+    BOT_DEBUG_PRINTLN(F("[BOT Client]DNS lookup failed"));
+    return false;
+  }
+  _dnsTtl = ttl;
+  _dnsResolvedAt = millis();
+  address = _hostAddress;
+
+  return true;
+}
+
+/***************************************************************
+ * All the JSON parsing and building is done in the bot's own  *
+ * fixed size buffer (JSON_BUFFER_SIZE bytes), reset at the    *
+ * start of each operation, so nothing is allocated on the     *
+ * heap. A document that does not fit fails to parse/build.    *
+ ***************************************************************/
+JsonBuffer &UniversalTelegramBot::resetJsonBuffer() {
+  updateJsonHighWater();
+  _jsonBuffer.clear();
+  return _jsonBuffer;
+}
+
+void UniversalTelegramBot::updateJsonHighWater() {
+  if (_jsonBuffer.size() > stats.json_high_water)
+    stats.json_high_water = _jsonBuffer.size();
+}
+
+// Connect with the server (api.telegram.org) if not already connected
+bool UniversalTelegramBot::connectClient() {
+  if (_laneBlocked)
+    return false;
+  if (client->connected())
+    return true;
+
+  BOT_DEBUG_PRINTLN(F("[BOT Client]Connecting to server"));
+  if (_beforeConnect != NULL)
+    _beforeConnect(*client);
+
+  IPAddress address;
+  bool connected;
+  unsigned long start;
+  if ((_hostResolver != NULL) && resolveHost(address)) {
+    start = micros();
+    connected = client->connect(address, _port);
+    // The server may have moved, look it up again next time
+    if (!connected)
+      flushDnsCache();
+  } else {
+    start = micros();
+    connected = client->connect(_host, _port);
+  }
+  if (!connected) {
+    BOT_DEBUG_PRINTLN(F("[BOT Client]Conection error"));
+    stats.connect_errors++;
+    return false;
+  }
+  lastRequest.connect_us = micros() - start;
+  lastRequest.connected = true;
+  stats.connect_us += lastRequest.connect_us;
+  if (stats.connects > 0)
+    stats.reconnects++;
+  stats.connects++;
+
+  if (_afterConnect != NULL)
+    _afterConnect(*client);
+
+  return true;
+}
+
+/***************************************************************
+ * Read the HTTP status line and headers of the response (not  *
+ * stored), keeping the status, Content-Length (-1 if not      *
+ * given) and the content and transfer encodings. Returns false*
+ * if they did not arrive before timeout ms since start.       *
+ ***************************************************************/
+bool UniversalTelegramBot::readHeaders(long &content_length, unsigned long start,
+                                       unsigned long timeout) {
+  char header[48]; header[0] = '\0';
+  uint8_t header_len = 0;
+  bool responseReceived = false;
+  bool currentLineIsBlank = true;
+  char c;
+
+  content_length = -1;
+  _compressed = false;
+  _chunked = false;
+  while (millis() - start < timeout) {
+    while (client->available()) {
+      c = client->read();
+      if (!responseReceived) {
+        lastRequest.first_byte_us = micros() - _requestStart;
+        responseReceived = true;
       }
-      if (avail) {
-        if (_debug) {
-          Serial.println();
-          Serial.println(_msg);
-          Serial.println();
+      lastRequest.bytes_in++;
+
+      if (c == '\n') {
+        if (currentLineIsBlank)
+          return true;
+
+        header[header_len] = '\0';
+        if (strncmp(header, "HTTP/", 5) == 0) {
+          const char* status = strchr(header, ' ');
+          if (status != NULL)
+            lastRequest.http_status = atoi(status);
+        } else if (strncasecmp(header, "Content-Length:", 15) == 0) {
+          content_length = atol(header + 15);
+        } else if (strncasecmp(header, "Content-Encoding:", 17) == 0) {
+          const char* encoding = header + 17;
+          while (*encoding == ' ')
+            encoding++;
+          if (strncasecmp(encoding, "gzip", 4) == 0) {
+            _compressed = true;
+            _encoding = INFLATE_GZIP;
+          } else if (strncasecmp(encoding, "deflate", 7) == 0) {
+            _compressed = true;
+            _encoding = INFLATE_DEFLATE;
+          }
+        } else if (strncasecmp(header, "Transfer-Encoding:", 18) == 0) {
+          // The last encoding is the framing, "chunked" if any
+          _chunked = (strstr(header + 18, "chunked") != NULL);
         }
+        header_len = 0;
+        currentLineIsBlank = true;
+      } else if (c != '\r') {
+        if (header_len < sizeof(header) - 1)
+          header[header_len++] = c;
+        currentLineIsBlank = false;
+      }
+    }
+    if (!client->connected() && !client->available())
+      break; // Closed before the headers were complete
+  }
+
+  return false;
+}
+
+/***************************************************************
+ * Read the server response into _msg. When withHeaders is set, *
+ * the HTTP status line and headers are consumed (not stored)  *
+ * and only the body is kept, de-chunked if it was sent with   *
+ * "Transfer-Encoding: chunked". Returns the body length.      *
+ ***************************************************************/
+int UniversalTelegramBot::readResponse(bool withHeaders, unsigned long timeout) {
+  long content_length = -1;
+  TelegramChunkedStream chunks(*client);
+  Stream *body = client;
+  int ch_count = 0;
+  char c;
+  bool responseReceived = false;
+  unsigned long now = millis();
+  // Without a length (i.e. the bare GET requests), the body ends when the
+  // server closes the connection, or with the JSON document: nesting depth
+  // outside strings
+  int depth = 0;
+  bool inString = false;
+  bool escaped = false;
+  bool complete = false;
+
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (withHeaders) {
+    if (!readHeaders(content_length, now, timeout)) {
+      stats.timeouts++;
+      return 0;
+    }
+    responseReceived = true;
+    if (_compressed)
+      return readCompressedBody(content_length, timeout);
+    if (_chunked) {
+      body = &chunks;
+      content_length = -1;
+    }
+  }
+
+  while (millis() - now < timeout) {
+    while (body->available()) {
+      c = body->read();
+      if (!responseReceived) {
+        lastRequest.first_byte_us = micros() - _requestStart;
+        responseReceived = true;
+      }
+      lastRequest.bytes_in++;
+
+      if (ch_count < MAX_MESSAGE_LENGTH) {
+        _msg[ch_count] = c;
+        ch_count++;
+
+        if(ch_count != MAX_MESSAGE_LENGTH)
+          _msg[ch_count] = '\0';
+      }
+
+      if (escaped) {
+        escaped = false;
+      } else if (inString) {
+        if (c == '\\')
+          escaped = true;
+        else if (c == '"')
+          inString = false;
+      } else if (c == '"') {
+        inString = true;
+      } else if ((c == '{') || (c == '[')) {
+        depth++;
+      } else if (((c == '}') || (c == ']')) && (depth > 0)) {
+        complete = (--depth == 0);
+      }
+    }
+
+    // Done once the announced body is complete or, without a length, once
+    // the last chunk, the document is complete or the server closed the
+    // connection
+    bool closed = !client->connected() && !client->available();
+    if (body == &chunks)
+      complete = chunks.done() || chunks.failed();
+    if (responseReceived &&
+        ((ch_count >= MAX_MESSAGE_LENGTH) ||
+         ((content_length >= 0) ? (ch_count >= content_length) : (complete || closed)))) {
+      break;
+    }
+    if (!responseReceived && closed)
+      break; // Closed without a response
+  }
+
+  lastRequest.bytes_in += chunks.framingBytes;
+  // The rest of a body that was cut short would be read as the next response
+  if ((body == &chunks) && !chunks.done())
+    closeClient();
+
+  if (responseReceived) {
+    lastRequest.body_us = micros() - _requestStart;
+    BOT_DEBUG_DUMP();
+    BOT_DEBUG_DUMP(_msg);
+    BOT_DEBUG_DUMP();
+  } else {
+    stats.timeouts++;
+  }
+
+  return ch_count;
+}
+
+/***************************************************************
+ * Inflate a gzip or deflate encoded body into _msg as it is   *
+ * received, so the compressed body is never stored. The      *
+ * inflater (~1.3KB of decoding tables) is only on the stack   *
+ * while a compressed body is read. A chunked body is          *
+ * de-chunked on the way in. A body that can not be inflated,  *
+ * or not read to its end, leaves the connection out of step,  *
+ * so it is closed.                                            *
+ ***************************************************************/
+int UniversalTelegramBot::readCompressedBody(long content_length, unsigned long timeout) {
+  TelegramInflate inflater;
+  TelegramChunkedStream chunks(*client);
+  Stream &body = _chunked ? (Stream &)chunks : (Stream &)*client;
+  unsigned long start = millis();
+
+  long length = inflater.inflate(body, _chunked ? -1 : content_length, _msg,
+                                 MAX_MESSAGE_LENGTH, _encoding, timeout);
+  if (length >= 0) {
+    // The compressed data may end before the body (padding, the last chunk
+    // and the trailer): the rest is read, so the connection stays in step
+    long left = _chunked ? -1 : content_length - (long)inflater.bytesIn;
+    while ((_chunked ? (!chunks.done() && !chunks.failed()) : (left > 0)) &&
+           (millis() - start < timeout)) {
+      if (body.available()) {
+        body.read();
+        lastRequest.bytes_in++;
+        left--;
+      } else if (!client->connected() && !client->available()) {
         break;
+      } else {
+        yield();
       }
-      if(millis() < now)
-        now = millis();
     }
+    if (_chunked ? !chunks.done() : (left > 0))
+      closeClient();
+  }
+  lastRequest.bytes_in += inflater.bytesIn + chunks.framingBytes;
+  lastRequest.body_us = micros() - _requestStart;
+  stats.compressed_in += inflater.bytesIn;
+  if (length < 0) {
+    BOT_DEBUG_PRINTLN(F("Could not inflate the response"));
+    _msg[0] = '\0';
+    closeClient();
+    return 0;
+  }
+  stats.inflated_in += length;
+
+  BOT_DEBUG_DUMP();
+  BOT_DEBUG_DUMP(_msg);
+  BOT_DEBUG_DUMP();
+
+  return length;
+}
+
+// Without it the server always sends the body as is
+void UniversalTelegramBot::writeAcceptEncoding() {
+  if (compressedResponses)
+    lastRequest.bytes_out += client->println(F("Accept-Encoding: gzip, deflate"));
+}
+
+char* UniversalTelegramBot::sendGetToTelegram(const char* command) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  char http_get_cmd[256]; http_get_cmd[0] = '\0';
+
+  beginRequest(command);
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (connectClient()) {
+    BOT_DEBUG_PRINTLN(F(".... connected to server"));
+
+    snprintf_P(http_get_cmd, 256, "GET /%s", command);
+	http_get_cmd[255] = '\0';
+    unsigned long start = micros();
+    if (compressedResponses) {
+      // The encoding is negotiated with headers, so not a bare GET
+      lastRequest.bytes_out += client->print(http_get_cmd);
+      lastRequest.bytes_out += client->println(F(" HTTP/1.1"));
+      lastRequest.bytes_out += client->print(F("Host: "));
+      lastRequest.bytes_out += client->println(_host);
+      writeAcceptEncoding();
+      lastRequest.bytes_out += client->println();
+    } else {
+      lastRequest.bytes_out += client->println(http_get_cmd);
+    }
+    lastRequest.write_us = micros() - start;
+
+    readResponse(compressedResponses, (unsigned long)(longPoll * 1000 + waitForResponse));
+    // The response to a bare GET ends with the connection, the server
+    // closes it: a request sent on it now would be lost
+    if (!compressedResponses)
+      closeClient();
   }
 
   return _msg;
 }
 
+// Write the request line and headers of a JSON POST request
+void UniversalTelegramBot::writePostHeaders(const char* command, size_t content_length) {
+  char http_post_cmd[MAX_CMD_LENGTH]; http_post_cmd[0] = '\0';
+
+  // POST URI
+  snprintf_P(http_post_cmd, MAX_CMD_LENGTH, "POST /%s", command);
+  http_post_cmd[MAX_CMD_LENGTH-1] = '\0';
+  lastRequest.bytes_out += client->print(http_post_cmd);
+  lastRequest.bytes_out += client->println(F(" HTTP/1.1"));
+  // Host header
+  lastRequest.bytes_out += client->print(F("Host:"));
+  lastRequest.bytes_out += client->println(_host);
+  // JSON content type
+  lastRequest.bytes_out += client->println(F("Content-Type: application/json"));
+  writeAcceptEncoding();
+
+  // Content length
+  lastRequest.bytes_out += client->print(F("Content-Length:"));
+  lastRequest.bytes_out += client->println((unsigned long)content_length);
+  // End of headers
+  lastRequest.bytes_out += client->println();
+}
+
 char* UniversalTelegramBot::sendPostToTelegram(const char* command,
                                                 JsonObject &payload) {
-  char http_post_cmd[MAX_CMD_LENGTH]; http_post_cmd[0] = '\0';
-  //String headers = ""; // Why store http response header if not used?
-  long now;
-  bool responseReceived;
-
-  // Connect with api.telegram.org if not already connected
-  if (!client->connected()) {
-    if (_debug)
-      Serial.println(F("[BOT Client]Connecting to server"));
-    if (!client->connect(HOST, SSL_PORT)) {
-      if (_debug)
-        Serial.println(F("[BOT Client]Conection error"));
-    }
-  }
-  if (client->connected()) {
-    // POST URI
-    snprintf_P(http_post_cmd, MAX_CMD_LENGTH, "POST /%s", command);
-	http_post_cmd[MAX_CMD_LENGTH-1] = '\0';
-    client->print(http_post_cmd);
-    client->println(F(" HTTP/1.1"));
-    // Host header
-    client->print(F("Host:"));
-    client->println(HOST);
-    // JSON content type
-    client->println(F("Content-Type: application/json"));
-
-    // Content length
-    int length = payload.measureLength();
-    client->print(F("Content-Length:"));
-    client->println(length);
-    // End of headers
-    client->println();
+  TelegramLaneScope scope(*this, LANE_SEND);
+  beginRequest(command);
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (connectClient()) {
+    unsigned long start = micros();
+    writePostHeaders(command, payload.measureLength());
     // POST message body
-    payload.printTo(*client); // Not really too slow?
-
-    int ch_count = 0;
-    char c;
-    now = millis();
-    responseReceived = false;
-    bool finishedHeaders = false;
-    bool currentLineIsBlank = true;
-    memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-    while (millis() - now < waitForResponse) {
-      while (client->available()) {
-        c = client->read();
-        responseReceived = true;
+    lastRequest.bytes_out += payload.printTo(*client); // Not really too slow?
+    lastRequest.write_us = micros() - start;
 
-        if (!finishedHeaders) {
-          if (currentLineIsBlank && c == '\n') {
-            finishedHeaders = true;
-          }/* else {
-            headers = headers + c; // Why store http response header if not used?
-          }*/
-        } else {
-          if (ch_count < MAX_MESSAGE_LENGTH) {
-            _msg[ch_count] = c;
-            ch_count++;
-
-            if(ch_count != MAX_MESSAGE_LENGTH)
-              _msg[ch_count] = '\0';
-          }
-        }
+    readResponse(true, waitForResponse);
+  }
 
-        if (c == '\n') {
-          currentLineIsBlank = true;
-        } else if (c != '\r') {
-          currentLineIsBlank = false;
-        }
-      }
+  return _msg;
+}
 
-      if (responseReceived) {
-        if (_debug) {
-          Serial.println();
-          Serial.println(_msg);
-          Serial.println();
+/***************************************************************
+ * POST a JSON body given as a list of segments, written as is *
+ * or escaped as string content, without building it in memory *
+ ***************************************************************/
+char* UniversalTelegramBot::sendPostToTelegram(const char* command,
+                                                const telegramBodySegment* segments,
+                                                uint8_t count) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  return sendPostToTelegram(command, segments, count, bodyLength(segments, count));
+}
+
+// Content-Length of a body given as segments
+size_t UniversalTelegramBot::bodyLength(const telegramBodySegment* segments,
+                                        uint8_t count) {
+  size_t content_length = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    content_length += segments[i].escape ?
+        jsonEscapedLength(segments[i].data, segments[i].length) : segments[i].length;
+  }
+  return content_length;
+}
+
+char* UniversalTelegramBot::sendPostToTelegram(const char* command,
+                                                const telegramBodySegment* segments,
+                                                uint8_t count, size_t content_length) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  beginRequest(command);
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (connectClient()) {
+    unsigned long start = micros();
+    writePostHeaders(command, content_length);
+    for (uint8_t i = 0; i < count; i++) {
+      if (segments[i].escape) {
+        lastRequest.bytes_out += jsonEscapeTo(*client, segments[i].data, segments[i].length);
+      } else if (segments[i].flash) {
+        // Copy from flash through a small buffer
+        uint8_t chunk[64];
+        for (size_t sent = 0; sent < segments[i].length; sent += sizeof(chunk)) {
+          size_t length = segments[i].length - sent;
+          if (length > sizeof(chunk))
+            length = sizeof(chunk);
+          memcpy_P(chunk, segments[i].data + sent, length);
+          lastRequest.bytes_out += client->write(chunk, length);
         }
-        break;
+      } else {
+        lastRequest.bytes_out += client->write((const uint8_t*)segments[i].data,
+                                               segments[i].length);
       }
     }
+    lastRequest.write_us = micros() - start;
+
+    readResponse(true, waitForResponse);
   }
 
   return _msg;
@@ -191,28 +662,31 @@ char* UniversalTelegramBot::sendMultipartFormDataToTelegram(
     const char* contentType, const char* chat_id, int fileSize,
     MoreDataAvailable moreDataAvailableCallback,
     GetNextByte getNextByteCallback) {
+  return sendMultipartFormData(command, binaryProperyName, fileName, contentType,
+                               chat_id, fileSize, moreDataAvailableCallback,
+                               getNextByteCallback, NULL);
+}
+
+// The file comes from the callbacks, or from data if not NULL
+char* UniversalTelegramBot::sendMultipartFormData(
+    const char* command, const char* binaryProperyName, const char* fileName,
+    const char* contentType, const char* chat_id, int fileSize,
+    MoreDataAvailable moreDataAvailableCallback,
+    GetNextByte getNextByteCallback, const uint8_t* data) {
+  TelegramLaneScope scope(*this, LANE_UPLOAD);
 
   char http_post_cmd[MAX_CMD_LENGTH]; http_post_cmd[0] = '\0';
   char to_print[MAX_CMD_LENGTH]; to_print[0] = '\0';
 
-  //String headers = ""; // Why store http response header if not used?
-  long now;
-  bool responseReceived;
   const char boundry[] = "------------------------b8f610217e83e29b";
 
-  // Connect with api.telegram.org if not already connected
-  if (!client->connected()) {
-    if (_debug)
-      Serial.println(F("[BOT Client]Connecting to server"));
-    if (!client->connect(HOST, SSL_PORT)) {
-      if (_debug)
-        Serial.println(F("[BOT Client]Conection error"));
-    }
-  }
-  if (client->connected()) {
+  beginRequest(command);
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (connectClient()) {
 
     char start_request[MAX_MESSAGE_LENGTH] = "";
     char end_request[MAX_MESSAGE_LENGTH] = "";
+    unsigned long start = micros();
 
     snprintf_P(start_request, MAX_MESSAGE_LENGTH, "--%s\r\n"
                            "content-disposition: form-data; name=\"chat_id\"\r\n"
@@ -228,223 +702,702 @@ char* UniversalTelegramBot::sendMultipartFormDataToTelegram(
     snprintf_P(end_request, MAX_MESSAGE_LENGTH, "\r\n--%s--\r\n", boundry);
 	end_request[MAX_MESSAGE_LENGTH-1] = '\0';
 
-    snprintf_P(http_post_cmd, MAX_CMD_LENGTH, "POST /bot %s /%s", _token, command);
+    snprintf_P(http_post_cmd, MAX_CMD_LENGTH, "POST /bot%s/%s", _token, command);
 	http_post_cmd[MAX_CMD_LENGTH-1] = '\0';
-    client->print(http_post_cmd);
-    client->println(F(" HTTP/1.1"));
+    lastRequest.bytes_out += client->print(http_post_cmd);
+    lastRequest.bytes_out += client->println(F(" HTTP/1.1"));
     // Host header
-    client->print(F("Host: "));
-    client->println(HOST);
-    client->println(F("User-Agent: arduino/1.0"));
-    client->println(F("Accept: */*"));
+    lastRequest.bytes_out += client->print(F("Host: "));
+    lastRequest.bytes_out += client->println(_host);
+    lastRequest.bytes_out += client->println(F("User-Agent: arduino/1.0"));
+    lastRequest.bytes_out += client->println(F("Accept: */*"));
+    writeAcceptEncoding();
 
     int contentLength = fileSize + strlen(start_request) + strlen(end_request);
     snprintf_P(to_print, MAX_CMD_LENGTH, "Content-Length: %d", contentLength);
 	to_print[MAX_CMD_LENGTH-1] = '\0';
-    if (_debug)
-      Serial.println(to_print);
-    client->println(to_print);
+    BOT_DEBUG_PRINTLN(to_print);
+    lastRequest.bytes_out += client->println(to_print);
     snprintf_P(to_print, MAX_CMD_LENGTH, "Content-Type: multipart/form-data; boundary=%s", boundry);
 	to_print[MAX_CMD_LENGTH-1] = '\0';
-    client->println(to_print);
-    client->println("");
-
-    client->print(start_request);
+    lastRequest.bytes_out += client->println(to_print);
+    lastRequest.bytes_out += client->println("");
 
-    if (_debug)
-      Serial.print(start_request);
+    lastRequest.bytes_out += client->print(start_request);
+    BOT_DEBUG_DUMP(start_request);
 
     byte buffer[512];
     int count = 0;
+    if (data != NULL) {
+      for (int sent = 0; sent < fileSize; sent += 512) {
+        int length = (fileSize - sent < 512) ? fileSize - sent : 512;
+        lastRequest.bytes_out += client->write(data + sent, length);
+      }
+    }
     //char ch;
-    while (moreDataAvailableCallback()) {
+    while ((data == NULL) && moreDataAvailableCallback()) {
       buffer[count] = getNextByteCallback();
       // client->write(ch);
       // Serial.write(ch);
       count++;
       if (count == 512) {
         // yield();
-        if (_debug) {
-          Serial.println(F("Sending full buffer"));
-        }
-        client->write((const uint8_t *)buffer, 512);
+        BOT_DEBUG_PRINTLN(F("Sending full buffer"));
+        lastRequest.bytes_out += client->write((const uint8_t *)buffer, 512);
         count = 0;
       }
     }
 
     if (count > 0) {
-      if (_debug) {
-        Serial.println(F("Sending remaining buffer"));
-      }
-      client->write((const uint8_t *)buffer, count);
+      BOT_DEBUG_PRINTLN(F("Sending remaining buffer"));
+      lastRequest.bytes_out += client->write((const uint8_t *)buffer, count);
     }
 
-    client->print(end_request);
-    if (_debug)
-      Serial.print(end_request);
+    lastRequest.bytes_out += client->print(end_request);
+    BOT_DEBUG_DUMP(end_request);
+    lastRequest.write_us = micros() - start;
+
+    readResponse(true, waitForResponse);
+  }
+
+  closeClient();
+  return _msg;
+}
 
-    count = 0;
-    int ch_count = 0;
-    char c;
-    now = millis();
-    bool finishedHeaders = false;
-    bool currentLineIsBlank = true;
+/***************************************************************
+ * GetFile - get the path to download a file from, valid for   *
+ * at least an hour                                            *
+ * (Arguments to pass: the file_id, and where to store the     *
+ * file information)                                           *
+ ***************************************************************/
+bool UniversalTelegramBot::getFile(const char* file_id, telegramFile &file) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  char command[MAX_CMD_LENGTH]; command[0] = '\0';
+  snprintf_P(command, MAX_CMD_LENGTH, "bot%s/getFile?file_id=%s", _token, file_id);
+  command[MAX_CMD_LENGTH-1] = '\0';
+  BOT_DEBUG_PRINTLN(F("GET File"));
+
+  sendGetToTelegram(command);
+  closeClient();
+
+  unsigned long parse_start = micros();
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &root = jsonBuffer.parseObject(_msg);
+  bool found = false;
+  if (root.success()) {
+    JsonObject &result = root["result"];
+    if (root.get<bool>("ok") && result.containsKey("file_path")) {
+      utf8Copy(file.file_id, result.get<char*>("file_id"), sizeof(file.file_id));
+      utf8Copy(file.file_path, result.get<char*>("file_path"), sizeof(file.file_path));
+      file.file_size = result.get<long>("file_size");
+      found = true;
+    }
+  } else {
+    stats.parse_failures++;
+  }
+  lastRequest.parse_us = micros() - parse_start;
+  finishRequest(found);
+
+  return found;
+}
+
+/***************************************************************
+ * DownloadFile - stream a file into out, DOWNLOAD_CHUNK_SIZE  *
+ * bytes at a time, so it is never held in memory. If the      *
+ * connection drops, the download is resumed where it stopped  *
+ * with a Range request (up to DOWNLOAD_ATTEMPTS times).       *
+ * (Arguments to pass: the file_path from getFile(), where to  *
+ * write it, optionally a progress callback and where to keep  *
+ * the CRC-32 of the data, updated as it is written)           *
+ * With a position, the download starts there (i.e. the bytes  *
+ * already in out from a failed download) and the position is *
+ * kept up to date, so it can be resumed later. A body sent    *
+ * with "Transfer-Encoding: chunked" is de-chunked as it is    *
+ * written.                                                    *
+ ***************************************************************/
+bool UniversalTelegramBot::downloadFile(const char* file_path, Print &out,
+                                        DownloadProgress progress, uint32_t* crc) {
+  TelegramLaneScope scope(*this, LANE_UPLOAD);
+  long position = 0;
+  return downloadFile(file_path, out, position, progress, crc);
+}
+
+bool UniversalTelegramBot::downloadFile(const char* file_path, Print &out,
+                                        long &position, DownloadProgress progress,
+                                        uint32_t* crc) {
+  TelegramLaneScope scope(*this, LANE_UPLOAD);
+  char command[MAX_CMD_LENGTH]; command[0] = '\0';
+  uint8_t buffer[DOWNLOAD_CHUNK_SIZE];
+  long total = -1;
+  bool complete = false;
+
+  snprintf_P(command, MAX_CMD_LENGTH, "file/bot%s/%s", _token, file_path);
+  command[MAX_CMD_LENGTH-1] = '\0';
+  BOT_DEBUG_PRINTLN(F("DOWNLOAD File"));
+
+  closeClient(); // The GET requests of the API are not HTTP/1.1
+  for (uint8_t attempt = 0; (attempt < DOWNLOAD_ATTEMPTS) && !complete; attempt++) {
+    if (attempt > 0)
+      stats.retries++;
+    beginRequest(command);
     memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-    while (millis() - now < waitForResponse) {
-      while (client->available()) {
-        c = client->read();
-        responseReceived = true;
+    if (!connectClient()) {
+      finishRequest(false);
+      continue;
+    }
 
-        if (!finishedHeaders) {
-          if (currentLineIsBlank && c == '\n') {
-            finishedHeaders = true;
-          }/* else {
-            headers = headers + c; // Why store http response header if not used?
-          }*/
-        } else {
-          if (ch_count < MAX_MESSAGE_LENGTH) {
-            _msg[ch_count] = c;
-            ch_count++;
-
-            if(ch_count != MAX_MESSAGE_LENGTH)
-              _msg[ch_count] = '\0';
-          }
-        }
+    unsigned long start = micros();
+    lastRequest.bytes_out += client->print(F("GET /"));
+    lastRequest.bytes_out += client->print(command);
+    lastRequest.bytes_out += client->println(F(" HTTP/1.1"));
+    lastRequest.bytes_out += client->print(F("Host: "));
+    lastRequest.bytes_out += client->println(_host);
+    if (position > 0) {
+      lastRequest.bytes_out += client->print(F("Range: bytes="));
+      lastRequest.bytes_out += client->print(position);
+      lastRequest.bytes_out += client->println(F("-"));
+    }
+    lastRequest.bytes_out += client->println(F("Connection: close"));
+    lastRequest.bytes_out += client->println();
+    lastRequest.write_us = micros() - start;
+
+    long content_length = -1;
+    if (!readHeaders(content_length, millis(), waitForResponse)) {
+      stats.timeouts++;
+      finishRequest(false);
+      closeClient();
+      continue;
+    }
 
-        if (c == '\n') {
-          currentLineIsBlank = true;
-        } else if (c != '\r') {
-          currentLineIsBlank = false;
-        }
+    // A server that ignores the Range sends the whole file, skip what we
+    // already have
+    long skip = 0;
+    if (lastRequest.http_status == 206) {
+      if (content_length >= 0)
+        total = position + content_length;
+    } else if (lastRequest.http_status == 200) {
+      total = content_length;
+      skip = position;
+    } else {
+      // i.e. 404 once the file_path expired, trying again will not help
+      BOT_DEBUG_PRINT(F("Download failed, HTTP status: "));
+      BOT_DEBUG_PRINTLN(lastRequest.http_status);
+      finishRequest(false);
+      closeClient();
+      break;
+    }
+
+    // A chunked body is de-chunked on the way in, its length is unknown
+    TelegramChunkedStream chunks(*client);
+    if (_chunked)
+      content_length = -1;
+    long remaining = content_length;
+    bool write_error = false;
+    unsigned long last_data = millis();
+    while ((remaining != 0) && !write_error && !chunks.done() && !chunks.failed()) {
+      int available = _chunked ? chunks.available() : client->available();
+      if (available <= 0) {
+        if ((!client->connected() && !client->available()) ||
+            (millis() - last_data > waitForResponse))
+          break;
+        yield();
+        continue;
       }
 
-      if (responseReceived) {
-        if (_debug) {
-          Serial.println();
-          Serial.println(_msg);
-          Serial.println();
-        }
+      size_t length = (available < (int)sizeof(buffer)) ? available : sizeof(buffer);
+      if ((remaining > 0) && (length > (size_t)remaining))
+        length = remaining;
+      int received = 0;
+      if (_chunked) {
+        while (received < (int)length)
+          buffer[received++] = chunks.read();
+      } else {
+        received = client->read(buffer, length);
+      }
+      if (received <= 0)
+        continue;
+      last_data = millis();
+      lastRequest.bytes_in += received;
+      if (remaining > 0)
+        remaining -= received;
+
+      uint8_t* data = buffer;
+      if (skip > 0) {
+        long skipped = (skip < received) ? skip : received;
+        skip -= skipped;
+        data += skipped;
+        received -= skipped;
+      }
+      if (received == 0)
+        continue;
+
+      if (out.write(data, received) != (size_t)received) {
+        BOT_DEBUG_PRINTLN(F("Download failed, could not write the file"));
+        write_error = true;
         break;
       }
+      if (crc != NULL)
+        *crc = crc32Update(*crc, data, received);
+      position += received;
+      if (progress != NULL)
+        progress(position, total);
     }
+    lastRequest.bytes_in += chunks.framingBytes;
+    lastRequest.body_us = micros() - _requestStart;
+
+    // A chunked file ends with its last chunk, else without a Content-Length
+    // when the server closes
+    if (_chunked)
+      complete = !write_error && chunks.done();
+    else
+      complete = !write_error && ((content_length >= 0) ? (remaining == 0) :
+                                  !client->connected());
+    finishRequest(complete);
+    closeClient();
+    if (write_error)
+      break;
   }
 
-  closeClient();
-  return _msg;
+  return complete;
 }
 
 bool UniversalTelegramBot::getMe() {
+  TelegramLaneScope scope(*this, LANE_SEND);
   char command[MAX_CMD_LENGTH]; command[0] = '\0';
   snprintf_P(command, MAX_CMD_LENGTH, "bot%s/getMe", _token);
   command[MAX_CMD_LENGTH-1] = '\0';
   memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-  strncpy(_msg, sendGetToTelegram(command), MAX_MESSAGE_LENGTH); // receive reply from telegram
+  sendGetToTelegram(command); // The reply is left in _msg
   _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-  DynamicJsonBuffer jsonBuffer;
+  unsigned long parse_start = micros();
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
   JsonObject &root = jsonBuffer.parseObject(_msg);
 
-  closeClient();
+  // A bare GET closes the connection. With compressedResponses the request
+  // is HTTP/1.1 and a connection the server keeps open is left for the next
+  // request (usually the first getUpdates), without a new handshake
 
   if (root.success()) {
     if (root.containsKey("result")) {
-      strncpy(name, root["result"]["first_name"], MAX_USER_NAME_LENGTH);
-      name[MAX_USER_NAME_LENGTH-1] = '\0';
-      strncpy(userName, root["result"]["username"], MAX_USER_NAME_LENGTH);
-      userName[MAX_USER_NAME_LENGTH-1] = '\0';
+      utf8Copy(name, root["result"]["first_name"], sizeof(name));
+      utf8Copy(userName, root["result"]["username"], sizeof(userName));
+      lastRequest.parse_us = micros() - parse_start;
+      finishRequest(true);
       return true;
     }
+  } else {
+    stats.parse_failures++;
   }
 
+  lastRequest.parse_us = micros() - parse_start;
+  finishRequest(false);
   return false;
 }
 
+/***************************************************************
+ * Identity cache - getMe() answered from a TelegramStorage    *
+ * (i.e. RTC memory, which survives deep sleep), so a waking   *
+ * bot does not spend a request on it. Telegram is asked only  *
+ * if nothing was cached yet, or for another token.            *
+ ***************************************************************/
+bool UniversalTelegramBot::getMe(TelegramStorage &cache) {
+  telegramIdentityRecord record;
+  uint32_t token_hash = fnv1a(_token, strlen(_token));
+
+  if (cache.load(&record, sizeof(record)) &&
+      (record.magic == IDENTITY_RECORD_MAGIC) &&
+      (record.token_hash == token_hash) &&
+      (record.checksum == identityRecordChecksum(record))) {
+    utf8Copy(name, record.name, CACHED_NAME_LENGTH);
+    utf8Copy(userName, record.user_name, CACHED_USER_NAME_LENGTH);
+    startup.identity_cached = true;
+    BOT_DEBUG_PRINTLN(F("Restored bot identity"));
+    return true;
+  }
+
+  if (!getMe())
+    return false;
+  if ((strlen(name) >= CACHED_NAME_LENGTH) ||
+      (strlen(userName) >= CACHED_USER_NAME_LENGTH))
+    return true; // Does not fit, asked again next time
+
+  memset(&record, 0, sizeof(record));
+  record.magic = IDENTITY_RECORD_MAGIC;
+  record.token_hash = token_hash;
+  strcpy(record.name, name);
+  strcpy(record.user_name, userName);
+  record.checksum = identityRecordChecksum(record);
+  if (!cache.save(&record, sizeof(record)))
+    BOT_DEBUG_PRINTLN(F("Failed to save bot identity"));
+
+  return true;
+}
+
+/***************************************************************
+ * Warm up - connect the client of the first poll now, so the  *
+ * first getUpdates does not wait for the TCP and TLS          *
+ * handshakes. Call it as soon as the network is up, i.e.      *
+ * first thing after waking from deep sleep. The connection is *
+ * left open for the poll.                                     *
+ ***************************************************************/
+bool UniversalTelegramBot::warmUp() {
+  TelegramLaneScope scope(*this, LANE_POLL);
+  Client *sendClient = client;
+  unsigned long start = millis();
+
+  if (_pollClient != NULL)
+    client = _pollClient;
+  _warmedUp = connectClient();
+  client = sendClient;
+  startup.warm_up_ms = millis() - start;
+
+  return _warmedUp;
+}
+
+// Time to first update: from the creation of the bot to its first getUpdates
+// response, which brings the updates pending while it was off
+void UniversalTelegramBot::recordFirstUpdate() {
+  if (!_firstUpdate)
+    return;
+  _firstUpdate = false;
+  startup.first_update_ms = millis() - _createdAt;
+  // A connection made for the poll itself sets lastRequest.connected
+  startup.warm_connection = _warmedUp && !lastRequest.connected;
+
+  BOT_DEBUG_PRINT(F("First update after (ms): "));
+  BOT_DEBUG_PRINTLN((unsigned long)startup.first_update_ms);
+}
+
 /***************************************************************
  * GetUpdates - function to receive messages from telegram *
  * (Argument to pass: the last+1 message to read)             *
  * Returns the number of new messages           *
  ***************************************************************/
 int UniversalTelegramBot::getUpdates(long offset) {
+  TelegramLaneScope scope(*this, LANE_POLL);
   char command[MAX_CMD_LENGTH]; command[0] = '\0';
-  if (_debug)
-    Serial.println(F("GET Update Messages"));
+  BOT_DEBUG_PRINTLN(F("GET Update Messages"));
 
-  snprintf_P(command, MAX_CMD_LENGTH, "bot%s/getUpdates?offset=%ld&limit=%d", _token, offset, HANDLE_MESSAGES);
-  command[MAX_CMD_LENGTH-1] = '\0';
-  if (longPoll > 0) {
-    snprintf_P(command, MAX_CMD_LENGTH, "%s%d", command, longPoll);
-	command[MAX_CMD_LENGTH-1] = '\0';
-  }
+  updatesCommand(command, offset, longPoll);
   memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-  strncpy(_msg, sendGetToTelegram(command), MAX_CMD_LENGTH); // receive reply from telegram.org
+  sendGetToTelegram(command); // The reply is left in _msg
   _msg[MAX_MESSAGE_LENGTH-1] = '\0';
 
   if (strcmp(_msg, "") == 0) {
-    if (_debug)
-      Serial.println(F("Received empty string in response!"));
+    BOT_DEBUG_PRINTLN(F("Received empty string in response!"));
     // close the client as there's nothing to do with an empty string
     closeClient();
+    finishRequest(false);
+    return 0;
+  }
+
+  int newMessages = parseUpdates(_msg);
+  if (newMessages >= 0)
+    recordFirstUpdate();
+  finishRequest(newMessages >= 0);
+  saveOffset();
+  if (newMessages > 0) {
+    // We will keep the client open because there may be a response to be
+    // given
+    return newMessages;
+  }
+
+  // Close the client as no response is to be given
+  closeClient();
+  return 0;
+}
+
+// The getUpdates request path, with the long poll timeout (seconds) if set
+void UniversalTelegramBot::updatesCommand(char* command, long offset, int timeout) {
+  if (timeout > 0) {
+    snprintf_P(command, MAX_CMD_LENGTH, "bot%s/getUpdates?offset=%ld&limit=%d&timeout=%d",
+               _token, offset, HANDLE_MESSAGES, timeout);
+  } else {
+    snprintf_P(command, MAX_CMD_LENGTH, "bot%s/getUpdates?offset=%ld&limit=%d",
+               _token, offset, HANDLE_MESSAGES);
+  }
+  command[MAX_CMD_LENGTH-1] = '\0';
+}
+
+/***************************************************************
+ * Update pipeline: with a dedicated poll client, the next     *
+ * getUpdates request is sent as soon as a batch is parsed, so *
+ * the server (and the network) work on it while the batch is  *
+ * handled. The response waits in the poll client until        *
+ * pollUpdates() is called again, while the handler can still  *
+ * send messages through the main client.                      *
+ * The requests are always long polls (PIPELINE_LONG_POLL if   *
+ * longPoll is 0), so the server paces them, and failed ones   *
+ * back off, so a bad token does not turn into a busy loop.    *
+ ***************************************************************/
+void UniversalTelegramBot::setPollClient(Client &pollClient) {
+  _pollClient = &pollClient;
+}
+
+// Long poll timeout of the pipeline requests, seconds
+int UniversalTelegramBot::pollTimeout() {
+  return (longPoll > 0) ? longPoll : PIPELINE_LONG_POLL;
+}
+
+// Wait before the next request after a failed one, doubling up to
+// POLL_MAX_RETRY_INTERVAL
+void UniversalTelegramBot::pollBackOff() {
+  _pollFailedAt = millis();
+  if (_pollRetryDelay == 0)
+    _pollRetryDelay = POLL_RETRY_INTERVAL;
+  else if (_pollRetryDelay < POLL_MAX_RETRY_INTERVAL / 2)
+    _pollRetryDelay *= 2;
+  else
+    _pollRetryDelay = POLL_MAX_RETRY_INTERVAL;
+}
+
+// Send the getUpdates request on the poll client, without waiting for the
+// response
+bool UniversalTelegramBot::requestUpdates(long offset) {
+  char command[MAX_CMD_LENGTH]; command[0] = '\0';
+  Client *sendClient = client;
+
+  updatesCommand(command, offset, pollTimeout());
+  client = _pollClient;
+  beginRequest(command);
+  bool requested = connectClient();
+  if (requested) {
+    unsigned long start = micros();
+    lastRequest.bytes_out += client->print(F("GET /"));
+    lastRequest.bytes_out += client->print(command);
+    lastRequest.bytes_out += client->println(F(" HTTP/1.1"));
+    lastRequest.bytes_out += client->print(F("Host: "));
+    lastRequest.bytes_out += client->println(_host);
+    writeAcceptEncoding();
+    lastRequest.bytes_out += client->println();
+    lastRequest.write_us = micros() - start;
+    // The request stays in flight while other requests are made, its stats
+    // are put back in place once the response is read
+    _pollRequest = lastRequest;
+    _pollStart = _requestStart;
+    _pollRequested = millis();
+    _requestOpen = false;
+  } else {
+    finishRequest(false);
+    pollBackOff();
+  }
+  client = sendClient;
+  _pollInFlight = requested;
+
+  return requested;
+}
+
+/***************************************************************
+ * PollUpdates - non blocking getUpdates, call it from loop()  *
+ * Returns the number of new messages, or 0 if the response to *
+ * the request in flight has not arrived yet. Without a poll   *
+ * client it is the same as getUpdates().                      *
+ ***************************************************************/
+int UniversalTelegramBot::pollUpdates() {
+  if (_pollClient == NULL)
+    return getUpdates(last_message_received + 1);
+
+  if (!_pollInFlight) {
+    if ((_pollRetryDelay > 0) && ((millis() - _pollFailedAt) < _pollRetryDelay))
+      return 0;
+    requestUpdates(last_message_received + 1);
     return 0;
+  }
+
+  Client *sendClient = client;
+  client = _pollClient;
+  if (!client->available()) {
+    bool expired = (millis() - _pollRequested) >
+                   (unsigned long)(pollTimeout() * 1000UL + waitForResponse);
+    if (expired || !client->connected()) {
+      // Lost, start over
+      stats.timeouts++;
+      closeClient();
+      _pollInFlight = false;
+      pollBackOff();
+    }
+    client = sendClient;
+    return 0;
+  }
+
+  lastRequest = _pollRequest;
+  _requestStart = _pollStart;
+  _requestOpen = true;
+  readResponse(true, waitForResponse);
+  client = sendClient;
+  _pollInFlight = false;
+
+  int newMessages = parseUpdates(_msg);
+  if (newMessages >= 0)
+    recordFirstUpdate();
+  finishRequest(newMessages >= 0);
+  saveOffset();
+
+  if (newMessages < 0) {
+    // An error (i.e. 401 for a revoked token, 409 for another poller),
+    // asking again right away would get the same
+    pollBackOff();
   } else {
-    if (_debug) {
-      Serial.print(F("Incoming message length: "));
-      Serial.println(strlen(_msg));
-      Serial.println(F("Creating DynamicJsonBuffer"));
+    // Prefetch the next batch while this one is handled
+    _pollRetryDelay = 0;
+    requestUpdates(last_message_received + 1);
+  }
+
+  return (newMessages > 0) ? newMessages : 0;
+}
+
+/***************************************************************
+ * ParseUpdates - parse a getUpdates response into messages[]  *
+ * (Argument to pass: the response body, it is modified while  *
+ * parsing). Independent of the connection, so recorded API    *
+ * responses can be fed to it directly.                        *
+ * Returns the number of new messages, or -1 if the response   *
+ * could not be parsed or was not ok                           *
+ ***************************************************************/
+int UniversalTelegramBot::parseUpdates(char* response) {
+  int newMessageIndex = -1;
+
+  BOT_DEBUG_PRINT(F("Incoming message length: "));
+  BOT_DEBUG_PRINTLN(strlen(response));
+
+  // Parse response into Json object
+  unsigned long parse_start = micros();
+  // ArduinoJson does not decode \uXXXX escapes (Telegram escapes all non
+  // ASCII characters), so turn them into UTF-8 first
+  jsonDecodeUnicodeEscapes(response, strlen(response));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &root = jsonBuffer.parseObject(response);
+
+  if (root.success()) {
+    // root.printTo(Serial);
+    BOT_DEBUG_PRINTLN();
+    if (root.containsKey("result")) {
+      int resultArrayLength = root["result"].size();
+      newMessageIndex = 0;
+      if (resultArrayLength > 0) {
+        // Step through all results. Those that do not fit in messages[] are
+        // not acknowledged, so the next getUpdates brings them again.
+        for (int i = 0;
+             (i < resultArrayLength) && (newMessageIndex < HANDLE_MESSAGES); i++) {
+          JsonObject &result = root["result"][i];
+          if (processResult(result, newMessageIndex)) {
+            newMessageIndex++;
+          }
+        }
+      } else {
+        BOT_DEBUG_PRINTLN(F("no new messages"));
+      }
+    } else {
+      BOT_DEBUG_PRINTLN(F("Response contained no 'result'"));
     }
+  } else { // Parsing failed
+    stats.parse_failures++;
+    if (strlen(response) < 2) { // Too short a message. Maybe connection issue
+      BOT_DEBUG_PRINTLN(F("Parsing error: Message too short"));
+    } else {
+      // Buffer may not be big enough, increase buffer or reduce max number of
+      // messages
+      BOT_DEBUG_PRINTLN(F("Failed to parse update, the message could be too "
+                          "big for the buffer (JSON_BUFFER_SIZE)"));
+    }
+  }
+
+  lastRequest.parse_us = micros() - parse_start;
+  updateJsonHighWater();
+  return newMessageIndex;
+}
+
+/***************************************************************
+ * Offset store - keeps last_message_received and the IDs of   *
+ * the last handled updates in a TelegramStorage, so updates   *
+ * handled before a restart are not executed again.            *
+ * (Arguments to pass: the storage backend and the minimum     *
+ * time in ms between two writes, to spare flash wear)         *
+ * Returns true if a previously saved offset was restored      *
+ ***************************************************************/
+bool UniversalTelegramBot::beginOffsetStore(TelegramStorage &storage,
+                                            unsigned long saveInterval) {
+  telegramOffsetRecord record;
+
+  _offsetStorage = &storage;
+  _offsetSaveInterval = saveInterval;
+  _offsetSavedAt = millis();
+
+  if (!storage.load(&record, sizeof(record)) ||
+      record.magic != OFFSET_RECORD_MAGIC ||
+      record.checksum != offsetRecordChecksum(record)) {
+    BOT_DEBUG_PRINTLN(F("No saved update offset"));
+    _savedOffset = last_message_received;
+    return false;
+  }
+
+  last_message_received = record.offset;
+  _savedOffset = record.offset;
+  startup.offset_restored = true;
+  for (uint8_t i = 0; i < RECENT_UPDATES_LENGTH; i++)
+    _recentUpdates[i] = record.recent[i];
+  _recentUpdatesNext = record.recent_next % RECENT_UPDATES_LENGTH;
+
+  BOT_DEBUG_PRINT(F("Restored update offset: "));
+  BOT_DEBUG_PRINTLN(last_message_received);
+  return true;
+}
 
-    // Parse response into Json object
-    DynamicJsonBuffer jsonBuffer;
-    JsonObject &root = jsonBuffer.parseObject(_msg);
-    root.begin();
-
-    if (root.success()) {
-      // root.printTo(Serial);
-      if (_debug)
-        Serial.println();
-      if (root.containsKey("result")) {
-        int resultArrayLength = root["result"].size();
-        if (resultArrayLength > 0) {
-          int newMessageIndex = 0;
-          // Step through all results
-          for (int i = 0; i < resultArrayLength; i++) {
-            JsonObject &result = root["result"][i];
-            if (processResult(result, newMessageIndex)) {
-              newMessageIndex++;
-            }
-          }
-          // We will keep the client open because there may be a response to be
-          // given
-          return newMessageIndex;
-        } else {
-          if (_debug)
-            Serial.println(F("no new messages"));
-        }
-      } else {
-        if (_debug)
-          Serial.println(F("Response contained no 'result'"));
-      }
-    } else { // Parsing failed
-      if (strlen(_msg) < 2) { // Too short a message. Maybe connection issue
-        if (_debug)
-          Serial.println(F("Parsing error: Message too short"));
-      } else {
-        // Buffer may not be big enough, increase buffer or reduce max number of
-        // messages
-        if (_debug)
-          Serial.println(F("Failed to parse update, the message could be too "
-                           "big for the buffer"));
-      }
-    }
-    // Close the client as no response is to be given
-    closeClient();
-    return 0;
+// Writes are coalesced: nothing is written while the offset is unchanged, and
+// unless forced, at most once per save interval (the pending offset is then
+// written by a later call)
+bool UniversalTelegramBot::saveOffset(bool force) {
+  telegramOffsetRecord record;
+
+  if (_offsetStorage == NULL)
+    return false;
+  if (last_message_received == _savedOffset)
+    return true;
+  if (!force && (_offsetSaveInterval > 0) &&
+      (millis() - _offsetSavedAt < _offsetSaveInterval))
+    return false;
+
+  memset(&record, 0, sizeof(record));
+  record.magic = OFFSET_RECORD_MAGIC;
+  record.offset = last_message_received;
+  for (uint8_t i = 0; i < RECENT_UPDATES_LENGTH; i++)
+    record.recent[i] = _recentUpdates[i];
+  record.recent_next = _recentUpdatesNext;
+  record.checksum = offsetRecordChecksum(record);
+
+  if (!_offsetStorage->save(&record, sizeof(record))) {
+    BOT_DEBUG_PRINTLN(F("Failed to save update offset"));
+    return false;
+  }
+  _savedOffset = last_message_received;
+  _offsetSavedAt = millis();
+
+  return true;
+}
+
+bool UniversalTelegramBot::isRecentUpdate(long update_id) {
+  for (uint8_t i = 0; i < RECENT_UPDATES_LENGTH; i++) {
+    if (_recentUpdates[i] == update_id)
+      return true;
   }
+  return false;
+}
+
+void UniversalTelegramBot::addRecentUpdate(long update_id) {
+  _recentUpdates[_recentUpdatesNext] = update_id;
+  _recentUpdatesNext = (_recentUpdatesNext + 1) % RECENT_UPDATES_LENGTH;
 }
 
 bool UniversalTelegramBot::processResult(JsonObject &result, int messageIndex) {
-  int update_id = result["update_id"];
-  // Check have we already dealt with this message (this shouldn't happen!)
-  if (last_message_received != update_id) {
+  long update_id = result["update_id"];
+  // Check have we already dealt with this message (i.e. replayed after a
+  // restart), before parsing any of its fields
+  if (isRecentUpdate(update_id)) {
+    last_message_received = update_id;
+    return false;
+  } else {
     last_message_received = update_id;
+    addRecentUpdate(update_id);
     messages[messageIndex].update_id = update_id;
 
     memset(messages[messageIndex].text, '\0', MAX_MESSAGE_TEXT_LENGTH);
@@ -454,6 +1407,11 @@ bool UniversalTelegramBot::processResult(JsonObject &result, int messageIndex) {
     memset(messages[messageIndex].from_name, '\0', MAX_USER_NAME_LENGTH);
     memset(messages[messageIndex].date, '\0', MAX_DATE_LENGTH);
     memset(messages[messageIndex].type, '\0', MAX_CMD_LENGTH);
+    memset(messages[messageIndex].query_id, '\0', MAX_ID_LENGTH);
+    memset(messages[messageIndex].file_id, '\0', MAX_ID_LENGTH);
+    memset(messages[messageIndex].file_name, '\0', MAX_USER_NAME_LENGTH);
+    messages[messageIndex].file_size = 0;
+    messages[messageIndex].message_id = 0;
     messages[messageIndex].longitude = 0;
     messages[messageIndex].latitude = 0;
 
@@ -464,91 +1422,104 @@ bool UniversalTelegramBot::processResult(JsonObject &result, int messageIndex) {
     if (result.containsKey("message")) {
       JsonObject &message = result["message"];
       strncpy(messages[messageIndex].type, "message", strlen("message")+1);
-      strncpy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"), 
-              message["from"]["id"].measureLength()+1);
-      strncpy(messages[messageIndex].from_name, 
-              message["from"].as<JsonObject>().get<char*>("first_name"),
-              message["from"]["first_name"].measureLength()+1);
-      strncpy(messages[messageIndex].date, message.get<char*>("date"), 
-              message["date"].measureLength()+1);
-      strncpy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"), 
-              message["chat"]["id"].measureLength()+1);
+      messages[messageIndex].message_id = message["message_id"].as<long>();
+      utf8Copy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].from_id));
+      utf8Copy(messages[messageIndex].from_name, message["from"].as<JsonObject>().get<char*>("first_name"),
+               sizeof(messages[messageIndex].from_name));
+      utf8Copy(messages[messageIndex].date, message.get<char*>("date"),
+               sizeof(messages[messageIndex].date));
+      utf8Copy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].chat_id));
       
       if (message["chat"].as<JsonObject>().containsKey("title")) {
-        strncpy(messages[messageIndex].chat_title, 
-                message["chat"].as<JsonObject>().get<char*>("title"), 
-                message["chat"]["title"].measureLength()+1);
+        utf8Copy(messages[messageIndex].chat_title, message["chat"].as<JsonObject>().get<char*>("title"),
+               sizeof(messages[messageIndex].chat_title));
       }
       else
         strncpy(messages[messageIndex].chat_title, "", 1);
 
       if (message.containsKey("text")) {
-        strncpy(messages[messageIndex].text, message.get<char*>("text"), 
-                message["text"].measureLength()+1);
+        utf8Copy(messages[messageIndex].text, message.get<char*>("text"),
+               sizeof(messages[messageIndex].text));
       } else if (message.containsKey("location")) {
         messages[messageIndex].longitude =
             message["location"]["longitude"].as<float>();
         messages[messageIndex].latitude =
             message["location"]["latitude"].as<float>();
       }
+      processFile(message, messageIndex);
     } else if (result.containsKey("channel_post")) {
       JsonObject &message = result["channel_post"];
       strncpy(messages[messageIndex].type, "channel_post", strlen("channel_post")+1);
-      strncpy(messages[messageIndex].text, message.get<char*>("text"), 
-              message["text"].measureLength()+1);
-      strncpy(messages[messageIndex].date, message.get<char*>("date"), 
-              message["date"].measureLength()+1);
-      strncpy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"), 
-              message["chat"]["id"].measureLength()+1);
-      strncpy(messages[messageIndex].chat_title, 
-              message["chat"].as<JsonObject>().get<char*>("title"), 
-              message["chat"]["title"].measureLength()+1);
+      messages[messageIndex].message_id = message["message_id"].as<long>();
+      utf8Copy(messages[messageIndex].text, message.get<char*>("text"),
+               sizeof(messages[messageIndex].text));
+      utf8Copy(messages[messageIndex].date, message.get<char*>("date"),
+               sizeof(messages[messageIndex].date));
+      utf8Copy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].chat_id));
+      utf8Copy(messages[messageIndex].chat_title, message["chat"].as<JsonObject>().get<char*>("title"),
+               sizeof(messages[messageIndex].chat_title));
+      processFile(message, messageIndex);
     } else if (result.containsKey("callback_query")) {
       JsonObject &message = result["callback_query"];
       strncpy(messages[messageIndex].type, "callback_query", strlen("callback_query")+1);
-      strncpy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"), 
-              message["from"]["id"].measureLength()+1);
-      strncpy(messages[messageIndex].from_name, 
-              message["from"].as<JsonObject>().get<char*>("first_name"),
-              message["from"]["first_name"].measureLength()+1);
-      strncpy(messages[messageIndex].text, message.get<char*>("data"), 
-              message["data"].measureLength()+1);
+      utf8Copy(messages[messageIndex].query_id, message.get<char*>("id"),
+               sizeof(messages[messageIndex].query_id));
+      utf8Copy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].from_id));
+      utf8Copy(messages[messageIndex].from_name, message["from"].as<JsonObject>().get<char*>("first_name"),
+               sizeof(messages[messageIndex].from_name));
+      utf8Copy(messages[messageIndex].text, message.get<char*>("data"),
+               sizeof(messages[messageIndex].text));
       if (message.containsKey("message")) {
-        strncpy(messages[messageIndex].date, 
-          message["message"].as<JsonObject>().get<char*>("date"), 
-              message["message"]["date"].measureLength()+1);
-        strncpy(messages[messageIndex].chat_id, 
-                message["message"]["chat"].as<JsonObject>().get<char*>("id"), 
-                message["message"]["chat"]["id"].measureLength()+1);
+        messages[messageIndex].message_id = message["message"]["message_id"].as<long>();
+        utf8Copy(messages[messageIndex].date, message["message"].as<JsonObject>().get<char*>("date"),
+               sizeof(messages[messageIndex].date));
+        utf8Copy(messages[messageIndex].chat_id, message["message"]["chat"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].chat_id));
       }
       strncpy(messages[messageIndex].chat_title, "", 1);
+    } else if (result.containsKey("inline_query")) {
+      JsonObject &message = result["inline_query"];
+      strncpy(messages[messageIndex].type, "inline_query", strlen("inline_query")+1);
+      utf8Copy(messages[messageIndex].query_id, message.get<char*>("id"),
+               sizeof(messages[messageIndex].query_id));
+      utf8Copy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].from_id));
+      utf8Copy(messages[messageIndex].from_name, message["from"].as<JsonObject>().get<char*>("first_name"),
+               sizeof(messages[messageIndex].from_name));
+      utf8Copy(messages[messageIndex].text, message.get<char*>("query"),
+               sizeof(messages[messageIndex].text));
+      strncpy(messages[messageIndex].chat_title, "", 1);
     } else if (result.containsKey("edited_message")) {
       JsonObject &message = result["edited_message"];
       strncpy(messages[messageIndex].type, "edited_message", strlen("edited_message")+1);
-      strncpy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"), 
-              message["from"]["id"].measureLength()+1);
-      strncpy(messages[messageIndex].from_name, 
-              message["from"].as<JsonObject>().get<char*>("first_name"),
-              message["from"]["first_name"].measureLength()+1);
-      strncpy(messages[messageIndex].date, message.get<char*>("date"), 
-              message["date"].measureLength()+1);
-      strncpy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"), 
-              message["chat"]["id"].measureLength()+1);
+      messages[messageIndex].message_id = message["message_id"].as<long>();
+      utf8Copy(messages[messageIndex].from_id, message["from"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].from_id));
+      utf8Copy(messages[messageIndex].from_name, message["from"].as<JsonObject>().get<char*>("first_name"),
+               sizeof(messages[messageIndex].from_name));
+      utf8Copy(messages[messageIndex].date, message.get<char*>("date"),
+               sizeof(messages[messageIndex].date));
+      utf8Copy(messages[messageIndex].chat_id, message["chat"].as<JsonObject>().get<char*>("id"),
+               sizeof(messages[messageIndex].chat_id));
       if (message["chat"].as<JsonObject>().containsKey("title")) {
-        strncpy(messages[messageIndex].chat_title, 
-                message["chat"].as<JsonObject>().get<char*>("title"), 
-                message["chat"]["title"].measureLength()+1);
+        utf8Copy(messages[messageIndex].chat_title, message["chat"].as<JsonObject>().get<char*>("title"),
+               sizeof(messages[messageIndex].chat_title));
       }
       else
         strncpy(messages[messageIndex].chat_title, "", 1);
 
       if (message.containsKey("text")) {
-        strncpy(messages[messageIndex].text, message.get<char*>("text"), 
-                message["text"].measureLength()+1);
+        utf8Copy(messages[messageIndex].text, message.get<char*>("text"),
+               sizeof(messages[messageIndex].text));
       } else if (message.containsKey("location")) {
         messages[messageIndex].longitude = message["location"]["longitude"].as<float>();
         messages[messageIndex].latitude = message["location"]["latitude"].as<float>();
       }
+      processFile(message, messageIndex);
     }
 
     messages[messageIndex].text[MAX_MESSAGE_TEXT_LENGTH-1] = '\0';
@@ -558,35 +1529,79 @@ bool UniversalTelegramBot::processResult(JsonObject &result, int messageIndex) {
     messages[messageIndex].from_name[MAX_USER_NAME_LENGTH-1] = '\0';
     messages[messageIndex].date[MAX_DATE_LENGTH-1] = '\0';
     messages[messageIndex].type[MAX_CMD_LENGTH-1] = '\0';
+    messages[messageIndex].query_id[MAX_ID_LENGTH-1] = '\0';
+    messages[messageIndex].file_id[MAX_ID_LENGTH-1] = '\0';
 
     return true;
   }
   return false;
 }
 
+// Keep the file attached to a message, if any. Of a photo, Telegram sends
+// several sizes, the last one is the largest.
+void UniversalTelegramBot::processFile(JsonObject &message, int messageIndex) {
+  static const char* const file_types[] = { "document", "audio", "voice", "video" };
+  JsonVariant variant;
+
+  if (message.containsKey("photo")) {
+    JsonArray &photo = message["photo"];
+    if (photo.size() > 0)
+      variant = photo[photo.size() - 1];
+  } else {
+    for (uint8_t i = 0; i < sizeof(file_types) / sizeof(file_types[0]); i++) {
+      if (message.containsKey(file_types[i])) {
+        variant = message[file_types[i]];
+        break;
+      }
+    }
+  }
+  JsonObject &file = variant;
+  if (!file.success())
+    return;
+
+  utf8Copy(messages[messageIndex].file_id, file.get<char*>("file_id"),
+           sizeof(messages[messageIndex].file_id));
+  utf8Copy(messages[messageIndex].file_name, file.get<char*>("file_name"),
+           sizeof(messages[messageIndex].file_name));
+  messages[messageIndex].file_size = file.get<long>("file_size");
+  // Files sent with a caption have no text, the caption takes its place
+  if (message.containsKey("caption") && (messages[messageIndex].text[0] == '\0')) {
+    utf8Copy(messages[messageIndex].text, message.get<char*>("caption"),
+             sizeof(messages[messageIndex].text));
+  }
+}
+
 /***********************************************************************
  * SendMessage - function to send message to telegram                  *
  * (Arguments to pass: chat_id, text to transmit and markup(optional)) *
  ***********************************************************************/
 bool UniversalTelegramBot::sendSimpleMessage(const char* chat_id, const char* text,
                                              const char* parse_mode) {
+  TelegramLaneScope scope(*this, LANE_SEND);
   char command[MAX_CMD_LENGTH]; command[0] = '\0';
   bool sent = false;
-  if (_debug)
-    Serial.println(F("SEND Simple Message"));
+  BOT_DEBUG_PRINTLN(F("SEND Simple Message"));
   unsigned long sttime = millis();
+  int attempt = 0;
 
   if (strcmp(text ,"") != 0) {
+    // Too long for the request line, it would be cut short
+    if (snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendMessage?chat_id=%s&text=%s&parse_mode=%s",
+                   _token, chat_id, text, parse_mode) >= (int)MAX_CMD_LENGTH)
+      return sendMessage(chat_id, text, parse_mode);
+
     while (millis() < sttime + 8000) { // loop for a while to send the message
+      if (attempt++ > 0)
+        stats.retries++;
       snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendMessage?chat_id=%s&text=%s&parse_mode=%s", _token, chat_id, 
               text, parse_mode);
 	  command[MAX_CMD_LENGTH-1] = '\0';
       memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-      strncpy(_msg, sendGetToTelegram(command), MAX_MESSAGE_LENGTH);
+      sendGetToTelegram(command);
       _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-      if (_debug)
-        Serial.println(_msg);
+      BOT_DEBUG_DUMP(_msg);
       sent = checkForOkResponse(_msg);
+      finishRequest(sent);
       if (sent) {
         break;
       }
@@ -596,26 +1611,317 @@ bool UniversalTelegramBot::sendSimpleMessage(const char* chat_id, const char* te
   return sent;
 }
 
+/***********************************************************************
+ * Segments of a message body, escaping the arguments on the fly:      *
+ * {"chat_id":"<chat_id>"[,"message_id":<id>],"text":"<text>"          *
+ * [,"parse_mode":"<parse_mode>"]                                      *
+ * The last string is left open, the caller closes it and the object.  *
+ * Returns the number of segments (up to 8), and in text_segment (if   *
+ * given) the index of the text's one.                                 *
+ ***********************************************************************/
+uint8_t UniversalTelegramBot::messageBodySegments(telegramBodySegment* body,
+                                                  const char* chat_id,
+                                                  long message_id,
+                                                  const char* text,
+                                                  const char* parse_mode,
+                                                  uint8_t* text_segment) {
+  uint8_t count = 0;
+
+  body[count++] = BODY_LITERAL("{\"chat_id\":\"");
+  body[count++] = BODY_STRING(chat_id);
+  if (message_id != 0) {
+    snprintf_P(_bodyMessageId, sizeof(_bodyMessageId), "%ld", message_id);
+    body[count++] = BODY_LITERAL("\",\"message_id\":");
+    body[count++] = BODY_RAW(_bodyMessageId);
+    body[count++] = BODY_LITERAL(",\"text\":\"");
+  } else {
+    body[count++] = BODY_LITERAL("\",\"text\":\"");
+  }
+  if (text_segment != NULL)
+    *text_segment = count;
+  body[count++] = BODY_STRING(text);
+  if (strcmp(parse_mode, "") != 0) {
+    body[count++] = BODY_LITERAL("\",\"parse_mode\":\"");
+    body[count++] = BODY_STRING(parse_mode);
+  }
+
+  return count;
+}
+
 bool UniversalTelegramBot::sendMessage(const char* chat_id, const char* text,
                                        const char* parse_mode) {
-  DynamicJsonBuffer jsonBuffer;
-  JsonObject &payload = jsonBuffer.createObject();
+  TelegramLaneScope scope(*this, LANE_SEND);
 
-  payload["chat_id"] = chat_id;
-  payload["text"] = text;
+  BOT_DEBUG_PRINTLN(F("SEND Message"));
 
-  if (strcmp(parse_mode, "") != 0) {
-    payload["parse_mode"] = parse_mode;
+  return sendMessageParts(chat_id, text, parse_mode, NULL);
+}
+
+bool UniversalTelegramBot::sendMessage(const char* chat_id, const char* text,
+                                       const char* parse_mode,
+                                       const TelegramKeyboard &keyboard) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+
+  BOT_DEBUG_PRINTLN(F("SEND Message with Keyboard"));
+
+  return sendMessageParts(chat_id, text, parse_mode, &keyboard);
+}
+
+// The line break or space a text was cut at is in neither part. Only that
+// one: more of them (a blank line, an indentation) belong to the next part.
+static size_t skipSeparator(const char* text, size_t offset, size_t length) {
+  if ((offset < length) && ((text[offset] == '\n') || (text[offset] == ' ')))
+    offset++;
+  return offset;
+}
+
+/***************************************************************
+ * Texts longer than MESSAGE_TEXT_LIMIT are sent as several    *
+ * messages, cut at line breaks (or spaces) where no markup is *
+ * left open. Each part is a slice of the text, escaped as it  *
+ * is written, so the text is never copied. The parts are sent *
+ * in order on the same connection, each once the previous one *
+ * was accepted; the first that fails stops the rest. The      *
+ * keyboard, if any, goes with the last part.                  *
+ * The outcome of all the parts is kept in lastSplit.          *
+ ***************************************************************/
+bool UniversalTelegramBot::sendMessageParts(const char* chat_id, const char* text,
+                                            const char* parse_mode,
+                                            const TelegramKeyboard *keyboard) {
+  telegramBodySegment body[8 + 2 + MAX_KEYBOARD_SEGMENTS];
+  TextMarkup markup = textMarkup(parse_mode);
+  size_t length = strlen(text);
+  size_t offset = 0;
+  bool sent = true;
+
+  memset(&lastSplit, 0, sizeof(lastSplit));
+  uint8_t text_segment;
+  uint8_t count = messageBodySegments(body, chat_id, 0, text, parse_mode, &text_segment);
+
+  do {
+    size_t part = textPartLength(text + offset, length - offset,
+                                 MESSAGE_TEXT_LIMIT, markup);
+    body[text_segment].data = text + offset;
+    body[text_segment].length = part;
+    offset = skipSeparator(text, offset + part, length);
+
+    uint8_t body_count = count;
+    if ((offset >= length) && (keyboard != NULL)) {
+      // The keyboard is spliced into the body already serialized
+      body[body_count++] = BODY_LITERAL("\",\"reply_markup\":");
+      body_count += keyboard->getSegments(&body[body_count]);
+      body[body_count++] = BODY_LITERAL("}");
+    } else {
+      body[body_count++] = BODY_LITERAL("\"}");
+    }
+
+    lastSplit.parts++;
+    sent = postCommand("sendMessage", NULL, body, body_count);
+    if (sent) {
+      lastSplit.sent++;
+      lastSplit.last_message_id = getResponseMessageId(_msg);
+      if (lastSplit.first_message_id == 0)
+        lastSplit.first_message_id = lastSplit.last_message_id;
+    }
+  } while (sent && (offset < length));
+
+  // Parts left unsent still count
+  while (offset < length) {
+    offset = skipSeparator(text, offset + textPartLength(text + offset, length - offset,
+                                                        MESSAGE_TEXT_LIMIT, markup),
+                           length);
+    lastSplit.parts++;
   }
 
-  return sendPostMessage(payload);
+  closeClient();
+  return sent;
+}
+
+// Send a message template, filling its placeholders with values. Only the
+// chat_id and the values are escaped, the rest was serialized beforehand.
+bool UniversalTelegramBot::sendMessage(const char* chat_id,
+                                       const TelegramMessageTemplate &message,
+                                       const char* const* values, uint8_t count) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  telegramBodySegment body[MAX_TEMPLATE_SEGMENTS];
+
+  BOT_DEBUG_PRINTLN(F("SEND Message Template"));
+
+  uint8_t segments = message.getSegments(body, chat_id, values, count);
+  if (segments == 0)
+    return false;
+
+  return sendPostCommand("sendMessage", NULL, body, segments);
+}
+
+/***************************************************************
+ * Broadcast - send the same message to many chats. The body   *
+ * is laid out (and its length computed) once, only the chat_id *
+ * changes, and the connection is kept open between sends.     *
+ * Sends are spaced by broadcastInterval ms, and paused for as  *
+ * long as Telegram asks on a 429 response.                    *
+ * (Arguments to pass: the message, a function returning the   *
+ * next chat_id (NULL when done), and an optional callback     *
+ * called after each chat)                                     *
+ * Returns the number of chats the message was sent to         *
+ ***************************************************************/
+uint32_t UniversalTelegramBot::broadcast(const char* text, GetNextChatId nextChatId,
+                                         const char* parse_mode,
+                                         BroadcastCallback callback) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  telegramBodySegment body[9];
+
+  BOT_DEBUG_PRINTLN(F("SEND Broadcast"));
+
+  uint8_t count = messageBodySegments(body, "", 0, text, parse_mode);
+  body[count++] = BODY_LITERAL("\"}");
+
+  return broadcastSegments(body, count, nextChatId, callback);
+}
+
+uint32_t UniversalTelegramBot::broadcast(const TelegramMessageTemplate &message,
+                                         GetNextChatId nextChatId,
+                                         BroadcastCallback callback,
+                                         const char* const* values, uint8_t count) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  telegramBodySegment body[MAX_TEMPLATE_SEGMENTS];
+
+  BOT_DEBUG_PRINTLN(F("SEND Broadcast Template"));
+
+  uint8_t segments = message.getSegments(body, "", values, count);
+  if (segments == 0)
+    return 0;
+
+  return broadcastSegments(body, segments, nextChatId, callback);
+}
+
+// The chat_id is the second segment of the body, see messageBodySegments()
+// and TelegramMessageTemplate::getSegments()
+uint32_t UniversalTelegramBot::broadcastSegments(telegramBodySegment* body,
+                                                 uint8_t count,
+                                                 GetNextChatId nextChatId,
+                                                 BroadcastCallback callback) {
+  char command[MAX_CMD_LENGTH]; command[0] = '\0';
+  snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendMessage", _token);
+  command[MAX_CMD_LENGTH-1] = '\0';
+
+  telegramBroadcast progress;
+  memset(&progress, 0, sizeof(progress));
+  unsigned long started = millis();
+  unsigned long last_send = 0;
+  size_t shared_length = bodyLength(body, count);
+
+  const char* chat_id;
+  while ((chat_id = nextChatId()) != NULL) {
+    body[1].data = chat_id;
+    body[1].length = strlen(chat_id);
+    size_t content_length = shared_length + jsonEscapedLength(chat_id, body[1].length);
+
+    BroadcastResult result = BROADCAST_FAILED;
+    for (uint8_t attempt = 0; attempt < BROADCAST_ATTEMPTS; attempt++) {
+      if (attempt > 0)
+        stats.retries++;
+      while ((progress.processed > 0 || attempt > 0) &&
+             (millis() - last_send < broadcastInterval))
+        yield();
+      last_send = millis();
+
+      sendPostToTelegram(command, body, count, content_length);
+      bool sent = checkForOkResponse(_msg);
+      finishRequest(sent);
+      if (sent) {
+        result = BROADCAST_SENT;
+        break;
+      }
+
+      int status = lastRequest.http_status;
+      if (status == 403) {
+        // The user blocked the bot, or the bot was removed from the chat
+        result = BROADCAST_BLOCKED;
+        break;
+      }
+      if (status == 429) {
+        // Wait as long as Telegram asks before going on
+        unsigned long wait = retryAfter();
+        BOT_DEBUG_PRINT(F("Broadcast rate limited, waiting (s): "));
+        BOT_DEBUG_PRINTLN(wait);
+        delay(wait * 1000);
+      } else if ((status >= 400) && (status < 500)) {
+        break; // i.e. chat not found, sending it again will not help
+      } else {
+        closeClient(); // Connection or server error, start over
+      }
+    }
+
+    progress.processed++;
+    if (result == BROADCAST_SENT)
+      progress.sent++;
+    else if (result == BROADCAST_BLOCKED)
+      progress.blocked++;
+    else
+      progress.failed++;
+    progress.elapsed_ms = millis() - started;
+
+    if (callback != NULL)
+      callback(chat_id, result, progress);
+  }
+
+  closeClient();
+  return progress.sent;
+}
+
+void UniversalTelegramBot::beginBatch() {
+  enterLane(LANE_SEND);
+}
+
+void UniversalTelegramBot::endBatch(bool close) {
+  if (close)
+    closeClient();
+  leaveLane();
+}
+
+/***************************************************************
+ * A single attempt to send a message, or to edit the text of  *
+ * one (message_id), on the connection left open by the        *
+ * previous one. A connection that gave no answer, or an error *
+ * other than a rejection, is closed, so the next attempt      *
+ * starts over.                                                *
+ ***************************************************************/
+SendResult UniversalTelegramBot::trySendMessage(const char* chat_id, const char* text,
+                                                const char* parse_mode) {
+  return tryMessage("sendMessage", chat_id, 0, text, parse_mode);
+}
+
+SendResult UniversalTelegramBot::tryEditMessageText(const char* chat_id, long message_id,
+                                                    const char* text,
+                                                    const char* parse_mode) {
+  return tryMessage("editMessageText", chat_id, message_id, text, parse_mode);
+}
+
+SendResult UniversalTelegramBot::tryMessage(const char* method, const char* chat_id,
+                                            long message_id, const char* text,
+                                            const char* parse_mode) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  telegramBodySegment body[9];
+
+  uint8_t count = messageBodySegments(body, chat_id, message_id, text, parse_mode);
+  body[count++] = BODY_LITERAL("\"}");
+  if (postAttempt(method, NULL, body, count))
+    return SEND_OK;
+
+  int status = lastRequest.http_status;
+  if ((status >= 400) && (status < 500) && (status != 429))
+    return SEND_REJECTED;
+  closeClient();
+  return (status == 0) ? SEND_OFFLINE : SEND_RETRY;
 }
 
 bool UniversalTelegramBot::sendMessageWithReplyKeyboard(
     const char* chat_id, const char* text, const char* parse_mode, const char* keyboard,
     bool resize, bool oneTime, bool selective) {
+  TelegramLaneScope scope(*this, LANE_SEND);
 
-  DynamicJsonBuffer jsonBuffer;
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
   JsonObject &payload = jsonBuffer.createObject();
 
   payload["chat_id"] = chat_id;
@@ -632,8 +1938,8 @@ bool UniversalTelegramBot::sendMessageWithReplyKeyboard(
   // Inner arrays represents columns
   // This example "ledon" and "ledoff" are two buttons on the top row
   // and "status is a single button on the next row"
-  DynamicJsonBuffer keyboardBuffer;
-  replyMarkup["keyboard"] = keyboardBuffer.parseArray(keyboard);
+  // Spliced into the payload as is, it is not parsed
+  replyMarkup["keyboard"] = RawJson(keyboard);
 
   // Telegram defaults these values to false, so to decrease the size of the
   // payload we will only send them if needed
@@ -656,7 +1962,8 @@ bool UniversalTelegramBot::sendMessageWithInlineKeyboard(const char* chat_id,
                                                          const char* text,
                                                          const char* parse_mode,
                                                          const char* keyboard) {
-  DynamicJsonBuffer jsonBuffer;
+  TelegramLaneScope scope(*this, LANE_SEND);
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
   JsonObject &payload = jsonBuffer.createObject();
 
   payload["chat_id"] = chat_id;
@@ -668,8 +1975,7 @@ bool UniversalTelegramBot::sendMessageWithInlineKeyboard(const char* chat_id,
 
   JsonObject &replyMarkup = payload.createNestedObject("reply_markup");
 
-  DynamicJsonBuffer keyboardBuffer;
-  replyMarkup["inline_keyboard"] = keyboardBuffer.parseArray(keyboard);
+  replyMarkup["inline_keyboard"] = RawJson(keyboard);
 
   return sendPostMessage(payload);
 }
@@ -679,56 +1985,303 @@ bool UniversalTelegramBot::sendMessageWithInlineKeyboard(const char* chat_id,
  * (Arguments to pass: chat_id, text to transmit and markup(optional)) *
  ***********************************************************************/
 bool UniversalTelegramBot::sendPostMessage(JsonObject &payload) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("SEND Post Message"));
+
+  if (!payload.containsKey("text")) {
+    closeClient();
+    return false;
+  }
+
+  return sendPostCommand("sendMessage", payload);
+}
+
+/***********************************************************************
+ * SendPostCommand - POST the payload to an API method, retrying for a *
+ * while on connection errors. Saves the message_id of the result, if  *
+ * any, in last_sent_message_id.                                       *
+ * (Arguments to pass: API method name and its JSON payload)           *
+ ***********************************************************************/
+bool UniversalTelegramBot::sendPostCommand(const char* method, JsonObject &payload) {
+  return sendPostCommand(method, &payload, NULL, 0);
+}
+
+bool UniversalTelegramBot::sendPostCommand(const char* method, JsonObject *payload,
+                                           const telegramBodySegment* segments,
+                                           uint8_t count) {
+  bool sent = postCommand(method, payload, segments, count);
+
+  closeClient();
+  return sent;
+}
+
+// Send a command, retrying for a while, and leave the connection open
+bool UniversalTelegramBot::postCommand(const char* method, JsonObject *payload,
+                                       const telegramBodySegment* segments,
+                                       uint8_t count) {
   bool sent = false;
-  if (_debug)
-    Serial.println(F("SEND Post Message"));
   unsigned long sttime = millis();
+  int attempt = 0;
 
-  if (payload.containsKey("text")) {
-    while (millis() < sttime + 8000) { // loop for a while to send the message
-      char command[MAX_CMD_LENGTH]; command[0] = '\0';
-      snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendMessage", _token);
-	  command[MAX_CMD_LENGTH-1] = '\0';
-      memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-      strncpy(_msg, sendPostToTelegram(command, payload), MAX_MESSAGE_LENGTH);
-      _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-      if (_debug)
-        Serial.println(_msg);
-      sent = checkForOkResponse(_msg);
-      if (sent) {
+  while (millis() < sttime + 8000) { // loop for a while to send the message
+    if (attempt++ > 0)
+      stats.retries++;
+    sent = postAttempt(method, payload, segments, count);
+    if (sent)
+      break;
+    if (lastRequest.http_status == 429) {
+      // Wait as long as Telegram asks, if that is within the time left
+      unsigned long wait = retryAfter() * 1000;
+      if (millis() + wait >= sttime + 8000)
         break;
-      }
+      delay(wait);
+      continue;
     }
+    // The request was rejected (i.e. "message is not modified"), sending it
+    // again will not help. Retry only on rate limit and server errors.
+    if ((lastRequest.http_status >= 400) && (lastRequest.http_status < 500))
+      break;
+  }
+
+  return sent;
+}
+
+// Send a command once, and leave the connection open
+bool UniversalTelegramBot::postAttempt(const char* method, JsonObject *payload,
+                                       const telegramBodySegment* segments,
+                                       uint8_t count) {
+  char command[MAX_CMD_LENGTH]; command[0] = '\0';
+
+  snprintf_P(command, MAX_CMD_LENGTH, "bot%s/%s", _token, method);
+  command[MAX_CMD_LENGTH-1] = '\0';
+  memset(_msg, '\0', MAX_MESSAGE_LENGTH);
+  if (payload != NULL)
+    sendPostToTelegram(command, *payload);
+  else
+    sendPostToTelegram(command, segments, count);
+  _msg[MAX_MESSAGE_LENGTH-1] = '\0';
+  BOT_DEBUG_DUMP(_msg);
+  bool sent = checkForOkResponse(_msg);
+  finishRequest(sent);
+  if (sent) {
+    long message_id = getResponseMessageId(_msg);
+    if (message_id != 0)
+      last_sent_message_id = message_id;
   }
 
-  closeClient();
   return sent;
 }
 
+// Seconds a rate limited (429) request asks to wait, from the response in
+// _msg (1 if not given)
+unsigned long UniversalTelegramBot::retryAfter() {
+  const char* retry_after = strstr(_msg, "\"retry_after\":");
+  if (retry_after == NULL)
+    return 1;
+  return atol(retry_after + strlen("\"retry_after\":"));
+}
+
+// From the response in _msg, i.e. the edit that was sent again after its
+// answer was lost
+bool UniversalTelegramBot::notModified() {
+  return strstr(_msg, "message is not modified") != NULL;
+}
+
+// Look for the message_id of the sent message in an API response, without
+// parsing the whole response
+long UniversalTelegramBot::getResponseMessageId(const char* response) {
+  const char* message_id = strstr(response, "\"message_id\":");
+  if (message_id == NULL)
+    return 0;
+  return atol(message_id + strlen("\"message_id\":"));
+}
+
+// The file_id of a sendPhoto response is that of the largest size, the last
+// of the photo array
+bool UniversalTelegramBot::getResponseFileId(const char* response) {
+  const char* key = "\"file_id\":\"";
+  const char* file_id = NULL;
+
+  last_sent_file_id[0] = '\0';
+  const char* photo = strstr(response, "\"photo\":[");
+  if (photo == NULL)
+    return false;
+  // The sizes are flat objects, the first ']' closes the array
+  const char* end = strchr(photo, ']');
+  for (const char* p = strstr(photo, key); (p != NULL) && ((end == NULL) || (p < end));
+       p = strstr(p + 1, key))
+    file_id = p + strlen(key);
+  if (file_id == NULL)
+    return false;
+
+  size_t length = strcspn(file_id, "\"");
+  if (length >= sizeof(last_sent_file_id))
+    return false;
+  memcpy(last_sent_file_id, file_id, length);
+  last_sent_file_id[length] = '\0';
+
+  return true;
+}
+
+bool UniversalTelegramBot::editMessageText(const char* chat_id, long message_id,
+                                           const char* text, const char* parse_mode,
+                                           const char* keyboard) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("EDIT Message Text"));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &payload = jsonBuffer.createObject();
+
+  payload["chat_id"] = chat_id;
+  payload["message_id"] = message_id;
+  payload["text"] = text;
+
+  if (strcmp(parse_mode, "") != 0) {
+    payload["parse_mode"] = parse_mode;
+  }
+
+  if (strcmp(keyboard, "") != 0) {
+    JsonObject &replyMarkup = payload.createNestedObject("reply_markup");
+    replyMarkup["inline_keyboard"] = RawJson(keyboard);
+  }
+
+  return sendPostCommand("editMessageText", payload);
+}
+
+bool UniversalTelegramBot::editMessageReplyMarkup(const char* chat_id,
+                                                  long message_id,
+                                                  const char* keyboard) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("EDIT Message Reply Markup"));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &payload = jsonBuffer.createObject();
+
+  payload["chat_id"] = chat_id;
+  payload["message_id"] = message_id;
+
+  // An empty keyboard removes the inline keyboard from the message
+  if (strcmp(keyboard, "") != 0) {
+    JsonObject &replyMarkup = payload.createNestedObject("reply_markup");
+    replyMarkup["inline_keyboard"] = RawJson(keyboard);
+  }
+
+  return sendPostCommand("editMessageReplyMarkup", payload);
+}
+
+bool UniversalTelegramBot::editMessageText(const char* chat_id, long message_id,
+                                           const char* text, const char* parse_mode,
+                                           const TelegramKeyboard &keyboard) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  telegramBodySegment body[8 + 2 + MAX_KEYBOARD_SEGMENTS];
+
+  BOT_DEBUG_PRINTLN(F("EDIT Message Text"));
+
+  uint8_t count = messageBodySegments(body, chat_id, message_id, text, parse_mode);
+  body[count++] = BODY_LITERAL("\",\"reply_markup\":");
+  count += keyboard.getSegments(&body[count]);
+  body[count++] = BODY_LITERAL("}");
+
+  return sendPostCommand("editMessageText", NULL, body, count);
+}
+
+bool UniversalTelegramBot::editMessageReplyMarkup(const char* chat_id,
+                                                  long message_id,
+                                                  const TelegramKeyboard &keyboard) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  char message_id_value[16];
+  telegramBodySegment body[5 + MAX_KEYBOARD_SEGMENTS];
+  uint8_t count = 0;
+
+  BOT_DEBUG_PRINTLN(F("EDIT Message Reply Markup"));
+
+  snprintf_P(message_id_value, sizeof(message_id_value), "%ld", message_id);
+  body[count++] = BODY_LITERAL("{\"chat_id\":\"");
+  body[count++] = BODY_STRING(chat_id);
+  body[count++] = BODY_LITERAL("\",\"message_id\":");
+  body[count++] = BODY_RAW(message_id_value);
+  body[count++] = BODY_LITERAL(",\"reply_markup\":");
+  count += keyboard.getSegments(&body[count]);
+  body[count++] = BODY_LITERAL("}");
+
+  return sendPostCommand("editMessageReplyMarkup", NULL, body, count);
+}
+
+bool UniversalTelegramBot::deleteMessage(const char* chat_id, long message_id) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("DELETE Message"));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &payload = jsonBuffer.createObject();
+
+  payload["chat_id"] = chat_id;
+  payload["message_id"] = message_id;
+
+  return sendPostCommand("deleteMessage", payload);
+}
+
+/***********************************************************************
+ * AnswerCallbackQuery - acknowledge an inline keyboard button press,  *
+ * so the Telegram client stops showing its progress indicator         *
+ * (Arguments to pass: query_id of the callback_query message, and     *
+ * optionally a notification text, shown as an alert if show_alert)    *
+ ***********************************************************************/
+bool UniversalTelegramBot::answerCallbackQuery(const char* query_id,
+                                               const char* text,
+                                               bool show_alert) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("ANSWER Callback Query"));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &payload = jsonBuffer.createObject();
+
+  payload["callback_query_id"] = query_id;
+
+  if (strcmp(text, "") != 0) {
+    payload["text"] = text;
+  }
+
+  if (show_alert) {
+    payload["show_alert"] = show_alert;
+  }
+
+  return sendPostCommand("answerCallbackQuery", payload);
+}
+
+/***********************************************************************
+ * AnswerInlineQuery - answer an inline query (@bot query), with the   *
+ * results given as a serialized JSON array of InlineQueryResult, i.e. *
+ * from a TelegramInlineCache. They are spliced into the payload as is *
+ * (Arguments to pass: the query_id, the results, how long Telegram    *
+ * may cache them (s), and whether they are only for this user)        *
+ ***********************************************************************/
+bool UniversalTelegramBot::answerInlineQuery(const char* query_id,
+                                             const char* results,
+                                             uint32_t cache_time,
+                                             bool is_personal) {
+  TelegramLaneScope scope(*this, LANE_SEND);
+  BOT_DEBUG_PRINTLN(F("ANSWER Inline Query"));
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
+  JsonObject &payload = jsonBuffer.createObject();
+
+  payload["inline_query_id"] = query_id;
+  payload["results"] = RawJson(results);
+  payload["cache_time"] = cache_time;
+
+  if (is_personal) {
+    payload["is_personal"] = is_personal;
+  }
+
+  return sendPostCommand("answerInlineQuery", payload);
+}
+
 char* UniversalTelegramBot::sendPostPhoto(JsonObject &payload) {
-  bool sent = false;
+  TelegramLaneScope scope(*this, LANE_SEND);
   memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-  if (_debug)
-    Serial.println(F("SEND Post Photo"));
-  unsigned long sttime = millis();
+  BOT_DEBUG_PRINTLN(F("SEND Post Photo"));
 
   if (payload.containsKey("photo")) {
-    while (millis() < sttime + 8000) { // loop for a while to send the message
-      char command[MAX_CMD_LENGTH]; command[0] = '\0';
-      snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendPhoto", _token);
-	  command[MAX_CMD_LENGTH-1] = '\0';
-      strncpy(_msg, sendPostToTelegram(command, payload), MAX_MESSAGE_LENGTH);
-      _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-      if (_debug)
-        Serial.println(_msg);
-      sent = checkForOkResponse(_msg);
-      if (sent) {
-        break;
-      }
-    }
+    sendPostCommand("sendPhoto", payload);
+  } else {
+    closeClient();
   }
 
-  closeClient();
   return _msg;
 }
 
@@ -736,27 +2289,92 @@ char* UniversalTelegramBot::sendPhotoByBinary(
     const char* chat_id, const char* contentType, int fileSize,
     MoreDataAvailable moreDataAvailableCallback,
     GetNextByte getNextByteCallback) {
+  TelegramLaneScope scope(*this, LANE_UPLOAD);
 
-  if (_debug)
-    Serial.println("SEND Photo");
+  BOT_DEBUG_PRINTLN(F("SEND Photo"));
 
   memset(_msg, '\0', MAX_MESSAGE_LENGTH);
-  strncpy(_msg, sendMultipartFormDataToTelegram(
+  sendMultipartFormDataToTelegram(
       "sendPhoto", "photo", "img.jpg", contentType, chat_id, fileSize,
-      moreDataAvailableCallback, getNextByteCallback), MAX_MESSAGE_LENGTH);
+      moreDataAvailableCallback, getNextByteCallback);
   _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-  if (_debug)
-    Serial.println(_msg);
+  BOT_DEBUG_DUMP(_msg);
+  finishRequest(checkForOkResponse(_msg));
+  getResponseFileId(_msg);
 
   return _msg;
 }
 
+/***************************************************************
+ * Send a photo through a file_id cache: content sent before   *
+ * goes as its file_id, in a small JSON request, and only new  *
+ * content is uploaded (its file_id is then cached). hash      *
+ * identifies the content, i.e. TelegramFileCache::contentHash *
+ * computed once, or any id that changes with the content.    *
+ * The file_id request and the upload each take the client of  *
+ * their own lane.                                             *
+ ***************************************************************/
+bool UniversalTelegramBot::sendPhoto(const char* chat_id, const uint8_t* data,
+                                     size_t length, TelegramFileCache &cache,
+                                     const char* contentType) {
+  return sendCachedPhoto(chat_id, TelegramFileCache::contentHash(data, length), length,
+                         cache, contentType, NULL, NULL, data);
+}
+
+bool UniversalTelegramBot::sendPhotoByBinary(const char* chat_id, const char* contentType,
+                                             int fileSize,
+                                             MoreDataAvailable moreDataAvailableCallback,
+                                             GetNextByte getNextByteCallback,
+                                             TelegramFileCache &cache, uint32_t hash) {
+  return sendCachedPhoto(chat_id, hash, fileSize, cache, contentType,
+                         moreDataAvailableCallback, getNextByteCallback, NULL);
+}
+
+bool UniversalTelegramBot::sendCachedPhoto(const char* chat_id, uint32_t hash,
+                                           uint32_t size, TelegramFileCache &cache,
+                                           const char* contentType,
+                                           MoreDataAvailable moreDataAvailableCallback,
+                                           GetNextByte getNextByteCallback,
+                                           const uint8_t* data) {
+  const char* file_id = cache.get(hash, size);
+
+  if (file_id != NULL) {
+    TelegramLaneScope scope(*this, LANE_SEND);
+    telegramBodySegment body[5];
+
+    BOT_DEBUG_PRINTLN(F("SEND Cached Photo"));
+    strcpy(last_sent_file_id, file_id);
+    body[0] = BODY_LITERAL("{\"chat_id\":\"");
+    body[1] = BODY_STRING(chat_id);
+    body[2] = BODY_LITERAL("\",\"photo\":\"");
+    body[3] = BODY_STRING(last_sent_file_id);
+    body[4] = BODY_LITERAL("\"}");
+    if (sendPostCommand("sendPhoto", NULL, body, 5))
+      return true;
+    // Only a rejected file_id is worth an upload, i.e. not a lost connection
+    if (lastRequest.http_status != 400)
+      return false;
+    cache.remove(hash, size);
+  }
+
+  BOT_DEBUG_PRINTLN(F("SEND Photo"));
+  sendMultipartFormData("sendPhoto", "photo", "img.jpg", contentType, chat_id, size,
+                        moreDataAvailableCallback, getNextByteCallback, data);
+  bool sent = checkForOkResponse(_msg);
+  finishRequest(sent);
+  if (sent && getResponseFileId(_msg))
+    cache.put(hash, size, last_sent_file_id);
+
+  return sent;
+}
+
 char* UniversalTelegramBot::sendPhoto(const char* chat_id, const char* photo,
                                       const char* caption,
                                       bool disable_notification,
                                       int reply_to_message_id,
                                       const char* keyboard) {
-  DynamicJsonBuffer jsonBuffer;
+  TelegramLaneScope scope(*this, LANE_SEND);
+  JsonBuffer &jsonBuffer = resetJsonBuffer();
   JsonObject &payload = jsonBuffer.createObject();
 
   payload["chat_id"] = chat_id;
@@ -774,11 +2392,10 @@ char* UniversalTelegramBot::sendPhoto(const char* chat_id, const char* photo,
     payload["reply_to_message_id"] = reply_to_message_id;
   }
 
-  if (keyboard) {
+  if (keyboard && (strcmp(keyboard, "") != 0)) {
     JsonObject &replyMarkup = payload.createNestedObject("reply_markup");
 
-    DynamicJsonBuffer keyboardBuffer;
-    replyMarkup["keyboard"] = keyboardBuffer.parseArray(keyboard);
+    replyMarkup["keyboard"] = RawJson(keyboard);
   }
 
   return sendPostPhoto(payload);
@@ -802,22 +2419,25 @@ bool UniversalTelegramBot::checkForOkResponse(char* response) {
 }
 
 bool UniversalTelegramBot::sendChatAction(const char* chat_id, const char* text) {
+  TelegramLaneScope scope(*this, LANE_SEND);
   bool sent = false;
-  if (_debug)
-    Serial.println(F("SEND Chat Action Message"));
+  BOT_DEBUG_PRINTLN(F("SEND Chat Action Message"));
   unsigned long sttime = millis();
+  int attempt = 0;
 
   if (strcmp(text, "") != 0) {
     char command[MAX_CMD_LENGTH]; command[0] = '\0';
     memset(_msg, '\0', MAX_MESSAGE_LENGTH);
     while (millis() < sttime + 8000) { // loop for a while to send the message
+      if (attempt++ > 0)
+        stats.retries++;
       snprintf_P(command, MAX_CMD_LENGTH, "bot%s/sendChatAction?chat_id=%s&action=%s", _token, chat_id, text);
 	  command[MAX_CMD_LENGTH-1] = '\0';
-      strncpy(_msg, sendGetToTelegram(command), MAX_MESSAGE_LENGTH);
+      sendGetToTelegram(command);
       _msg[MAX_MESSAGE_LENGTH-1] = '\0';
-      if (_debug)
-        Serial.println(_msg);
+      BOT_DEBUG_DUMP(_msg);
       sent = checkForOkResponse(_msg);
+      finishRequest(sent);
 
       if (sent) {
         break;
@@ -829,11 +2449,47 @@ bool UniversalTelegramBot::sendChatAction(const char* chat_id, const char* text)
   return sent;
 }
 
+/***************************************************************
+ * With a client pool, every operation runs on a client of its *
+ * lane, taken when the operation starts and given back when   *
+ * it ends. Operations call each other, so only the outermost  *
+ * one takes the client. If none gets free in waitForResponse  *
+ * ms, the operation fails without connecting. Without clients *
+ * for the lane or the send lane, the bot's own client is used.*
+ ***************************************************************/
+void UniversalTelegramBot::setClientPool(TelegramClientPool &pool) {
+  _pool = &pool;
+}
+
+void UniversalTelegramBot::enterLane(TelegramLane lane) {
+  if ((_laneDepth++ > 0) || (_pool == NULL))
+    return;
+
+  _laneClient = _pool->acquire(lane, waitForResponse);
+  if (_laneClient != NULL) {
+    client = _laneClient;
+  } else if (_pool->hasClients(lane)) {
+    BOT_DEBUG_PRINTLN(F("No free client in the pool"));
+    _laneBlocked = true;
+  }
+}
+
+void UniversalTelegramBot::leaveLane() {
+  if (--_laneDepth > 0)
+    return;
+
+  if (_laneClient != NULL)
+    _pool->release(_laneClient);
+  _laneClient = NULL;
+  _laneBlocked = false;
+  client = _ownClient;
+}
+
 void UniversalTelegramBot::closeClient() {
+  if (_laneBlocked)
+    return;
   if (client->connected()) {
-    if (_debug) {
-      Serial.println(F("Closing client"));
-    }
+    BOT_DEBUG_PRINTLN(F("Closing client"));
     client->stop();
   }
 }
@@ -28,7 +28,45 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 #define ARDUINOJSON_ENABLE_ARDUINO_STRING 0 // Disable String objects in ArduinoJson
 #include <ArduinoJson.h>
 
+#include "TelegramStorage.h"
+#include "TelegramKeyboard.h"
+#include "TelegramMessageTemplate.h"
+#include "TelegramInlineCache.h"
+#include "TelegramCrc32.h"
+#include "TelegramInflate.h"
+#include "TelegramClientPool.h"
+#include "TelegramFileCache.h"
+
+// Most updates asked for (and stored in messages[]) per getUpdates. Like the
+// other sizes, set it for the whole build (-DHANDLE_MESSAGES=10).
+#ifndef HANDLE_MESSAGES
 #define HANDLE_MESSAGES 1
+#endif
+
+// Debug output level:
+//   0 - All debug code is compiled out (no Serial usage, no runtime checks)
+//   1 - Status messages, enabled at runtime with bot._debug = true
+//   2 - Also dump full request/response payloads
+// It has to be set for the whole build (i.e. -DTELEGRAM_DEBUG_LEVEL=0 in the
+// PlatformIO build_flags): a #define in the sketch does not reach the library
+// sources, which are compiled on their own.
+#ifndef TELEGRAM_DEBUG_LEVEL
+#define TELEGRAM_DEBUG_LEVEL 1
+#endif
+
+#if TELEGRAM_DEBUG_LEVEL > 0
+#define BOT_DEBUG_PRINT(...) do { if (_debug) Serial.print(__VA_ARGS__); } while (0)
+#define BOT_DEBUG_PRINTLN(...) do { if (_debug) Serial.println(__VA_ARGS__); } while (0)
+#else
+#define BOT_DEBUG_PRINT(...) do { } while (0)
+#define BOT_DEBUG_PRINTLN(...) do { } while (0)
+#endif
+
+#if TELEGRAM_DEBUG_LEVEL > 1
+#define BOT_DEBUG_DUMP(...) do { if (_debug) Serial.println(__VA_ARGS__); } while (0)
+#else
+#define BOT_DEBUG_DUMP(...) do { } while (0)
+#endif
 
 const char HOST[] = "api.telegram.org";
 const uint16_t SSL_PORT = 443;
@@ -41,6 +79,29 @@ const uint16_t MAX_MESSAGE_TEXT_LENGTH = 4097;
 const uint16_t MAX_MESSAGE_LENGTH = TOKEN_LENGTH + MAX_DATE_LENGTH + MAX_MESSAGE_TEXT_LENGTH + 
                                     MAX_ID_LENGTH + MAX_CMD_LENGTH + MAX_USER_NAME_LENGTH + 32;
 
+// Size of the buffer all JSON documents are parsed and built in. It must fit
+// the parsed tree of a getUpdates response, check stats.json_high_water.
+// The buffer is a member of the bot, so like HANDLE_MESSAGES it has to be
+// set for the whole build (-DJSON_BUFFER_SIZE=8192), not in the sketch.
+#ifndef JSON_BUFFER_SIZE
+#define JSON_BUFFER_SIZE 4096
+#endif
+
+const uint8_t MAX_METHOD_LENGTH = 32;
+const uint8_t RECENT_UPDATES_LENGTH = 8;
+const uint8_t BROADCAST_ATTEMPTS = 3;
+const uint32_t DNS_CACHE_TTL = 300; // seconds
+const uint8_t PIPELINE_LONG_POLL = 30; // seconds, prefetch with longPoll 0
+const unsigned long POLL_RETRY_INTERVAL = 1000; // ms, after a failed poll
+const unsigned long POLL_MAX_RETRY_INTERVAL = 60000; // ms
+const uint16_t MAX_FILE_PATH_LENGTH = 256;
+const uint16_t DOWNLOAD_CHUNK_SIZE = 512;
+const uint8_t DOWNLOAD_ATTEMPTS = 3;
+const uint16_t MESSAGE_TEXT_LIMIT = 4096; // Characters of a message text
+// Longest bot names kept by getMe(TelegramStorage&), longer ones are not cached
+const uint8_t CACHED_NAME_LENGTH = 128;
+const uint8_t CACHED_USER_NAME_LENGTH = 33;
+
 typedef bool (*MoreDataAvailable)();
 typedef byte (*GetNextByte)();
 
@@ -52,16 +113,133 @@ struct telegramMessage {
   char from_name[MAX_USER_NAME_LENGTH];
   char date[MAX_DATE_LENGTH];
   char type[MAX_CMD_LENGTH];
+  char query_id[MAX_ID_LENGTH];
+  char file_id[MAX_ID_LENGTH];   // Document, photo (largest size), audio, voice or video
+  char file_name[MAX_USER_NAME_LENGTH];
+  long file_size;
+  long message_id;
   float longitude;
   float latitude;
   int update_id;
 };
 
+// A file ready to be downloaded, see getFile()
+struct telegramFile {
+  char file_id[MAX_ID_LENGTH];
+  char file_path[MAX_FILE_PATH_LENGTH];
+  long file_size;
+};
+
+// Part of a JSON request body, written as is or escaped as string content.
+// Segments written as is can be in flash (PROGMEM).
+struct telegramBodySegment {
+  const char* data;
+  size_t length;
+  bool escape;
+  bool flash;
+};
+
+// Timings (in microseconds) and traffic of a single request to the API.
+// The Client interface does a DNS lookup, TCP connect and TLS handshake in a
+// single connect() call, so those phases are reported together as connect_us,
+// unless a host resolver is set (then the lookup is reported as resolve_us).
+struct telegramRequestStats {
+  char method[MAX_METHOD_LENGTH];
+  uint32_t resolve_us;
+  uint32_t connect_us;
+  uint32_t write_us;
+  uint32_t first_byte_us;
+  uint32_t body_us;
+  uint32_t parse_us;
+  uint32_t bytes_out;
+  uint32_t bytes_in;
+  int http_status;
+  bool connected;
+  bool ok;
+};
+
+// Accumulated counters since the bot was created (or resetStats() called)
+struct telegramStats {
+  uint32_t requests;
+  uint32_t failures;
+  uint32_t bytes_out;
+  uint32_t bytes_in;
+  uint32_t connects;
+  uint32_t reconnects;
+  uint32_t connect_errors;
+  uint32_t connect_us; // Total time spent connecting
+  uint32_t dns_lookups;
+  uint32_t dns_cache_hits;
+  uint32_t timeouts;
+  uint32_t retries;
+  uint32_t rate_limited;
+  uint32_t parse_failures;
+  uint32_t json_high_water; // Most bytes of the JSON buffer used at once
+  uint32_t compressed_in; // Bytes of compressed response bodies received
+  uint32_t inflated_in;   // ... and their length once inflated
+};
+
+// How the bot started: what was restored instead of asked for, and the time
+// from the creation of the bot to the first getUpdates response
+struct telegramStartup {
+  bool identity_cached;     // getMe(cache) answered from the cache
+  bool offset_restored;     // beginOffsetStore() found a saved offset
+  bool warm_connection;     // The first poll used the connection of warmUp()
+  uint32_t warm_up_ms;      // Time warmUp() took to connect
+  uint32_t first_update_ms;
+};
+
+// Outcome of a broadcast to a single chat
+enum BroadcastResult { BROADCAST_SENT, BROADCAST_FAILED, BROADCAST_BLOCKED };
+
+// Outcome of a single attempt of trySendMessage() or tryEditMessageText():
+// sent, refused by Telegram
+// (i.e. chat not found, sending it again will not help), rate limited or a
+// server error (worth another attempt later), or no response at all
+enum SendResult { SEND_OK, SEND_REJECTED, SEND_RETRY, SEND_OFFLINE };
+
+// Outcome of the last sendMessage(). Texts longer than MESSAGE_TEXT_LIMIT
+// are sent as consecutive messages (parts).
+struct telegramSplitMessage {
+  uint16_t parts;
+  uint16_t sent;
+  long first_message_id;
+  long last_message_id;
+};
+
+// Progress of a broadcast
+struct telegramBroadcast {
+  uint32_t processed;
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t blocked;
+  unsigned long elapsed_ms;
+};
+
+typedef const char* (*GetNextChatId)();
+typedef void (*BroadcastCallback)(const char* chat_id, BroadcastResult result,
+                                  const telegramBroadcast &progress);
+
+// Resolve host into address. ttl (seconds) is preset to the configured one,
+// a resolver that knows the TTL of the DNS record can set it.
+typedef bool (*HostResolver)(const char* host, IPAddress &address, uint32_t &ttl);
+// Called before and after the client connects, i.e. to restore and save the
+// TLS session, so reconnections do an abbreviated handshake
+typedef void (*ConnectHook)(Client &client);
+
+// Download progress, total is -1 if not known
+typedef void (*DownloadProgress)(long received, long total);
+
+typedef void (*StatsSink)(const telegramRequestStats &request,
+                          const telegramStats &stats);
+
 class UniversalTelegramBot {
 public:
   UniversalTelegramBot(const char* token, Client &client);
   char* sendGetToTelegram(const char* command);
   char* sendPostToTelegram(const char* command, JsonObject &payload);
+  char* sendPostToTelegram(const char* command, const telegramBodySegment* segments,
+                           uint8_t count);
   char*
   sendMultipartFormDataToTelegram(const char* command, const char* binaryProperyName,
                                   const char* fileName, const char* contentType,
@@ -70,9 +248,33 @@ public:
                                   GetNextByte getNextByteCallback);
 
   bool getMe();
+  bool getMe(TelegramStorage &cache);
+  bool warmUp();
 
   bool sendSimpleMessage(const char* chat_id, const char* text, const char* parse_mode);
   bool sendMessage(const char* chat_id, const char* text, const char* parse_mode = "");
+  bool sendMessage(const char* chat_id, const char* text, const char* parse_mode,
+                   const TelegramKeyboard &keyboard);
+  bool sendMessage(const char* chat_id, const TelegramMessageTemplate &message,
+                   const char* const* values = NULL, uint8_t count = 0);
+  uint32_t broadcast(const char* text, GetNextChatId nextChatId,
+                     const char* parse_mode = "", BroadcastCallback callback = NULL);
+  uint32_t broadcast(const TelegramMessageTemplate &message, GetNextChatId nextChatId,
+                     BroadcastCallback callback = NULL,
+                     const char* const* values = NULL, uint8_t count = 0);
+  // Messages sent one attempt at a time, i.e. from a queue that retries them
+  // later. Between beginBatch() and endBatch() they share a client (of the
+  // send lane) and its connection, endBatch(false) keeps it open.
+  void beginBatch();
+  SendResult trySendMessage(const char* chat_id, const char* text,
+                            const char* parse_mode = "");
+  SendResult tryEditMessageText(const char* chat_id, long message_id, const char* text,
+                                const char* parse_mode = "");
+  void endBatch(bool close = true);
+  // Seconds the last rate limited (429) response asked to wait
+  unsigned long retryAfter();
+  // The last edit was refused because the message already shows that text
+  bool notModified();
   bool sendMessageWithReplyKeyboard(const char* chat_id, const char* text,
                                     const char* parse_mode, const char* keyboard,
                                     bool resize = false, bool oneTime = false,
@@ -82,6 +284,20 @@ public:
 
   bool sendChatAction(const char* chat_id, const char* text);
 
+  bool editMessageText(const char* chat_id, long message_id, const char* text,
+                       const char* parse_mode = "", const char* keyboard = "");
+  bool editMessageText(const char* chat_id, long message_id, const char* text,
+                       const char* parse_mode, const TelegramKeyboard &keyboard);
+  bool editMessageReplyMarkup(const char* chat_id, long message_id,
+                              const char* keyboard = "");
+  bool editMessageReplyMarkup(const char* chat_id, long message_id,
+                              const TelegramKeyboard &keyboard);
+  bool deleteMessage(const char* chat_id, long message_id);
+  bool answerCallbackQuery(const char* query_id, const char* text = "",
+                           bool show_alert = false);
+  bool answerInlineQuery(const char* query_id, const char* results,
+                         uint32_t cache_time = 300, bool is_personal = false);
+
   bool sendPostMessage(JsonObject &payload);
   char* sendPostPhoto(JsonObject &payload);
   char* sendPhotoByBinary(const char* chat_id, const char* contentType, int fileSize,
@@ -90,24 +306,145 @@ public:
   char* sendPhoto(const char* chat_id, const char* photo, const char* caption = "",
                    bool disable_notification = false,
                    int reply_to_message_id = 0, const char* keyboard = "");
+  bool sendPhoto(const char* chat_id, const uint8_t* data, size_t length,
+                 TelegramFileCache &cache, const char* contentType = "image/jpeg");
+  bool sendPhotoByBinary(const char* chat_id, const char* contentType, int fileSize,
+                         MoreDataAvailable moreDataAvailableCallback,
+                         GetNextByte getNextByteCallback,
+                         TelegramFileCache &cache, uint32_t hash);
+
+  bool getFile(const char* file_id, telegramFile &file);
+  bool downloadFile(const char* file_path, Print &out,
+                    DownloadProgress progress = NULL, uint32_t* crc = NULL);
+  bool downloadFile(const char* file_path, Print &out, long &position,
+                    DownloadProgress progress = NULL, uint32_t* crc = NULL);
 
   int getUpdates(long offset);
+  void setPollClient(Client &pollClient);
+  void setClientPool(TelegramClientPool &pool);
+  bool requestUpdates(long offset);
+  int pollUpdates();
+  int parseUpdates(char* response);
+  bool beginOffsetStore(TelegramStorage &storage, unsigned long saveInterval = 0);
+  bool saveOffset(bool force = false);
   bool checkForOkResponse(char* response);
+  void setServer(const char* host, uint16_t port);
+  void setHostResolver(HostResolver resolver, uint32_t ttl = DNS_CACHE_TTL);
+  void setConnectHooks(ConnectHook beforeConnect, ConnectHook afterConnect);
+  void flushDnsCache();
+  void setStatsSink(StatsSink sink);
+  void resetStats();
   telegramMessage messages[HANDLE_MESSAGES]; //
   long last_message_received = 0;
+  long last_sent_message_id = 0;
+  char last_sent_file_id[FILE_CACHE_ID_LENGTH]; // Of the last photo uploaded
   char name[MAX_USER_NAME_LENGTH];
   char userName[MAX_USER_NAME_LENGTH];
   uint16_t longPoll = 0;
   bool _debug = false;
   uint16_t waitForResponse = 1500;
+  uint16_t broadcastInterval = 35; // Telegram allows ~30 messages per second
+  bool compressedResponses = false; // Ask for gzip or deflate encoded responses
+  telegramStats stats;
+  telegramRequestStats lastRequest;
+  telegramSplitMessage lastSplit;
+  telegramStartup startup;
 
 private:
-  // JsonObject * parseUpdates(const char* response);
   char _token[TOKEN_LENGTH];
   char _msg[MAX_MESSAGE_LENGTH];
   Client *client;
+  Client *_ownClient;
+  char _bodyMessageId[16];
+  StaticJsonBuffer<JSON_BUFFER_SIZE> _jsonBuffer;
+  StatsSink _statsSink = NULL;
+  unsigned long _requestStart = 0;
+  bool _requestOpen = false;
+  unsigned long _createdAt = 0;
+  bool _warmedUp = false;
+  bool _firstUpdate = true;
+  bool _compressed = false;
+  bool _chunked = false; // Transfer-Encoding: chunked
+  InflateFormat _encoding = INFLATE_GZIP;
+  const char* _host = HOST;
+  uint16_t _port = SSL_PORT;
+  HostResolver _hostResolver = NULL;
+  ConnectHook _beforeConnect = NULL;
+  ConnectHook _afterConnect = NULL;
+  IPAddress _hostAddress;
+  uint32_t _dnsTtl = DNS_CACHE_TTL;
+  unsigned long _dnsResolvedAt = 0;
+  bool _dnsCached = false;
+  Client *_pollClient = NULL;
+  TelegramClientPool *_pool = NULL;
+  Client *_laneClient = NULL;
+  uint8_t _laneDepth = 0;
+  bool _laneBlocked = false;
+  bool _pollInFlight = false;
+  unsigned long _pollRequested = 0;
+  unsigned long _pollFailedAt = 0;
+  unsigned long _pollRetryDelay = 0;
+  unsigned long _pollStart = 0;
+  telegramRequestStats _pollRequest;
+  TelegramStorage *_offsetStorage = NULL;
+  unsigned long _offsetSaveInterval = 0;
+  unsigned long _offsetSavedAt = 0;
+  long _savedOffset = 0;
+  long _recentUpdates[RECENT_UPDATES_LENGTH];
+  uint8_t _recentUpdatesNext = 0;
+  JsonBuffer &resetJsonBuffer();
+  void updateJsonHighWater();
+  void updatesCommand(char* command, long offset, int timeout);
+  int pollTimeout();
+  void pollBackOff();
+  void recordFirstUpdate();
   bool processResult(JsonObject &result, int messageIndex);
+  bool sendPostCommand(const char* method, JsonObject &payload);
+  bool sendPostCommand(const char* method, JsonObject *payload,
+                       const telegramBodySegment* segments, uint8_t count);
+  bool postCommand(const char* method, JsonObject *payload,
+                   const telegramBodySegment* segments, uint8_t count);
+  bool postAttempt(const char* method, JsonObject *payload,
+                   const telegramBodySegment* segments, uint8_t count);
+  bool sendMessageParts(const char* chat_id, const char* text, const char* parse_mode,
+                        const TelegramKeyboard *keyboard);
+  SendResult tryMessage(const char* method, const char* chat_id, long message_id,
+                        const char* text, const char* parse_mode);
+  char* sendPostToTelegram(const char* command, const telegramBodySegment* segments,
+                           uint8_t count, size_t content_length);
+  size_t bodyLength(const telegramBodySegment* segments, uint8_t count);
+  uint32_t broadcastSegments(telegramBodySegment* body, uint8_t count,
+                             GetNextChatId nextChatId, BroadcastCallback callback);
+  void writePostHeaders(const char* command, size_t content_length);
+  void writeAcceptEncoding();
+  uint8_t messageBodySegments(telegramBodySegment* body, const char* chat_id,
+                              long message_id, const char* text,
+                              const char* parse_mode, uint8_t* text_segment = NULL);
+  long getResponseMessageId(const char* response);
+  bool getResponseFileId(const char* response);
+  bool sendCachedPhoto(const char* chat_id, uint32_t hash, uint32_t size,
+                       TelegramFileCache &cache, const char* contentType,
+                       MoreDataAvailable moreDataAvailableCallback,
+                       GetNextByte getNextByteCallback, const uint8_t* data);
+  char* sendMultipartFormData(const char* command, const char* binaryProperyName,
+                              const char* fileName, const char* contentType,
+                              const char* chat_id, int fileSize,
+                              MoreDataAvailable moreDataAvailableCallback,
+                              GetNextByte getNextByteCallback, const uint8_t* data);
+  bool isRecentUpdate(long update_id);
+  void addRecentUpdate(long update_id);
+  void beginRequest(const char* command);
+  void finishRequest(bool ok);
+  bool connectClient();
+  bool resolveHost(IPAddress &address);
+  bool readHeaders(long &content_length, unsigned long start, unsigned long timeout);
+  int readResponse(bool withHeaders, unsigned long timeout);
+  int readCompressedBody(long content_length, unsigned long timeout);
+  void processFile(JsonObject &message, int messageIndex);
   void closeClient();
+  void enterLane(TelegramLane lane);
+  void leaveLane();
+  friend class TelegramLaneScope;
 };
 
 #endif
@@ -0,0 +1,13 @@
+/*
+   Benchmark of the JSON string codec on the host (x86-64: 8 bytes words)
+
+     bench_codec [iterations scale, default 1.0]
+ */
+
+#include "codec_bench.h"
+
+int main(int argc, char** argv) {
+  double scale = (argc > 1) ? atof(argv[1]) : 1.0;
+
+  return runCodecBenchmark(Serial, scale) ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+/*
+   Benchmark of the inflater on the recorded responses, gzip encoded by
+   zlib at its default level as a server would: size on the wire and
+   inflate time per byte of the response.
+
+     bench_inflate [iterations scale, default 1.0]
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <zlib.h>
+
+#include <vector>
+
+#include "MemoryStream.h"
+#include "corpus.h"
+
+static std::string gzip(const std::string &data) {
+  z_stream stream;
+  std::vector<char> out(compressBound(data.size()) + 32);
+
+  memset(&stream, 0, sizeof(stream));
+  deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  stream.next_in = (Bytef*)data.data();
+  stream.avail_in = data.size();
+  stream.next_out = (Bytef*)out.data();
+  stream.avail_out = out.size();
+  deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  return std::string(out.data(), stream.total_out);
+}
+
+static bool benchInflate(const char* name, unsigned long iterations) {
+  std::string corpus = loadCorpus(name);
+  MemoryStream in(gzip(corpus));
+  std::vector<char> out(corpus.size() + 1);
+  TelegramInflate inflater;
+  long length = 0;
+
+  in.chunk = 1460; // A TCP segment
+  unsigned long start = micros();
+  for (unsigned long i = 0; i < iterations; i++) {
+    in.position = 0;
+    length = inflater.inflate(in, in.data.size(), out.data(), out.size(), INFLATE_GZIP, 1000);
+  }
+  unsigned long elapsed_us = micros() - start;
+
+  if ((length != (long)corpus.size()) || (corpus != out.data())) {
+    printf("%-24s inflated %ld of %zu bytes, not the same\n", name, length, corpus.size());
+    return false;
+  }
+  double per_inflate_us = (double)elapsed_us / iterations;
+  // Responses over MAX_MESSAGE_LENGTH do not fit the bot's buffer (*)
+  printf("%-24s %7zu B %6zu B gz (%5.1f%%) %9.2f us %6.2f ns/B %8.1f MB/s%s\n",
+         name, corpus.size(), in.data.size(), 100.0 * in.data.size() / corpus.size(),
+         per_inflate_us, per_inflate_us * 1000 / corpus.size(), corpus.size() / per_inflate_us,
+         (corpus.size() >= MAX_MESSAGE_LENGTH) ? " *" : "");
+  return true;
+}
+
+int main(int argc, char** argv) {
+  double scale = (argc > 1) ? atof(argv[1]) : 1.0;
+  static const struct {
+    const char* name;
+    unsigned long iterations;
+  } corpora[] = {
+    { "updates_empty.json", 20000 },
+    { "updates_1.json", 20000 },
+    { "updates_10.json", 5000 },
+    { "updates_100.json", 500 },
+    { "updates_max_text.json", 5000 },
+    { "updates_unicode.json", 5000 },
+    { "updates_callback.json", 5000 },
+    { "send_message.json", 20000 },
+  };
+  bool ok = true;
+
+  printf("TelegramInflate %zu bytes, MAX_MESSAGE_LENGTH %u\n",
+         sizeof(TelegramInflate), MAX_MESSAGE_LENGTH);
+  for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++)
+    ok = benchInflate(corpora[i].name, (unsigned long)(corpora[i].iterations * scale) + 1) && ok;
+
+  return ok ? 0 : 1;
+}
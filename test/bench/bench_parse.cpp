@@ -0,0 +1,103 @@
+/*
+   Benchmark of the receive and send paths on the recorded responses:
+   throughput of parseUpdates() per corpus, of sendMessage() against an
+   in-memory server, heap allocations per operation and peak memory.
+
+     bench_parse [iterations scale, default 1.0]
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <sys/resource.h>
+
+#include <new>
+#include <vector>
+
+#include "FakeClient.h"
+#include "corpus.h"
+#include "heap.h"
+
+// Room for a bot, constructed again before every parse so the updates are
+// not taken for replays
+alignas(UniversalTelegramBot) static char botStorage[sizeof(UniversalTelegramBot)];
+
+static void benchParse(const char* name, unsigned long iterations) {
+  std::string corpus = loadCorpus(name);
+  std::vector<char> response(corpus.size() + 1);
+  FakeClient client;
+  int updates = 0;
+  uint32_t json_high_water = 0;
+  unsigned long elapsed_us = 0;
+
+  unsigned long allocations = heap.allocations;
+  for (unsigned long i = 0; i < iterations; i++) {
+    UniversalTelegramBot* bot = new (botStorage) UniversalTelegramBot("123:abc", client);
+    memcpy(response.data(), corpus.c_str(), corpus.size() + 1);
+    unsigned long start = micros();
+    updates = bot->parseUpdates(response.data());
+    elapsed_us += micros() - start;
+    json_high_water = bot->stats.json_high_water;
+    bot->~UniversalTelegramBot();
+  }
+  allocations = heap.allocations - allocations;
+
+  double per_parse_us = (double)elapsed_us / iterations;
+  printf("%-24s %7zu B %4d upd %9.2f us %8.1f MB/s %10.0f upd/s %6.2f alloc %7u json B\n",
+         name, corpus.size(), updates, per_parse_us,
+         corpus.size() / per_parse_us, updates * 1e6 / per_parse_us,
+         (double)allocations / iterations, json_high_water);
+}
+
+// Whole sendMessage(): body built from segments, written to the client,
+// response read and checked
+static void benchSend(unsigned long iterations) {
+  std::string response = httpResponse(loadCorpus("send_message.json"));
+  FakeClient client;
+  UniversalTelegramBot* bot = new (botStorage) UniversalTelegramBot("123:abc", client);
+  unsigned long sent = 0;
+
+  client.handler = [&](const std::string &) { return response; };
+  unsigned long allocations = heap.allocations;
+  unsigned long start = micros();
+  for (unsigned long i = 0; i < iterations; i++) {
+    if (bot->sendMessage("123456789", "Temperature 21.5 C"))
+      sent++;
+    client.requests.clear();
+  }
+  unsigned long elapsed_us = micros() - start;
+  allocations = heap.allocations - allocations;
+
+  double per_send_us = (double)elapsed_us / iterations;
+  printf("%-24s %7u B out %3lu/%lu sent %9.2f us %10.0f msg/s %6.2f alloc\n",
+         "sendMessage", bot->lastRequest.bytes_out, sent, iterations, per_send_us,
+         1e6 / per_send_us, (double)allocations / iterations);
+  bot->~UniversalTelegramBot();
+}
+
+int main(int argc, char** argv) {
+  double scale = (argc > 1) ? atof(argv[1]) : 1.0;
+  static const struct {
+    const char* name;
+    unsigned long iterations;
+  } corpora[] = {
+    { "updates_empty.json", 20000 },
+    { "updates_1.json", 20000 },
+    { "updates_10.json", 5000 },
+    { "updates_100.json", 500 },
+    { "updates_max_text.json", 5000 },
+    { "updates_unicode.json", 5000 },
+    { "updates_callback.json", 5000 },
+  };
+
+  printf("HANDLE_MESSAGES %d, JSON_BUFFER_SIZE %d, bot %zu bytes\n",
+         HANDLE_MESSAGES, JSON_BUFFER_SIZE, sizeof(UniversalTelegramBot));
+  for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++)
+    benchParse(corpora[i].name, (unsigned long)(corpora[i].iterations * scale) + 1);
+  benchSend((unsigned long)(20000 * scale) + 1);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("peak heap %ld B, max RSS %ld KB\n", (long)heap.peak_bytes, usage.ru_maxrss);
+
+  return 0;
+}
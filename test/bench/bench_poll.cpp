@@ -0,0 +1,103 @@
+/*
+   Benchmark of the update pipeline under a slow handler: batches handled
+   per second with getUpdates() (poll, then handle) and with
+   setPollClient() + pollUpdates() (the next poll in flight while the
+   batch is handled), against an in-memory server that answers every
+   request after a round trip of ROUND_TRIP_MS, always with a new update.
+
+     bench_poll [seconds per loop, default 3]
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+
+const unsigned long ROUND_TRIP_MS = 100;
+const unsigned long HANDLER_MS = 80;
+
+// FakeClient whose responses only arrive a round trip after the request
+class SlowClient : public FakeClient {
+public:
+  unsigned long ready = 0;
+
+  SlowClient() {
+    handler = [this](const std::string &request) {
+      ready = millis() + ROUND_TRIP_MS;
+      return updates(request);
+    };
+  }
+  int available() { return (millis() >= ready) ? FakeClient::available() : 0; }
+
+private:
+  // A batch with the update asked for by the offset, without headers for a
+  // bare GET
+  static std::string updates(const std::string &request) {
+    size_t offset = request.find("offset=");
+    long id = (offset == std::string::npos) ? 1 : atol(request.c_str() + offset + 7);
+    if (id <= 0)
+      id = 1;
+    std::string update = std::to_string(id);
+    std::string body = "{\"ok\":true,\"result\":[{\"update_id\":" + update +
+                       ",\"message\":{\"message_id\":" + update +
+                       ",\"from\":{\"id\":42,\"is_bot\":false,\"first_name\":\"Ada\"},"
+                       "\"chat\":{\"id\":42,\"first_name\":\"Ada\",\"type\":\"private\"},"
+                       "\"date\":1700000000,\"text\":\"/status\"}}]}";
+    if (request.find(" HTTP/1.1") == std::string::npos)
+      return body;
+    return httpResponse(body);
+  }
+};
+
+// The handler drives a slow peripheral
+static void handle(UniversalTelegramBot &bot, int count) {
+  (void)bot;
+  (void)count;
+  delay(HANDLER_MS);
+}
+
+static double benchGetUpdates(unsigned long seconds) {
+  SlowClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  unsigned long batches = 0;
+
+  unsigned long start = millis();
+  while (millis() - start < seconds * 1000) {
+    int count = bot.getUpdates(bot.last_message_received + 1);
+    if (count > 0) {
+      handle(bot, count);
+      batches++;
+    }
+  }
+  return batches * 1000.0 / (millis() - start);
+}
+
+static double benchPollUpdates(unsigned long seconds) {
+  SlowClient client;
+  SlowClient pollClient;
+  UniversalTelegramBot bot("123:abc", client);
+  unsigned long batches = 0;
+
+  bot.setPollClient(pollClient);
+  unsigned long start = millis();
+  while (millis() - start < seconds * 1000) {
+    int count = bot.pollUpdates();
+    if (count > 0) {
+      handle(bot, count);
+      batches++;
+    }
+  }
+  return batches * 1000.0 / (millis() - start);
+}
+
+int main(int argc, char** argv) {
+  unsigned long seconds = (argc > 1) ? atol(argv[1]) : 3;
+
+  printf("round trip %lu ms, handler %lu ms per batch\n", ROUND_TRIP_MS, HANDLER_MS);
+  double serial = benchGetUpdates(seconds);
+  printf("%-12s %6.1f batches/s\n", "getUpdates", serial);
+  double pipelined = benchPollUpdates(seconds);
+  printf("%-12s %6.1f batches/s\n", "pollUpdates", pipelined);
+
+  // The round trip is hidden behind the handler
+  return (pipelined > serial) ? 0 : 1;
+}
@@ -0,0 +1,282 @@
+/*
+   Benchmark of the JSON string codec (TelegramStringCodec) against a
+   byte at a time loop, on message texts of 4 KB: plain ASCII, Cyrillic,
+   emoji and text full of quotes and line breaks. Shared by the host
+   benchmark (bench_codec.cpp) and the ESP32 one (esp32/), so both run the
+   same texts and print the same table.
+
+   The word size of the codec is that of the target: 8 bytes on x86-64, 4 on
+   ESP32. The output of both loops is compared, a mismatch fails the run.
+ */
+
+#ifndef codec_bench_h
+#define codec_bench_h
+
+#include <Arduino.h>
+#include <TelegramStringCodec.h>
+
+#define CODEC_BENCH_TEXT_LENGTH 4096
+
+// Escaping, a byte at a time, as ArduinoJson 5 does
+static size_t byteEscape(char* dst, size_t dst_size, const char* src, size_t length) {
+  static const char hex[] = "0123456789abcdef";
+  size_t written = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    char c = src[i];
+    const char* seq = NULL;
+    switch (c) {
+      case '"': seq = "\\\""; break;
+      case '\\': seq = "\\\\"; break;
+      case '\b': seq = "\\b"; break;
+      case '\f': seq = "\\f"; break;
+      case '\n': seq = "\\n"; break;
+      case '\r': seq = "\\r"; break;
+      case '\t': seq = "\\t"; break;
+    }
+    if (seq != NULL) {
+      if (written + 2 >= dst_size)
+        break;
+      dst[written++] = seq[0];
+      dst[written++] = seq[1];
+    } else if ((uint8_t)c < 0x20) {
+      if (written + 6 >= dst_size)
+        break;
+      memcpy(dst + written, "\\u00", 4);
+      dst[written + 4] = hex[(uint8_t)c >> 4];
+      dst[written + 5] = hex[(uint8_t)c & 0x0F];
+      written += 6;
+    } else {
+      if (written + 1 >= dst_size)
+        break;
+      dst[written++] = c;
+    }
+  }
+  dst[written] = '\0';
+
+  return written;
+}
+
+static long byteHex4(const char* s) {
+  long value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = s[i];
+    value <<= 4;
+    if ((c >= '0') && (c <= '9'))
+      value |= c - '0';
+    else if ((c >= 'a') && (c <= 'f'))
+      value |= c - 'a' + 10;
+    else if ((c >= 'A') && (c <= 'F'))
+      value |= c - 'A' + 10;
+    else
+      return -1;
+  }
+  return value;
+}
+
+// Unescaping, a byte at a time. Only takes the well formed input of the
+// benchmark.
+static size_t byteUnescape(char* dst, size_t dst_size, const char* src, size_t length) {
+  size_t written = 0;
+  size_t i = 0;
+
+  while ((i < length) && (written + 4 < dst_size)) {
+    char c = src[i++];
+    if ((c != '\\') || (i >= length)) {
+      dst[written++] = c;
+      continue;
+    }
+    c = src[i++];
+    switch (c) {
+      case 'b': dst[written++] = '\b'; break;
+      case 'f': dst[written++] = '\f'; break;
+      case 'n': dst[written++] = '\n'; break;
+      case 'r': dst[written++] = '\r'; break;
+      case 't': dst[written++] = '\t'; break;
+      case 'u': {
+        long cp = byteHex4(src + i);
+        i += 4;
+        if ((cp >= 0xD800) && (cp <= 0xDBFF)) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (byteHex4(src + i + 2) - 0xDC00);
+          i += 6;
+        }
+        if (cp < 0x80) {
+          dst[written++] = (char)cp;
+        } else if (cp < 0x800) {
+          dst[written++] = (char)(0xC0 | (cp >> 6));
+          dst[written++] = (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+          dst[written++] = (char)(0xE0 | (cp >> 12));
+          dst[written++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+          dst[written++] = (char)(0x80 | (cp & 0x3F));
+        } else {
+          dst[written++] = (char)(0xF0 | (cp >> 18));
+          dst[written++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+          dst[written++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+          dst[written++] = (char)(0x80 | (cp & 0x3F));
+        }
+        break;
+      }
+      default:
+        dst[written++] = c;
+        break;
+    }
+  }
+  dst[written] = '\0';
+
+  return written;
+}
+
+// Fill text with pattern, repeated, up to length bytes (cut on an UTF-8
+// character boundary). text has room for length + 4 bytes.
+static size_t codecBenchText(char* text, size_t length, const char* pattern) {
+  size_t pattern_length = strlen(pattern);
+
+  for (size_t i = 0; i < length + 4; i++)
+    text[i] = pattern[i % pattern_length];
+  length = utf8Truncate(text, length + 4, length);
+  text[length] = '\0';
+
+  return length;
+}
+
+// \uXXXX form of an UTF-8 text, as the Bot API sends it (non ASCII
+// characters escaped, the ones outside the BMP as surrogate pairs)
+static size_t codecBenchEscapeUnicode(char* dst, size_t dst_size, const char* src, size_t length) {
+  static const char hex[] = "0123456789abcdef";
+  size_t written = 0;
+  size_t i = 0;
+
+  while ((i < length) && (written + 13 < dst_size)) {
+    uint8_t c = (uint8_t)src[i];
+    uint32_t cp;
+    if (c < 0x80) {
+      size_t escaped = byteEscape(dst + written, dst_size - written, src + i, 1);
+      written += escaped;
+      i++;
+      continue;
+    } else if (c < 0xE0) {
+      cp = ((c & 0x1F) << 6) | (src[i + 1] & 0x3F);
+      i += 2;
+    } else if (c < 0xF0) {
+      cp = ((c & 0x0F) << 12) | ((src[i + 1] & 0x3F) << 6) | (src[i + 2] & 0x3F);
+      i += 3;
+    } else {
+      cp = ((c & 0x07) << 18) | ((src[i + 1] & 0x3F) << 12) |
+           ((src[i + 2] & 0x3F) << 6) | (src[i + 3] & 0x3F);
+      i += 4;
+    }
+
+    uint32_t units[2];
+    int count = 1;
+    units[0] = cp;
+    if (cp >= 0x10000) {
+      units[0] = 0xD800 + ((cp - 0x10000) >> 10);
+      units[1] = 0xDC00 + ((cp - 0x10000) & 0x3FF);
+      count = 2;
+    }
+    for (int u = 0; u < count; u++) {
+      dst[written++] = '\\';
+      dst[written++] = 'u';
+      for (int shift = 12; shift >= 0; shift -= 4)
+        dst[written++] = hex[(units[u] >> shift) & 0x0F];
+    }
+  }
+  dst[written] = '\0';
+
+  return written;
+}
+
+typedef size_t (*CodecFunction)(char* dst, size_t dst_size, const char* src, size_t length);
+
+// Time iterations calls of f, in microseconds: the best of a few rounds,
+// so a preemption (or a WiFi interrupt on the ESP32) does not count
+static unsigned long codecBenchTime(CodecFunction f, char* dst, size_t dst_size,
+                                    const char* src, size_t length,
+                                    unsigned long iterations) {
+  unsigned long best = (unsigned long)-1;
+
+  for (uint8_t round = 0; round < 5; round++) {
+    unsigned long start = micros();
+    for (unsigned long i = 0; i < iterations; i++) {
+      f(dst, dst_size, src, length);
+      // Keep the compiler from dropping the calls
+      __asm__ __volatile__("" : : "r"(dst) : "memory");
+    }
+    unsigned long elapsed = micros() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+
+  return best;
+}
+
+static bool codecBenchCase(Print &out, const char* name, CodecFunction codec,
+                           CodecFunction bytewise, const char* src, size_t length,
+                           unsigned long iterations) {
+  static char codec_out[CODEC_BENCH_TEXT_LENGTH * 6 + 1];
+  static char byte_out[CODEC_BENCH_TEXT_LENGTH * 6 + 1];
+  char line[128];
+
+  size_t codec_length = codec(codec_out, sizeof(codec_out), src, length);
+  size_t byte_length = bytewise(byte_out, sizeof(byte_out), src, length);
+  bool same = (codec_length == byte_length) && (memcmp(codec_out, byte_out, codec_length) == 0);
+
+  unsigned long codec_us = codecBenchTime(codec, codec_out, sizeof(codec_out), src, length, iterations);
+  unsigned long byte_us = codecBenchTime(bytewise, byte_out, sizeof(byte_out), src, length, iterations);
+  if (codec_us == 0)
+    codec_us = 1;
+  if (byte_us == 0)
+    byte_us = 1;
+
+  snprintf(line, sizeof(line), "%-18s %5u B %8.2f us %8.1f MB/s %8.2f us %8.1f MB/s %5.2fx%s",
+           name, (unsigned)length, (double)codec_us / iterations,
+           (double)length * iterations / codec_us, (double)byte_us / iterations,
+           (double)length * iterations / byte_us, (double)byte_us / codec_us,
+           same ? "" : "  MISMATCH");
+  out.println(line);
+
+  return same;
+}
+
+// Runs every case, iterations scaled by scale. Returns false if the codec
+// and the byte at a time loop disagree on any of them.
+static bool runCodecBenchmark(Print &out, double scale) {
+  static const struct {
+    const char* name;
+    const char* pattern;
+  } texts[] = {
+    { "ascii", "Temperature in the living room is 21.5 C, humidity 40%. " },
+    { "cyrillic", "\xd0\xa2\xd0\xb5\xd0\xbc\xd0\xbf\xd0\xb5\xd1\x80\xd0\xb0\xd1\x82\xd1\x83\xd1\x80\xd0\xb0 21.5 C, "
+                  "\xd0\xb2\xd0\xbb\xd0\xb0\xd0\xb6\xd0\xbd\xd0\xbe\xd1\x81\xd1\x82\xd1\x8c 40%. " },
+    { "emoji", "\xf0\x9f\x8c\xa1 21.5 C \xf0\x9f\x92\xa7 40% \xe2\x9c\x85 " },
+    { "escapes", "<b>\"Door\"</b>\topen\n" },
+  };
+  static char text[CODEC_BENCH_TEXT_LENGTH + 4];
+  static char escaped[CODEC_BENCH_TEXT_LENGTH * 6 + 1];
+  char line[128];
+  unsigned long iterations = (unsigned long)(2000 * scale) + 1;
+  bool same = true;
+
+  snprintf(line, sizeof(line), "codec word %u bits, %lu iterations",
+           (unsigned)(sizeof(size_t) * 8), iterations);
+  out.println(line);
+  out.println("case                  size    codec us    codec     byte us     byte  speedup");
+
+  for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+    size_t length = codecBenchText(text, CODEC_BENCH_TEXT_LENGTH, texts[i].pattern);
+    char name[32];
+
+    snprintf(name, sizeof(name), "escape %s", texts[i].name);
+    same &= codecBenchCase(out, name, jsonEscape, byteEscape, text, length, iterations);
+
+    // As received: non ASCII characters as \uXXXX escapes
+    size_t escaped_length = codecBenchEscapeUnicode(escaped, sizeof(escaped), text, length);
+    snprintf(name, sizeof(name), "unescape %s", texts[i].name);
+    same &= codecBenchCase(out, name, jsonUnescape, byteUnescape, escaped, escaped_length, iterations);
+  }
+
+  return same;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/*
+   ESP32 build of the codec benchmark (4 bytes words), printed to Serial
+   once after boot
+ */
+
+#include "codec_bench.h"
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  // ESP32 at 240 MHz: about a tenth of the host speed
+  bool same = runCodecBenchmark(Serial, 0.1);
+  Serial.println(same ? "OK" : "FAILED");
+}
+
+void loop() {
+}
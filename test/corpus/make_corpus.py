@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Writes the recorded Bot API responses used by the host tests and the
+benchmark. They are laid out the way api.telegram.org sends them: compact,
+non ASCII characters as \\uXXXX escapes (surrogate pairs above the BMP)
+and "/" escaped.
+
+    python3 make_corpus.py [output directory]
+"""
+import json
+import os
+import sys
+
+USER = {"id": 123456789, "is_bot": False, "first_name": "Ada",
+        "last_name": "Lovelace", "username": "ada", "language_code": "en"}
+CHAT = {"id": 123456789, "first_name": "Ada", "last_name": "Lovelace",
+        "username": "ada", "type": "private"}
+BOT = {"id": 987654321, "is_bot": True, "first_name": "Lamp",
+       "username": "lamp_bot"}
+DATE = 1700000000
+FIRST_UPDATE = 500000000
+
+COMMANDS = ["/start", "/status", "/ledon", "/ledoff", "/temp", "/help"]
+UNICODE_TEXTS = [
+    "Привет, как дела? Температура 21°C",
+    "温度は21度です。湿度は45%です。",
+    "Ελληνικά: η θερμοκρασία είναι 21°",
+    "🌡️ 21°C 💧 45% 🔋 87% ✅",
+    "مرحبا، درجة الحرارة ٢١",
+    "👨‍👩‍👧‍👦 family 🏳️‍🌈 flags 🇩🇪🇯🇵",
+]
+
+
+def dump(value):
+    # Telegram escapes "/" too
+    return json.dumps(value, ensure_ascii=True,
+                      separators=(",", ":")).replace("/", "\\/")
+
+
+def message_update(index, text):
+    return {"update_id": FIRST_UPDATE + index,
+            "message": {"message_id": 1000 + index, "from": USER,
+                        "chat": CHAT, "date": DATE + index, "text": text}}
+
+
+def callback_update(index):
+    return {"update_id": FIRST_UPDATE + index,
+            "callback_query": {
+                "id": str(4000000000000000000 + index), "from": USER,
+                "message": {"message_id": 1000 + index, "from": BOT,
+                            "chat": CHAT, "date": DATE + index,
+                            "text": "Lamp control",
+                            "reply_markup": {"inline_keyboard": [[
+                                {"text": "On", "callback_data": "ledon"},
+                                {"text": "Off", "callback_data": "ledoff"}]]}},
+                "chat_instance": "-1234567890123456789",
+                "data": "ledon" if index % 2 == 0 else "ledoff"}}
+
+
+def updates(results):
+    return dump({"ok": True, "result": results})
+
+
+def max_length_text():
+    # 4096 characters, the longest text Telegram delivers
+    line = "2023-11-14 22:13:20 sensor=kitchen temp=21.5 hum=45 ok\n"
+    text = (line * (4096 // len(line) + 1))[:4096]
+    return text
+
+
+def corpora():
+    return {
+        "updates_1.json": updates([message_update(0, "/status")]),
+        "updates_10.json": updates([message_update(i, COMMANDS[i % len(COMMANDS)])
+                                    for i in range(10)]),
+        "updates_100.json": updates([message_update(i, COMMANDS[i % len(COMMANDS)])
+                                     for i in range(100)]),
+        "updates_max_text.json": updates([message_update(0, max_length_text())]),
+        "updates_unicode.json": updates([message_update(i, UNICODE_TEXTS[i % len(UNICODE_TEXTS)])
+                                         for i in range(10)]),
+        "updates_callback.json": updates([callback_update(i) for i in range(10)]),
+        "updates_empty.json": updates([]),
+        "send_message.json": dump({"ok": True, "result": {
+            "message_id": 2000, "from": BOT, "chat": CHAT, "date": DATE,
+            "text": "Temperature 21.5 C"}}),
+        "send_message_error.json": dump({"ok": False, "error_code": 400,
+                                         "description": "Bad Request: chat not found"}),
+    }
+
+
+def main():
+    directory = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    for name, content in corpora().items():
+        with open(os.path.join(directory, name), "w") as f:
+            f.write(content)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,125 @@
+/*
+   Load test of the bot against the mock Bot API (test/mock), over real TCP
+   connections with TelegramPosixClient. It handles every update the server
+   has queued the way an echo bot would: a "typing" chat action and a reply,
+   and a photo every 10th update (3 different ones, so most are file_id
+   hits). Reports the throughput and the latency percentiles per method.
+
+     mock_bot_api.py --scenario NAME --run load_bot {port} {updates}
+
+   Exits with 1 if an update was not handled or a reply not sent.
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramPosixClient.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct operation {
+  const char* name;
+  std::vector<unsigned long> latencies_us;
+  unsigned long failures;
+};
+
+static operation operations[] = {
+  { "getUpdates", {}, 0 },
+  { "sendChatAction", {}, 0 },
+  { "sendMessage", {}, 0 },
+  { "sendPhoto", {}, 0 },
+};
+enum { OP_POLL, OP_ACTION, OP_MESSAGE, OP_PHOTO };
+
+static void record(int op, unsigned long start, bool ok) {
+  operations[op].latencies_us.push_back(micros() - start);
+  if (!ok)
+    operations[op].failures++;
+}
+
+static double percentile(const std::vector<unsigned long> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[index] / 1000.0;
+}
+
+static void report(unsigned long elapsed_ms, unsigned long handled) {
+  unsigned long requests = 0;
+
+  printf("%-16s %6s %6s %9s %9s %9s %9s\n", "method", "calls", "failed",
+         "p50 ms", "p90 ms", "p99 ms", "max ms");
+  for (operation &op : operations) {
+    std::vector<unsigned long> sorted = op.latencies_us;
+    std::sort(sorted.begin(), sorted.end());
+    requests += sorted.size();
+    printf("%-16s %6zu %6lu %9.2f %9.2f %9.2f %9.2f\n", op.name, sorted.size(),
+           op.failures, percentile(sorted, 0.50), percentile(sorted, 0.90),
+           percentile(sorted, 0.99), sorted.empty() ? 0.0 : sorted.back() / 1000.0);
+  }
+  printf("%lu updates in %lu ms: %.1f updates/s, %.1f calls/s\n", handled, elapsed_ms,
+         handled * 1000.0 / elapsed_ms, requests * 1000.0 / elapsed_ms);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: load_bot <port> <updates>\n");
+    return 2;
+  }
+  uint16_t port = (uint16_t)atoi(argv[1]);
+  unsigned long updates = strtoul(argv[2], NULL, 10);
+
+  TelegramPosixClient client;
+  UniversalTelegramBot bot("4711:mock", client);
+  bot.setServer("127.0.0.1", port);
+
+  TelegramFileCache cache;
+  static uint8_t photos[3][2048];
+  for (int p = 0; p < 3; p++)
+    for (size_t i = 0; i < sizeof(photos[p]); i++)
+      photos[p][i] = (uint8_t)(i * 31 + p * 7);
+
+  unsigned long handled = 0;
+  unsigned long start = millis();
+  // The whole run must finish well within the ctest timeout
+  while ((handled < updates) && (millis() - start < 120000)) {
+    unsigned long op_start = micros();
+    int received = bot.getUpdates(bot.last_message_received + 1);
+    record(OP_POLL, op_start, true);
+
+    for (int i = 0; i < received; i++) {
+      telegramMessage &message = bot.messages[i];
+      char reply[64];
+      snprintf(reply, sizeof(reply), "echo %ld", message.update_id);
+
+      op_start = micros();
+      record(OP_ACTION, op_start, bot.sendChatAction(message.chat_id, "typing"));
+      op_start = micros();
+      record(OP_MESSAGE, op_start, bot.sendMessage(message.chat_id, reply));
+      if (message.update_id % 10 == 0) {
+        const uint8_t* photo = photos[(message.update_id / 10) % 3];
+        op_start = micros();
+        record(OP_PHOTO, op_start,
+               bot.sendPhoto(message.chat_id, photo, sizeof(photos[0]), cache));
+      }
+      handled++;
+    }
+  }
+  unsigned long elapsed_ms = millis() - start;
+  if (elapsed_ms == 0)
+    elapsed_ms = 1;
+
+  report(elapsed_ms, handled);
+  printf("bot: %u requests, %u retries, %u timeouts, %u rate limited, %u connects; "
+         "photo cache %u hits, %u misses\n",
+         bot.stats.requests, bot.stats.retries, bot.stats.timeouts, bot.stats.rate_limited,
+         bot.stats.connects, cache.hits, cache.misses);
+
+  bool ok = (handled == updates);
+  for (operation &op : operations)
+    if (&op != &operations[OP_POLL])
+      ok = ok && (op.failures == 0);
+  printf("%s\n", ok ? "OK" : "FAILED");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+   Reconnection cost over TLS, against the mock Bot API run with --tls.
+   Sends the same messages three times, reconnecting for each one (as
+   sendMessage() does), and reports the handshakes and connect times:
+
+     full      no session kept, every connect is a full handshake
+     resumed   the connect hooks save the TLS session and offer it on the
+               next connect, for an abbreviated handshake
+     cached    as resumed, with a host resolver: a single DNS lookup, then
+               the cached address until the TTL expires
+
+     mock_bot_api.py --scenario baseline --tls CERT KEY --run tls_connect {port} COUNT
+
+   Exits with 1 if a message was not sent, a session was not resumed or the
+   address was looked up more than once.
+ */
+
+#include <UniversalTelegramBot.h>
+#include <OpenSSLClient.h>
+
+#include <netdb.h>
+
+#include <algorithm>
+#include <vector>
+
+static OpenSSLClient tls;
+static SSL_SESSION* saved = NULL;
+static unsigned long lookups = 0;
+
+static void restoreSession(Client &) {
+  tls.setSession(saved);
+}
+
+static void saveSession(Client &) {
+  SSL_SESSION* session = tls.session();
+  if (session == NULL)
+    return;
+  if (saved != NULL)
+    SSL_SESSION_free(saved);
+  saved = session;
+}
+
+static bool resolve(const char* host, IPAddress &address, uint32_t &ttl) {
+  struct addrinfo hints;
+  struct addrinfo* addresses;
+
+  lookups++;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(host, NULL, &hints, &addresses) != 0)
+    return false;
+  address = IPAddress(((struct sockaddr_in*)addresses->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(addresses);
+  (void)ttl; // The configured one
+
+  return true;
+}
+
+static double percentile(const std::vector<unsigned long> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[index] / 1000.0;
+}
+
+struct phase {
+  unsigned long sent;
+  unsigned long handshakes;
+  unsigned long resumed;
+};
+
+static phase run(const char* name, UniversalTelegramBot &bot, unsigned long count) {
+  std::vector<unsigned long> connects;
+  uint32_t handshakes = tls.handshakes;
+  uint32_t resumed = tls.resumed;
+  uint32_t handshake_us = tls.handshake_us;
+  phase result = { 0, 0, 0 };
+
+  bot.resetStats();
+  for (unsigned long i = 0; i < count; i++) {
+    char text[32];
+    snprintf(text, sizeof(text), "%s %lu", name, i);
+    if (bot.sendMessage("100000001", text))
+      result.sent++;
+    if (bot.lastRequest.connected)
+      connects.push_back(bot.lastRequest.connect_us);
+  }
+  result.handshakes = tls.handshakes - handshakes;
+  result.resumed = tls.resumed - resumed;
+  handshake_us = tls.handshake_us - handshake_us;
+
+  std::sort(connects.begin(), connects.end());
+  printf("%-8s %5lu %5lu %10lu %7lu %9.2f %9.2f %9.2f %9.2f %5u %5u\n", name,
+         result.sent, result.handshakes, result.handshakes - result.resumed,
+         result.resumed,
+         result.handshakes ? handshake_us / 1000.0 / result.handshakes : 0.0,
+         percentile(connects, 0.50), percentile(connects, 0.90),
+         connects.empty() ? 0.0 : connects.back() / 1000.0,
+         bot.stats.dns_lookups, bot.stats.dns_cache_hits);
+
+  return result;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: tls_connect <port> <count>\n");
+    return 2;
+  }
+  uint16_t port = (uint16_t)atoi(argv[1]);
+  unsigned long count = strtoul(argv[2], NULL, 10);
+
+  UniversalTelegramBot bot("4711:mock", tls);
+  bot.setServer("localhost", port);
+
+  printf("%-8s %5s %5s %10s %7s %9s %9s %9s %9s %5s %5s\n", "phase", "sent",
+         "hands", "full", "resumed", "hs ms", "p50 ms", "p90 ms", "max ms",
+         "dns", "hits");
+  phase full = run("full", bot, count);
+  bot.setConnectHooks(restoreSession, saveSession);
+  phase resumed = run("resumed", bot, count);
+  bot.setHostResolver(resolve, 300);
+  phase cached = run("cached", bot, count);
+
+  // Only the first connect of the resumed phase has no session to offer
+  bool ok = (full.sent == count) && (resumed.sent == count) && (cached.sent == count) &&
+            (full.resumed == 0) && (resumed.resumed + 1 >= resumed.handshakes) &&
+            (cached.resumed == cached.handshakes) && (lookups == 1);
+  printf("%s\n", ok ? "OK" : "FAILED");
+
+  if (saved != NULL)
+    SSL_SESSION_free(saved);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+#!/usr/bin/env python3
+"""Stand-in for the Telegram Bot API, for the host load tests.
+
+Serves getUpdates (with long polls), sendMessage, sendPhoto, sendChatAction
+and getMe over plain TCP (or TLS, with --tls), and replays the faults of a
+scenario from scenarios.json: latency, responses written in small fragments,
+connections dropped before the response, and 429 storms.
+
+  mock_bot_api.py --scenario NAME [--port PORT] [--tls CERT KEY]
+  mock_bot_api.py --scenario NAME --run COMMAND...
+
+With --run, the server listens on a free port, runs COMMAND with {port},
+{updates} and {tls} replaced, prints what it served once the command exits,
+and exits with its status.
+"""
+
+import argparse
+import json
+import os
+import random
+import re
+import socketserver
+import ssl
+import subprocess
+import sys
+import threading
+import time
+import urllib.parse
+
+SCENARIOS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "scenarios.json")
+FIRST_UPDATE = 700000000
+CHATS = 10
+SEND_METHODS = ("sendMessage", "sendPhoto")
+
+
+class BotApi:
+    """State of the fake bot: pending updates, sent messages and counters"""
+
+    def __init__(self, scenario):
+        self.scenario = scenario
+        self.lock = threading.Condition()
+        self.updates = [self.update(FIRST_UPDATE + i) for i in range(scenario.get("updates", 100))]
+        self.message_id = 1
+        self.requests = 0
+        self.send_requests = 0
+        self.counts = {}
+        self.dropped = 0
+        self.rate_limited = 0
+        self.handshakes = 0
+        self.resumed = 0
+        self.random = random.Random(scenario.get("seed", 1))
+
+    @staticmethod
+    def update(update_id):
+        chat = 100000000 + update_id % CHATS
+        return {
+            "update_id": update_id,
+            "message": {
+                "message_id": update_id - FIRST_UPDATE + 1,
+                "from": {"id": chat, "is_bot": False, "first_name": "Load", "username": "load_test"},
+                "chat": {"id": chat, "first_name": "Load", "username": "load_test", "type": "private"},
+                "date": 1700000000,
+                "text": "/echo %d" % update_id,
+            },
+        }
+
+    def count(self, name):
+        self.counts[name] = self.counts.get(name, 0) + 1
+
+    # Fault decisions, in the order of the requests
+
+    def drop(self):
+        """True if this request is dropped without a response"""
+        every = self.scenario.get("disconnect_every", 0)
+        with self.lock:
+            self.requests += 1
+            if every and (self.requests % every == 0):
+                self.dropped += 1
+                return True
+        return False
+
+    def rate_limit(self, method):
+        """retry_after (s) if this send is rate limited, else 0. Each window
+        of `every` sends starts with `burst` 429 responses."""
+        storm = self.scenario.get("rate_limit")
+        if not storm or method not in SEND_METHODS:
+            return 0
+        with self.lock:
+            position = self.send_requests % storm["every"]
+            self.send_requests += 1
+            if position < storm["burst"]:
+                self.rate_limited += 1
+                return storm["retry_after"]
+        return 0
+
+    def latency(self):
+        delay = self.scenario.get("latency_ms", 0)
+        jitter = self.scenario.get("jitter_ms", 0)
+        if jitter:
+            delay += self.random.uniform(0, jitter)
+        if delay:
+            time.sleep(delay / 1000.0)
+
+    # Methods
+
+    def call(self, method, params):
+        self.count(method)
+        if method == "getUpdates":
+            return self.get_updates(params)
+        if method == "getMe":
+            return {"id": 4711, "is_bot": True, "first_name": "Mock", "username": "mock_bot"}
+        if method == "sendChatAction":
+            return True
+        if method in SEND_METHODS:
+            with self.lock:
+                message_id = self.message_id
+                self.message_id += 1
+            result = {
+                "message_id": message_id,
+                "chat": {"id": int(params.get("chat_id", "0")), "type": "private"},
+                "date": int(time.time()),
+            }
+            if method == "sendMessage":
+                result["text"] = params.get("text", "")
+            else:
+                result["photo"] = [
+                    {"file_id": "AgADmockphotosmall%d" % message_id, "file_size": 1000, "width": 90, "height": 90},
+                    {"file_id": "AgADmockphotolarge%d" % message_id, "file_size": 9000, "width": 320, "height": 320},
+                ]
+            return result
+        return None
+
+    def get_updates(self, params):
+        offset = int(params.get("offset", "0"))
+        limit = int(params.get("limit", "100"))
+        timeout = int(params.get("timeout", "0"))
+        deadline = time.time() + timeout
+        with self.lock:
+            # Updates before the offset are confirmed
+            self.updates = [u for u in self.updates if u["update_id"] >= offset]
+            while not self.updates and time.time() < deadline:
+                self.lock.wait(deadline - time.time())
+            return self.updates[:limit]
+
+
+def parse_params(target, headers, body):
+    """Parameters of a request, from its query string and JSON or
+    multipart body"""
+    url = urllib.parse.urlsplit(target)
+    params = dict(urllib.parse.parse_qsl(url.query))
+    content_type = headers.get("content-type", "")
+    if content_type.startswith("application/json") and body:
+        try:
+            params.update({k: str(v) for k, v in json.loads(body.decode("utf-8")).items()})
+        except ValueError:
+            pass
+    elif content_type.startswith("multipart/form-data"):
+        match = re.search(rb'name="chat_id"\r\n\r\n([^\r]*)', body)
+        if match:
+            params["chat_id"] = match.group(1).decode()
+    return url.path, params
+
+
+class Handler(socketserver.StreamRequestHandler):
+    def setup(self):
+        api = self.server.api
+        if self.server.tls:
+            try:
+                self.request = self.server.tls.wrap_socket(self.request, server_side=True)
+            except (ssl.SSLError, OSError):
+                self.request = None
+                return
+            with api.lock:
+                api.handshakes += 1
+                if self.request.session_reused:
+                    api.resumed += 1
+        super().setup()
+
+    def handle(self):
+        if self.request is None:
+            return
+        while self.handle_request():
+            pass
+
+    def finish(self):
+        if self.request is not None:
+            super().finish()
+
+    def handle_request(self):
+        api = self.server.api
+        line = self.rfile.readline(65537)
+        if not line:
+            return False
+        words = line.decode("latin-1").split()
+        if len(words) < 2:
+            return False
+        # The library sends simple GETs as a bare request line (HTTP/0.9):
+        # no headers, the response is the body alone, then the connection
+        # is closed
+        simple = len(words) == 2
+        headers = {}
+        if not simple:
+            while True:
+                header = self.rfile.readline(65537).decode("latin-1")
+                if header in ("\r\n", "\n", ""):
+                    break
+                name, _, value = header.partition(":")
+                headers[name.strip().lower()] = value.strip()
+        length = int(headers.get("content-length", "0"))
+        body = self.rfile.read(length) if length else b""
+
+        if api.drop():
+            return False
+        api.latency()
+
+        path, params = parse_params(words[1], headers, body)
+        match = re.match(r"^/bot[^/]+/(\w+)$", path)
+        method = match.group(1) if match else ""
+        retry_after = api.rate_limit(method)
+        status = 200
+        if retry_after:
+            api.count("429")
+            status = 429
+            reply = {"ok": False, "error_code": 429,
+                     "description": "Too Many Requests: retry after %d" % retry_after,
+                     "parameters": {"retry_after": retry_after}}
+        else:
+            result = api.call(method, params)
+            if result is None:
+                status = 404
+                reply = {"ok": False, "error_code": 404, "description": "Not Found"}
+            else:
+                reply = {"ok": True, "result": result}
+
+        payload = json.dumps(reply, separators=(",", ":")).encode("utf-8")
+        if simple:
+            response = payload
+        else:
+            response = ("HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                        "Content-Length: %d\r\nConnection: keep-alive\r\n\r\n"
+                        % (status, "OK" if status == 200 else "Error", len(payload))).encode() + payload
+        self.send(response)
+        return not simple
+
+    def send(self, response):
+        size = self.server.api.scenario.get("fragment_bytes", 0)
+        delay = self.server.api.scenario.get("fragment_delay_ms", 0) / 1000.0
+        try:
+            if not size:
+                self.wfile.write(response)
+                return
+            for start in range(0, len(response), size):
+                self.wfile.write(response[start:start + size])
+                self.wfile.flush()
+                if delay:
+                    time.sleep(delay)
+        except OSError:
+            pass
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def tls_context(cert, key):
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(cert, key)
+    return context
+
+
+def summary(api, elapsed):
+    counts = ", ".join("%s %d" % item for item in sorted(api.counts.items()))
+    text = "server: %d requests in %.1f s (%s), %d dropped, %d rate limited" % (
+        api.requests, elapsed, counts, api.dropped, api.rate_limited)
+    if api.handshakes:
+        text += ", %d TLS handshakes (%d resumed)" % (api.handshakes, api.resumed)
+    return text
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--scenario", default="baseline")
+    parser.add_argument("--scenarios", default=SCENARIOS)
+    parser.add_argument("--port", type=int, default=0)
+    parser.add_argument("--tls", nargs=2, metavar=("CERT", "KEY"))
+    parser.add_argument("--run", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    with open(args.scenarios) as f:
+        scenarios = json.load(f)
+    if args.scenario not in scenarios:
+        parser.error("unknown scenario %s (%s)" % (args.scenario, ", ".join(sorted(scenarios))))
+    scenario = scenarios[args.scenario]
+
+    server = Server(("127.0.0.1", args.port), Handler)
+    server.api = BotApi(scenario)
+    server.tls = tls_context(*args.tls) if args.tls else None
+    port = server.server_address[1]
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    start = time.time()
+
+    if not args.run:
+        print("mock Bot API (%s) on port %d" % (args.scenario, port), flush=True)
+        try:
+            while True:
+                time.sleep(3600)
+        except KeyboardInterrupt:
+            print(summary(server.api, time.time() - start))
+        return 0
+
+    values = {"port": str(port), "updates": str(scenario.get("updates", 100)),
+              "tls": "1" if args.tls else "0"}
+    command = [re.sub(r"\{(\w+)\}", lambda m: values.get(m.group(1), m.group(0)), a) for a in args.run]
+    print("scenario %s: %s" % (args.scenario, scenario.get("description", "")), flush=True)
+    status = subprocess.call(command)
+    print(summary(server.api, time.time() - start), flush=True)
+    server.shutdown()
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,200 @@
+/*
+   Minimal Arduino core for host builds (see Arduino.h)
+ */
+
+#include "Arduino.h"
+
+#include <chrono>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point startTime =
+    std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+/***************************************************************
+ * Print                                                       *
+ ***************************************************************/
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  while (size-- > 0)
+    written += write(*buffer++);
+  return written;
+}
+
+static size_t printNumber(Print &out, unsigned long value, int base, bool negative) {
+  char buffer[8 * sizeof(long) + 2];
+  char *p = &buffer[sizeof(buffer) - 1];
+
+  *p = '\0';
+  if (base < 2)
+    base = 10;
+  do {
+    int digit = value % base;
+    *--p = (digit < 10) ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  if (negative)
+    *--p = '-';
+
+  return out.write(p);
+}
+
+size_t Print::print(const __FlashStringHelper *str) {
+  return write((const char *)str);
+}
+
+size_t Print::print(const char *str) {
+  return write(str);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base) {
+  return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(long value, int base) {
+  if ((base == 10) && (value < 0))
+    return printNumber(*this, 0UL - (unsigned long)value, 10, true);
+  return printNumber(*this, (unsigned long)value, base, false);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return printNumber(*this, value, base, false);
+}
+
+size_t Print::print(double value, int digits) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return write(buffer);
+}
+
+size_t Print::println() {
+  return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *str) {
+  return print(str) + println();
+}
+
+size_t Print::println(const char *str) {
+  return print(str) + println();
+}
+
+size_t Print::println(char c) {
+  return print(c) + println();
+}
+
+size_t Print::println(unsigned char value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(double value, int digits) {
+  return print(value, digits) + println();
+}
+
+/***************************************************************
+ * Stream                                                      *
+ ***************************************************************/
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  unsigned long start = millis();
+
+  while ((count < length) && (millis() - start < _timeout)) {
+    int c = read();
+    if (c < 0) {
+      yield();
+      continue;
+    }
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+/***************************************************************
+ * Serial                                                      *
+ ***************************************************************/
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+/***************************************************************
+ * IPAddress                                                   *
+ ***************************************************************/
+IPAddress::IPAddress() {
+  memset(_bytes, 0, sizeof(_bytes));
+}
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  _bytes[0] = a;
+  _bytes[1] = b;
+  _bytes[2] = c;
+  _bytes[3] = d;
+}
+
+IPAddress::IPAddress(uint32_t address) {
+  memcpy(_bytes, &address, sizeof(_bytes));
+}
+
+IPAddress::operator uint32_t() const {
+  uint32_t address;
+  memcpy(&address, _bytes, sizeof(address));
+  return address;
+}
+
+bool IPAddress::operator==(const IPAddress &other) const {
+  return memcmp(_bytes, other._bytes, sizeof(_bytes)) == 0;
+}
@@ -0,0 +1,121 @@
+/*
+   In-memory stand-in for a network client: each complete request written
+   to it is passed to a handler, which returns the raw HTTP response the
+   client then reads back. Requests are kept for the checks.
+ */
+
+#ifndef FakeClient_h
+#define FakeClient_h
+
+#include <Client.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+class FakeClient : public Client {
+public:
+  std::function<std::string(const std::string &request)> handler;
+  std::vector<std::string> requests;
+  int connects = 0;
+  bool refuse = false;     // Fail every connect, as if the server was down
+  bool keepAlive = true;   // Else the server closes after each response
+  size_t chunk = 100;      // Most bytes available() reports at once
+
+  int connect(IPAddress, uint16_t) {
+    if (refuse)
+      return 0;
+    _open = true;
+    _request.clear();
+    _response.clear();
+    _position = 0;
+    connects++;
+    return 1;
+  }
+  int connect(const char*, uint16_t) { return connect(IPAddress(), 0); }
+
+  size_t write(uint8_t c) {
+    if (!_open)
+      return 0;
+    _request += (char)c;
+    complete();
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++)
+      if (write(buffer[i]) == 0)
+        return i;
+    return size;
+  }
+  using Print::write;
+
+  int available() {
+    if (_position >= _response.size())
+      return 0;
+    return (int)std::min(_response.size() - _position, chunk);
+  }
+  int read() { return available() ? (uint8_t)_response[_position++] : -1; }
+  int read(uint8_t* buffer, size_t size) {
+    size_t length = std::min((size_t)available(), size);
+    memcpy(buffer, _response.data() + _position, length);
+    _position += length;
+    return (int)length;
+  }
+  int peek() { return available() ? (uint8_t)_response[_position] : -1; }
+  void flush() {}
+  void stop() { _open = false; }
+  uint8_t connected() {
+    if (!keepAlive && !_response.empty() && (_position >= _response.size()))
+      return 0;
+    return _open;
+  }
+  operator bool() { return _open; }
+
+private:
+  std::string _request;
+  std::string _response;
+  size_t _position = 0;
+  bool _open = false;
+
+  // A bare "GET /path" line (no HTTP version) ends with its line break,
+  // other requests after their headers and Content-Length bytes of body
+  void complete() {
+    if ((_request.compare(0, 4, "GET ") == 0) &&
+        (_request.find(" HTTP/1.1") == std::string::npos)) {
+      if ((_request.size() >= 2) && (_request.compare(_request.size() - 2, 2, "\r\n") == 0))
+        respond();
+      return;
+    }
+    size_t end = _request.find("\r\n\r\n");
+    if (end == std::string::npos)
+      return;
+    size_t length = 0;
+    size_t header = _request.find("Content-Length:");
+    if ((header != std::string::npos) && (header < end))
+      length = atol(_request.c_str() + header + strlen("Content-Length:"));
+    if (_request.size() >= end + 4 + length)
+      respond();
+  }
+
+  void respond() {
+    requests.push_back(_request);
+    _request.clear();
+    if (handler)
+      _response += handler(requests.back());
+  }
+};
+
+// Complete HTTP response with a Content-Length
+inline std::string httpResponse(const std::string &body, int status = 200) {
+  return "HTTP/1.1 " + std::to_string(status) + " X\r\nContent-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Body of a request (after the headers)
+inline std::string requestBody(const std::string &request) {
+  size_t end = request.find("\r\n\r\n");
+  return (end == std::string::npos) ? request : request.substr(end + 4);
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+   TelegramStorage in memory, for the state the bot keeps across restarts
+   (file_id cache, identity): a new bot on the same storage is a restart.
+ */
+
+#ifndef MemoryStorage_h
+#define MemoryStorage_h
+
+#include <TelegramStorage.h>
+
+#include <vector>
+
+class MemoryStorage : public TelegramStorage {
+public:
+  std::vector<uint8_t> record;
+  int saves = 0;
+
+  size_t capacity() { return 2048; }
+  bool load(void* data, size_t length) {
+    if (record.size() != length)
+      return false;
+    memcpy(data, record.data(), length);
+    return true;
+  }
+  bool save(const void* data, size_t length) {
+    record.assign((const uint8_t*)data, (const uint8_t*)data + length);
+    saves++;
+    return true;
+  }
+};
+
+#endif
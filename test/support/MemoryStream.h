@@ -0,0 +1,30 @@
+/*
+   Stream over bytes in memory, for what reads a Stream directly (the
+   inflater). At most chunk bytes are available at once, like a network
+   client.
+ */
+
+#ifndef MemoryStream_h
+#define MemoryStream_h
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <string>
+
+class MemoryStream : public Stream {
+public:
+  std::string data;
+  size_t position = 0;
+  size_t chunk = 100;
+
+  explicit MemoryStream(const std::string &bytes = "") : data(bytes) {}
+
+  int available() { return (int)std::min(data.size() - position, chunk); }
+  int read() { return available() ? (uint8_t)data[position++] : -1; }
+  int peek() { return available() ? (uint8_t)data[position] : -1; }
+  size_t write(uint8_t) { return 0; }
+  using Print::write;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+   TLS client over OpenSSL, for the host tests against the mock Bot API
+   with --tls. Like BearSSL on the ESP8266 it speaks TLS 1.2 and lets the
+   application keep the session of a connection (session()) and offer it
+   on the next one (setSession()), for an abbreviated handshake. The
+   certificate of the local stand-in server is not verified.
+ */
+
+#ifndef OpenSSLClient_h
+#define OpenSSLClient_h
+
+#include <Client.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/ssl.h>
+
+#include <string>
+
+class OpenSSLClient : public Client {
+public:
+  uint32_t handshakes = 0;
+  uint32_t resumed = 0;       // Handshakes that resumed the offered session
+  uint32_t handshake_us = 0;  // Total time of the handshakes
+
+  OpenSSLClient() {
+    _context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_max_proto_version(_context, TLS1_2_VERSION);
+    SSL_CTX_set_verify(_context, SSL_VERIFY_NONE, NULL);
+  }
+  ~OpenSSLClient() {
+    stop();
+    setSession(NULL);
+    SSL_CTX_free(_context);
+  }
+
+  // Session of the current connection, NULL if none. The caller owns the
+  // reference (SSL_SESSION_free()).
+  SSL_SESSION* session() {
+    return (_ssl != NULL) ? SSL_get1_session(_ssl) : NULL;
+  }
+  // Session to offer on the next connect, NULL for a full handshake. The
+  // client takes its own reference.
+  void setSession(SSL_SESSION* session) {
+    if (session != NULL)
+      SSL_SESSION_up_ref(session);
+    if (_session != NULL)
+      SSL_SESSION_free(_session);
+    _session = session;
+  }
+
+  int connect(IPAddress ip, uint16_t port) {
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+  }
+
+  int connect(const char* host, uint16_t port) {
+    struct addrinfo hints;
+    struct addrinfo* addresses;
+    char service[8];
+
+    stop();
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+      return 0;
+    for (struct addrinfo* a = addresses; (a != NULL) && (_socket < 0); a = a->ai_next) {
+      _socket = socket(a->ai_family, SOCK_STREAM, 0);
+      if ((_socket >= 0) && (::connect(_socket, a->ai_addr, a->ai_addrlen) != 0)) {
+        ::close(_socket);
+        _socket = -1;
+      }
+    }
+    freeaddrinfo(addresses);
+    if (_socket < 0)
+      return 0;
+    int one = 1;
+    setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    unsigned long start = micros();
+    _ssl = SSL_new(_context);
+    SSL_set_fd(_ssl, _socket);
+    if (_session != NULL)
+      SSL_set_session(_ssl, _session);
+    if (SSL_connect(_ssl) != 1) {
+      stop();
+      return 0;
+    }
+    handshake_us += micros() - start;
+    handshakes++;
+    if (SSL_session_reused(_ssl))
+      resumed++;
+    // Reads never block, like the Arduino clients
+    fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL) | O_NONBLOCK);
+
+    return 1;
+  }
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while ((_ssl != NULL) && (written < size)) {
+      int sent = SSL_write(_ssl, buffer + written, (int)(size - written));
+      if (sent > 0) {
+        written += sent;
+        continue;
+      }
+      int error = SSL_get_error(_ssl, sent);
+      if ((error == SSL_ERROR_WANT_WRITE) || (error == SSL_ERROR_WANT_READ)) {
+        struct pollfd fd = { _socket, (short)((error == SSL_ERROR_WANT_WRITE) ? POLLOUT : POLLIN), 0 };
+        poll(&fd, 1, 100);
+        continue;
+      }
+      close(false);
+    }
+    return written;
+  }
+  using Print::write;
+
+  int available() {
+    fill();
+    return (int)(_received.size() - _position);
+  }
+  int read() {
+    if (available() <= 0)
+      return -1;
+    return (uint8_t)_received[_position++];
+  }
+  int read(uint8_t* buffer, size_t size) {
+    int length = available();
+    if (length <= 0)
+      return -1;
+    if ((size_t)length > size)
+      length = (int)size;
+    memcpy(buffer, _received.data() + _position, length);
+    _position += length;
+    return length;
+  }
+  int peek() { return (available() > 0) ? (uint8_t)_received[_position] : -1; }
+  void flush() {}
+  void stop() {
+    _received.clear();
+    _position = 0;
+    close(true);
+  }
+  uint8_t connected() {
+    return (_ssl != NULL) || (available() > 0);
+  }
+  operator bool() { return _ssl != NULL; }
+
+private:
+  SSL_CTX* _context = NULL;
+  SSL* _ssl = NULL;
+  SSL_SESSION* _session = NULL;
+  int _socket = -1;
+  std::string _received;
+  size_t _position = 0;
+
+  // Decrypt whatever arrived, without blocking
+  void fill() {
+    char buffer[4096];
+
+    if (_position == _received.size()) {
+      _received.clear();
+      _position = 0;
+    }
+    while (_ssl != NULL) {
+      int length = SSL_read(_ssl, buffer, sizeof(buffer));
+      if (length > 0) {
+        _received.append(buffer, length);
+        continue;
+      }
+      int error = SSL_get_error(_ssl, length);
+      if ((error != SSL_ERROR_WANT_READ) && (error != SSL_ERROR_WANT_WRITE))
+        close(error == SSL_ERROR_ZERO_RETURN); // Closed by the server
+      break;
+    }
+  }
+
+  // A clean shutdown keeps the session resumable
+  void close(bool clean) {
+    if (_ssl != NULL) {
+      if (clean)
+        SSL_shutdown(_ssl);
+      SSL_free(_ssl);
+      _ssl = NULL;
+    }
+    if (_socket >= 0) {
+      ::close(_socket);
+      _socket = -1;
+    }
+  }
+};
+
+#endif
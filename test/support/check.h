@@ -0,0 +1,46 @@
+/*
+   Checks for the host tests: a failed CHECK prints where and goes on, the
+   test's exit status is the number of failures (see CHECK_DONE).
+ */
+
+#ifndef check_h
+#define check_h
+
+#include <stdio.h>
+#include <string.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(expected, actual) do { \
+    long long checkExpected = (long long)(expected); \
+    long long checkActual = (long long)(actual); \
+    if (checkExpected != checkActual) { \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+             checkActual, checkExpected); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_STRING(expected, actual) do { \
+    const char* checkExpected = (expected); \
+    const char* checkActual = (actual); \
+    if (strcmp(checkExpected, checkActual) != 0) { \
+      printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, \
+             checkActual, checkExpected); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_DONE() do { \
+    printf("%s\n", checkFailures ? "FAILED" : "OK"); \
+    return checkFailures; \
+  } while (0)
+
+#endif
@@ -0,0 +1,33 @@
+/*
+   Recorded API responses of test/corpus (see make_corpus.py)
+ */
+
+#ifndef corpus_h
+#define corpus_h
+
+#include <stdio.h>
+
+#include <string>
+
+const long CORPUS_FIRST_UPDATE = 500000000;
+
+// Whole file, empty if it can not be read
+inline std::string loadCorpus(const char* name) {
+  std::string path = std::string(CORPUS_DIR) + "/" + name;
+  std::string content;
+  char buffer[4096];
+  size_t length;
+
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    printf("Can not read %s\n", path.c_str());
+    return content;
+  }
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    content.append(buffer, length);
+  fclose(file);
+
+  return content;
+}
+
+#endif
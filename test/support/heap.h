@@ -0,0 +1,60 @@
+/*
+   Counts the heap allocations of the whole program, by replacing the global
+   operator new and delete. Include it in one source file of a program.
+ */
+
+#ifndef heap_h
+#define heap_h
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+struct heapCounters {
+  std::atomic<unsigned long> allocations;
+  std::atomic<long> live_bytes;
+  std::atomic<long> peak_bytes;
+};
+
+static heapCounters heap;
+
+// Each block is prefixed with its size, so delete knows what it frees
+void* operator new(size_t size) {
+  size_t* block = (size_t*)malloc(size + sizeof(max_align_t));
+  if (block == NULL)
+    throw std::bad_alloc();
+  *block = size;
+  heap.allocations++;
+  long live = heap.live_bytes += size;
+  long peak = heap.peak_bytes;
+  while ((live > peak) && !heap.peak_bytes.compare_exchange_weak(peak, live)) {
+  }
+  return (char*)block + sizeof(max_align_t);
+}
+
+void operator delete(void* pointer) noexcept {
+  if (pointer == NULL)
+    return;
+  size_t* block = (size_t*)((char*)pointer - sizeof(max_align_t));
+  heap.live_bytes -= *block;
+  free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept {
+  operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+   broadcast(): a 429 pauses for the retry_after Telegram asks for and
+   resumes with the chat that was refused, a blocked bot and a missing chat
+   are not retried, server errors are, and the callback sees the progress
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <map>
+#include <vector>
+
+#include "FakeClient.h"
+#include "check.h"
+
+static const char* chats[] = { "11", "22", "33", "44", "55", "66" };
+static size_t nextChat = 0;
+
+static const char* nextChatId() {
+  return (nextChat < sizeof(chats) / sizeof(chats[0])) ? chats[nextChat++] : NULL;
+}
+
+static std::vector<BroadcastResult> results;
+static telegramBroadcast progress;
+
+static void callback(const char*, BroadcastResult result, const telegramBroadcast &p) {
+  results.push_back(result);
+  progress = p;
+}
+
+static std::string chatOf(const std::string &request) {
+  std::string body = requestBody(request);
+  size_t start = body.find("\"chat_id\":\"") + 11;
+  return body.substr(start, body.find('"', start) - start);
+}
+
+static std::string refused(int status, const char* extra = "") {
+  return httpResponse("{\"ok\":false,\"error_code\":" + std::to_string(status) +
+                      ",\"description\":\"X\"" + extra + "}", status);
+}
+
+static void testBroadcast() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::map<std::string, int> attempts;
+  std::vector<unsigned long> sentAt;
+
+  client.handler = [&](const std::string &request) {
+    std::string chat = chatOf(request);
+    int attempt = ++attempts[chat];
+    sentAt.push_back(millis());
+    if ((chat == "33") && (attempt == 1))
+      return refused(429, ",\"parameters\":{\"retry_after\":1}");
+    if (chat == "44")
+      return refused(403);
+    if (chat == "55")
+      return refused(400);
+    if ((chat == "66") && (attempt < 3))
+      return refused(502);
+    return httpResponse("{\"ok\":true,\"result\":{\"message_id\":1}}");
+  };
+  bot.broadcastInterval = 0;
+
+  CHECK_EQUAL(4, bot.broadcast("Storm warning", nextChatId, "", callback));
+
+  // 33 again after the 429, and only then the next chats
+  std::vector<std::string> order;
+  for (const std::string &request : client.requests)
+    order.push_back(chatOf(request));
+  CHECK((order == std::vector<std::string>{ "11", "22", "33", "33", "44", "55", "66", "66",
+                                            "66" }));
+  CHECK(sentAt[3] - sentAt[2] >= 1000);
+  CHECK(sentAt[2] - sentAt[0] < 1000);
+
+  CHECK((results == std::vector<BroadcastResult>{ BROADCAST_SENT, BROADCAST_SENT,
+                                                  BROADCAST_SENT, BROADCAST_BLOCKED,
+                                                  BROADCAST_FAILED, BROADCAST_SENT }));
+  CHECK_EQUAL(6, progress.processed);
+  CHECK_EQUAL(4, progress.sent);
+  CHECK_EQUAL(1, progress.blocked);
+  CHECK_EQUAL(1, progress.failed);
+  CHECK(progress.elapsed_ms >= 1000);
+  CHECK_EQUAL(1, bot.stats.rate_limited);
+}
+
+int main() {
+  testBroadcast();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,125 @@
+/*
+   Responses sent with "Transfer-Encoding: chunked", as is and gzip
+   encoded: the body is de-chunked before it is parsed or inflated, and the
+   last chunk is consumed so the connection stays in step for the next
+   request
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+// A getUpdates response with a single update, and the same gzip encoded
+static const char UPDATE[] =
+  "{\"ok\":true,\"result\":[{\"update_id\":500,\"message\":{\"message_id\":7,"
+  "\"from\":{\"id\":42,\"is_bot\":false,\"first_name\":\"Ada\"},\"chat\":{\"id\":42,"
+  "\"first_name\":\"Ada\",\"type\":\"private\"},\"date\":1700000000,\"text\":\"/status "
+  "chunked chunked chunked chunked chunked chunked chunked chunked chunked chunked "
+  "chunked chunked chunked chunked chunked chunked chunked chunked chunked chunked \"}}]}";
+static const char UPDATE_GZIP[] =
+  "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\xcd\x4e\x5b\x0a\xc2\x30"
+  "\x10\xbc\x8a\xcc\x77\xc0\x2a\x4a\x21\x7f\x9e\x43\xa4\xac\x4d\x6a"
+  "\x43\x9f\x64\x37\x45\x29\xb9\xbb\x89\x28\x08\x5e\xc0\xfd\xd9\x9d"
+  "\xd9\x99\x61\x56\x4c\x1d\xb4\xf8\x60\x15\xbc\xe5\xd0\x0b\xf4\x79"
+  "\x45\x98\x0d\x89\xad\x9c\x81\x3e\x16\x85\xc2\x60\x99\xe9\x66\xa1"
+  "\xd7\xcf\xf9\xfa\x95\x0a\x8d\x9f\x86\x4c\x67\x78\xd8\x2b\x38\xae"
+  "\xae\x53\x0a\x69\xa8\xe7\x94\xd9\x38\xcf\x52\x8d\x34\x24\x2f\x4e"
+  "\x86\x10\x15\xea\x96\xe4\xdb\xf2\xa3\x51\x90\xc7\x9c\xc1\xec\xdd"
+  "\x92\x7a\x64\x53\xee\x03\xbd\x2b\x8b\xf7\x24\x8d\xbd\xa7\x18\x6c"
+  "\x59\x48\x02\x6f\xea\x36\x8c\x9d\x35\x7f\xbb\x11\xe3\x25\x3e\x01"
+  "\x82\x02\x74\x1c\x6f\x01\x00\x00";
+
+// body in chunks of size bytes, with a chunk extension on the first one
+// and a trailer after the last
+static std::string chunked(const std::string &body, size_t size, const char* encoding) {
+  std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+  if (encoding != NULL)
+    response += std::string("Content-Encoding: ") + encoding + "\r\n";
+  response += "Transfer-Encoding: chunked\r\n\r\n";
+  for (size_t start = 0; start < body.size(); start += size) {
+    std::string data = body.substr(start, size);
+    char line[32];
+    snprintf(line, sizeof(line), "%zX%s\r\n", data.size(), (start == 0) ? ";name=value" : "");
+    response += line + data + "\r\n";
+  }
+  return response + "0\r\nX-Trailer: 1\r\n\r\n";
+}
+
+static std::string gzipped() {
+  return std::string(UPDATE_GZIP, sizeof(UPDATE_GZIP) - 1);
+}
+
+static void checkUpdate(UniversalTelegramBot &bot) {
+  CHECK_STRING("42", bot.messages[0].chat_id);
+  CHECK(strncmp(bot.messages[0].text, "/status chunked", 15) == 0);
+}
+
+static void testChunkedBody() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string sent = "{\"ok\":true,\"result\":{\"message_id\":12,\"chat\":{\"id\":42}}}";
+
+  bot.compressedResponses = true; // So getUpdates keeps the connection
+  client.chunk = 5;
+  client.handler = [&](const std::string &request) {
+    if (request.find("getUpdates") != std::string::npos)
+      return chunked(UPDATE, 16, NULL);
+    return chunked(sent, 3, NULL);
+  };
+
+  CHECK_EQUAL(1, bot.getUpdates(0));
+  checkUpdate(bot);
+  CHECK(bot.sendMessage("42", "hello"));
+  CHECK_EQUAL(12, bot.lastSplit.last_message_id);
+  // Both over the same connection: nothing of the first response was left
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(2, client.requests.size());
+}
+
+static void testChunkedGzipBody() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string gzip = gzipped();
+
+  bot.compressedResponses = true;
+  client.chunk = 7;
+  client.handler = [&](const std::string &) { return chunked(gzip, 50, "gzip"); };
+
+  CHECK_EQUAL(1, bot.getUpdates(0));
+  checkUpdate(bot);
+  CHECK_EQUAL(gzip.size(), bot.stats.compressed_in);
+  CHECK_EQUAL(strlen(UPDATE), bot.stats.inflated_in);
+  CHECK_EQUAL(chunked(gzip, 50, "gzip").size(), bot.lastRequest.bytes_in);
+
+  // The next poll on the same connection
+  CHECK_EQUAL(0, bot.getUpdates(501));
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(2, client.requests.size());
+}
+
+static void testBrokenFraming() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string gzip = gzipped();
+
+  bot.compressedResponses = true;
+  client.handler = [&](const std::string &) {
+    std::string response = chunked(gzip, 50, "gzip");
+    response[response.find("\r\n\r\n") + 4] = 'x'; // Not a chunk size
+    return response;
+  };
+
+  CHECK_EQUAL(0, bot.getUpdates(0));
+  // Out of step, so not used again
+  bot.getUpdates(0);
+  CHECK_EQUAL(2, client.connects);
+}
+
+int main() {
+  testChunkedBody();
+  testChunkedGzipBody();
+  testBrokenFraming();
+
+  CHECK_DONE();
+}
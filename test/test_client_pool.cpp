@@ -0,0 +1,177 @@
+/*
+   TelegramClientPool shared by several threads, as by the tasks of an
+   ESP32: a client is never handed to two threads at once, the in-flight
+   limits hold, and bots of different threads sharing the pool send through
+   it without losing or repeating a request. Also built with
+   -fsanitize=thread (client_pool_tsan) to catch the data races.
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FakeClient.h"
+#include "check.h"
+
+#define THREADS 8
+#define ROUNDS 200
+
+static const char PHOTO_SENT[] =
+  "{\"ok\":true,\"result\":{\"message_id\":2,\"photo\":"
+  "[{\"file_id\":\"AgADphoto\",\"width\":90,\"height\":90}]}}";
+
+static void testExclusiveClients() {
+  TelegramClientPool pool;
+  FakeClient clients[4];
+  std::atomic<int> users[4];
+  std::atomic<int> overlaps(0);
+  std::atomic<int> rejected(0);
+
+  pool.addClient(LANE_SEND, clients[0]);
+  pool.addClient(LANE_SEND, clients[1]);
+  pool.addClient(LANE_SEND, clients[2]);
+  pool.addClient(LANE_UPLOAD, clients[3]);
+  pool.setLimit(LANE_SEND, 2);
+  for (std::atomic<int> &u : users)
+    u = 0;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t]() {
+      TelegramLane lane = (t % 4 == 0) ? LANE_UPLOAD : LANE_SEND;
+      for (int i = 0; i < ROUNDS; i++) {
+        Client* client = pool.acquire(lane, 5000);
+        if (client == NULL) {
+          rejected++;
+          continue;
+        }
+        int index = (int)((FakeClient*)client - clients);
+        if (++users[index] != 1)
+          overlaps++;
+        std::this_thread::yield();
+        users[index]--;
+        pool.release(client);
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  CHECK_EQUAL(0, overlaps.load());
+  CHECK_EQUAL(0, rejected.load());
+  CHECK_EQUAL(6 * ROUNDS, pool.stats[LANE_SEND].acquired);
+  CHECK_EQUAL(2 * ROUNDS, pool.stats[LANE_UPLOAD].acquired);
+  CHECK(pool.stats[LANE_SEND].peak_in_flight <= 2);
+  CHECK_EQUAL(1, pool.stats[LANE_UPLOAD].peak_in_flight);
+  for (int lane = 0; lane < LANE_COUNT; lane++)
+    CHECK_EQUAL(0, pool.stats[lane].in_flight);
+}
+
+// A lane that gets its own clients while other threads use the pool: its
+// requests go to the send lane until then, and to its clients from then on
+static void testClientsAddedInUse() {
+  TelegramClientPool pool;
+  FakeClient sendClient;
+  FakeClient pollClients[2];
+  std::atomic<bool> added(false);
+  std::atomic<int> wrongLane(0);
+
+  CHECK(!pool.hasClients(LANE_POLL));
+  pool.addClient(LANE_SEND, sendClient);
+  CHECK(pool.hasClients(LANE_POLL));
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < ROUNDS; i++) {
+        bool after = added;
+        if (!pool.hasClients(LANE_POLL))
+          wrongLane++;
+        Client* client = pool.acquire(LANE_POLL, 5000);
+        if ((client == NULL) || (after && (client == &sendClient)))
+          wrongLane++;
+        std::this_thread::yield();
+        pool.release(client);
+      }
+    });
+  }
+  pool.addClient(LANE_POLL, pollClients[0]);
+  pool.addClient(LANE_POLL, pollClients[1]);
+  added = true;
+  for (std::thread &thread : threads)
+    thread.join();
+
+  CHECK_EQUAL(0, wrongLane.load());
+  CHECK_EQUAL(2, pool.stats[LANE_POLL].clients);
+  CHECK_EQUAL(THREADS * ROUNDS,
+              pool.stats[LANE_SEND].acquired + pool.stats[LANE_POLL].acquired);
+  CHECK_EQUAL(0, pool.stats[LANE_SEND].in_flight);
+  CHECK_EQUAL(0, pool.stats[LANE_POLL].in_flight);
+}
+
+static void testBotsSharingPool() {
+  TelegramClientPool pool;
+  FakeClient sendClients[2];
+  FakeClient uploadClient;
+  FakeClient ownClients[THREADS];
+  std::atomic<int> failed(0);
+
+  for (FakeClient &client : sendClients) {
+    client.handler = [](const std::string &request) {
+      std::string body = requestBody(request);
+      if (request.find("sendPhoto") != std::string::npos) // By file_id
+        return httpResponse(PHOTO_SENT);
+      return httpResponse("{\"ok\":true,\"result\":{\"message_id\":1,\"text\":\"" +
+                          body.substr(body.find("\"text\":\"") + 8, 6) + "\"}}");
+    };
+    pool.addClient(LANE_SEND, client);
+  }
+  uploadClient.handler = [](const std::string &) { return httpResponse(PHOTO_SENT); };
+  pool.addClient(LANE_UPLOAD, uploadClient);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&, t]() {
+      UniversalTelegramBot bot("123:abc", ownClients[t]);
+      TelegramFileCache cache;
+      uint8_t photo[512];
+      memset(photo, t, sizeof(photo));
+      bot.setClientPool(pool);
+
+      for (int i = 0; i < ROUNDS / 10; i++) {
+        char text[16];
+        snprintf(text, sizeof(text), "t%02di%02d", t, i);
+        if (!bot.sendMessage("42", text))
+          failed++;
+        if ((t == 0) && !bot.sendPhoto("42", photo, sizeof(photo), cache))
+          failed++;
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  CHECK_EQUAL(0, failed.load());
+  // Every message went once through a client of the send lane
+  std::vector<std::string> texts;
+  for (FakeClient &client : sendClients)
+    for (const std::string &request : client.requests)
+      if (request.find("sendMessage") != std::string::npos)
+        texts.push_back(requestBody(request).substr(requestBody(request).find("\"text\":\"") + 8, 6));
+  std::sort(texts.begin(), texts.end());
+  CHECK_EQUAL(THREADS * ROUNDS / 10, texts.size());
+  CHECK(std::adjacent_find(texts.begin(), texts.end()) == texts.end());
+  CHECK(uploadClient.requests.size() >= 1);
+  for (FakeClient &client : ownClients)
+    CHECK_EQUAL(0, client.requests.size());
+}
+
+int main() {
+  testExclusiveClients();
+  testClientsAddedInUse();
+  testBotsSharingPool();
+
+  CHECK_DONE();
+}
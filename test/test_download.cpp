@@ -0,0 +1,158 @@
+/*
+   downloadFile() streaming a file into a Print: a plain download, a
+   dropped connection resumed with a Range request, a server that ignores
+   the Range, a file that is gone, a chunked body and an output that can
+   not take the data
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+// Output that keeps what is written, up to limit bytes
+class StringPrint : public Print {
+public:
+  std::string data;
+  size_t limit = (size_t)-1;
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) {
+    size_t length = std::min(size, limit - data.size());
+    data.append((const char*)buffer, length);
+    return length;
+  }
+  using Print::write;
+};
+
+static std::string file() {
+  std::string data;
+  for (int i = 0; i < 2000; i++)
+    data += (char)('a' + (i * 7) % 26);
+  return data;
+}
+
+static std::string partial(const std::string &data, size_t start, size_t sent) {
+  return "HTTP/1.1 206 Partial Content\r\nContent-Length: " +
+         std::to_string(data.size() - start) + "\r\n\r\n" + data.substr(start, sent);
+}
+
+static void testDownload() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+  uint32_t crc = 0;
+
+  client.handler = [](const std::string &) { return httpResponse(file()); };
+
+  CHECK(bot.downloadFile("photos/file_1.jpg", out, NULL, &crc));
+  CHECK(out.data == file());
+  CHECK_EQUAL(crc32Update(0, (const uint8_t*)file().data(), file().size()), crc);
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK(client.requests[0].find("GET /file/bot123:abc/photos/file_1.jpg HTTP/1.1\r\n") == 0);
+  CHECK(client.requests[0].find("Range:") == std::string::npos);
+}
+
+static void testResume() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+  long position = 0;
+
+  // The first response is cut after 700 bytes, the server closes
+  client.keepAlive = false;
+  client.handler = [&](const std::string &request) {
+    if (client.requests.size() == 1)
+      return httpResponse(file()).substr(0, httpResponse(file()).size() - 1300);
+    size_t range = request.find("Range: bytes=");
+    size_t start = (range == std::string::npos) ? 0 : atol(request.c_str() + range + 13);
+    return partial(file(), start, file().size() - start);
+  };
+
+  CHECK(bot.downloadFile("photos/file_1.jpg", out, position));
+  CHECK(out.data == file());
+  CHECK_EQUAL(2000, position);
+  CHECK_EQUAL(2, client.requests.size());
+  CHECK(client.requests[1].find("\r\nRange: bytes=700-\r\n") != std::string::npos);
+  CHECK_EQUAL(1, bot.stats.retries);
+}
+
+static void testRangeIgnored() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+  long position = 500; // Already in the file from an earlier download
+
+  client.handler = [](const std::string &) { return httpResponse(file()); };
+
+  CHECK(bot.downloadFile("photos/file_1.jpg", out, position));
+  CHECK(client.requests[0].find("\r\nRange: bytes=500-\r\n") != std::string::npos);
+  // The first 500 bytes of the whole file are skipped
+  CHECK(out.data == file().substr(500));
+  CHECK_EQUAL(2000, position);
+}
+
+static void testGone() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+
+  client.handler = [](const std::string &) { return httpResponse("Not Found", 404); };
+
+  CHECK(!bot.downloadFile("photos/file_1.jpg", out));
+  // Not tried again, the file_path expired
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK_EQUAL(404, bot.lastRequest.http_status);
+  CHECK(out.data.empty());
+}
+
+static void testChunked() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+
+  client.chunk = 7;
+  client.handler = [](const std::string &) {
+    std::string response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+    std::string data = file();
+    for (size_t start = 0; start < data.size(); start += 300) {
+      std::string chunk = data.substr(start, 300);
+      char line[16];
+      snprintf(line, sizeof(line), "%zx\r\n", chunk.size());
+      response += line + chunk + "\r\n";
+    }
+    return response + "0\r\n\r\n";
+  };
+
+  // Done with the last chunk, the server keeps the connection open
+  CHECK(bot.downloadFile("photos/file_1.jpg", out));
+  CHECK(out.data == file());
+  CHECK_EQUAL(1, client.requests.size());
+}
+
+static void testShortWrite() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  StringPrint out;
+  long position = 0;
+
+  out.limit = 1050; // i.e. the file system is full, in the 11th read of 100
+  client.handler = [](const std::string &) { return httpResponse(file()); };
+
+  CHECK(!bot.downloadFile("photos/file_1.jpg", out, position));
+  // Not tried again, and the position is that of the last complete write
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK_EQUAL(1000, position);
+  CHECK(out.data == file().substr(0, out.data.size()));
+}
+
+int main() {
+  testDownload();
+  testResume();
+  testRangeIgnored();
+  testGone();
+  testChunked();
+  testShortWrite();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,121 @@
+/*
+   A button press handled the usual way: the callback query is answered,
+   the message holding the keyboard is edited in place, its keyboard
+   changed or removed, and the message deleted. A refused edit is not
+   sent again.
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+// A press of the "On" button of the message holding the keyboard
+static const char PRESS[] =
+  "{\"ok\":true,\"result\":[{\"update_id\":500000000,\"callback_query\":{"
+  "\"id\":\"4000000000000000000\",\"from\":{\"id\":123456789,\"is_bot\":false,"
+  "\"first_name\":\"Ada\"},\"message\":{\"message_id\":1000,\"from\":{\"id\":987654321,"
+  "\"is_bot\":true,\"first_name\":\"Lamp\"},\"chat\":{\"id\":123456789,"
+  "\"first_name\":\"Ada\",\"type\":\"private\"},\"date\":1700000000,"
+  "\"text\":\"Lamp control\",\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"On\","
+  "\"callback_data\":\"ledon\"}]]}},\"chat_instance\":\"-1234567890123456789\","
+  "\"data\":\"ledon\"}}]}";
+
+static std::string ok(const char* result) {
+  return httpResponse(std::string("{\"ok\":true,\"result\":") + result + "}");
+}
+
+static bool has(const std::string &request, const char* text) {
+  return request.find(text) != std::string::npos;
+}
+
+static void testButtonPress() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  bot.compressedResponses = true; // So getUpdates has headers
+  client.handler = [&](const std::string &request) {
+    if (has(request, "/getUpdates"))
+      return httpResponse(PRESS);
+    if (has(request, "/editMessageText "))
+      return ok("{\"message_id\":1000,\"chat\":{\"id\":123456789},\"text\":\"Lamp is on\"}");
+    return ok("true");
+  };
+
+  CHECK_EQUAL(1, bot.getUpdates(0));
+  CHECK_STRING("callback_query", bot.messages[0].type);
+  CHECK_STRING("4000000000000000000", bot.messages[0].query_id);
+  CHECK_EQUAL(1000, bot.messages[0].message_id);
+  const char* chat_id = bot.messages[0].chat_id;
+  long message_id = bot.messages[0].message_id;
+
+  CHECK(bot.answerCallbackQuery(bot.messages[0].query_id, "Lamp on", true));
+  std::string body = requestBody(client.requests.back());
+  CHECK(has(client.requests.back(), "/answerCallbackQuery "));
+  CHECK(has(body, "\"callback_query_id\":\"4000000000000000000\""));
+  CHECK(has(body, "\"text\":\"Lamp on\""));
+  CHECK(has(body, "\"show_alert\":true"));
+
+  // Without a text, only the id
+  CHECK(bot.answerCallbackQuery(bot.messages[0].query_id));
+  body = requestBody(client.requests.back());
+  CHECK(!has(body, "\"text\""));
+  CHECK(!has(body, "show_alert"));
+
+  bot.last_sent_message_id = 0;
+  CHECK(bot.editMessageText(chat_id, message_id, "Lamp is on", "",
+                            "[[{\"text\":\"Off\",\"callback_data\":\"ledoff\"}]]"));
+  body = requestBody(client.requests.back());
+  CHECK(has(client.requests.back(), "/editMessageText "));
+  CHECK(has(body, "\"chat_id\":\"123456789\""));
+  CHECK(has(body, "\"message_id\":1000"));
+  CHECK(has(body, "\"text\":\"Lamp is on\""));
+  CHECK(has(body, "\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"Off\","
+                  "\"callback_data\":\"ledoff\"}]]}"));
+  CHECK_EQUAL(1000, bot.last_sent_message_id);
+
+  // An empty keyboard removes it
+  CHECK(bot.editMessageReplyMarkup(chat_id, message_id));
+  body = requestBody(client.requests.back());
+  CHECK(has(client.requests.back(), "/editMessageReplyMarkup "));
+  CHECK(has(body, "\"message_id\":1000"));
+  CHECK(!has(body, "reply_markup"));
+
+  CHECK(bot.deleteMessage(chat_id, message_id));
+  body = requestBody(client.requests.back());
+  CHECK(has(client.requests.back(), "/deleteMessage "));
+  CHECK(has(body, "\"chat_id\":\"123456789\""));
+  CHECK(has(body, "\"message_id\":1000"));
+  CHECK_EQUAL(6, client.requests.size());
+}
+
+static void testRefused() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  client.handler = [](const std::string &) {
+    return httpResponse("{\"ok\":false,\"error_code\":400,\"description\":\"Bad Request: "
+                        "message is not modified\"}", 400);
+  };
+
+  CHECK(!bot.editMessageText("42", 1000, "Lamp is on"));
+  CHECK(bot.notModified());
+  CHECK_EQUAL(400, bot.lastRequest.http_status);
+  // Sending it again would not help
+  CHECK_EQUAL(1, client.requests.size());
+
+  client.handler = [](const std::string &) {
+    return httpResponse("{\"ok\":false,\"error_code\":400,\"description\":\"Bad Request: "
+                        "message to delete not found\"}", 400);
+  };
+  CHECK(!bot.deleteMessage("42", 1000));
+  CHECK(!bot.notModified());
+  CHECK_EQUAL(2, client.requests.size());
+}
+
+int main() {
+  testButtonPress();
+  testRefused();
+
+  CHECK_DONE();
+}
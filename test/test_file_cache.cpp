@@ -0,0 +1,112 @@
+/*
+   Photos sent through a TelegramFileCache: the first send uploads, the
+   next ones are a small sendPhoto request with the cached file_id, a
+   rejected file_id uploads again, and the entries survive a restart
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "MemoryStorage.h"
+#include "check.h"
+
+#define PHOTO_SIZE 20000
+#define FILE_ID "AgACAgIAAxkDAAIBZ2VfQ3R1c2VyX3Bob3RvX2xhcmdlX2ZpbGVfaWQ"
+
+static std::string photoSent() {
+  return httpResponse("{\"ok\":true,\"result\":{\"message_id\":5,\"chat\":{\"id\":42},"
+                      "\"photo\":[{\"file_id\":\"AgACsmall\",\"width\":90,\"height\":90},"
+                      "{\"file_id\":\"" FILE_ID "\",\"width\":800,\"height\":600}]}}");
+}
+
+static void photo(uint8_t* data) {
+  for (size_t i = 0; i < PHOTO_SIZE; i++)
+    data[i] = (uint8_t)(i * 7 + (i >> 8));
+}
+
+static void testUploadOnce() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramFileCache cache;
+  static uint8_t data[PHOTO_SIZE];
+
+  photo(data);
+  client.handler = [](const std::string &) { return photoSent(); };
+
+  CHECK(bot.sendPhoto("42", data, sizeof(data), cache));
+  CHECK_EQUAL(1, cache.misses);
+  CHECK_STRING(FILE_ID, bot.last_sent_file_id);
+  CHECK(client.requests[0].find("multipart/form-data") != std::string::npos);
+  CHECK(client.requests[0].size() > PHOTO_SIZE);
+
+  CHECK(bot.sendPhoto("42", data, sizeof(data), cache));
+  CHECK_EQUAL(1, cache.hits);
+  CHECK_EQUAL(PHOTO_SIZE, cache.bytes_saved);
+  CHECK_EQUAL(2, client.requests.size());
+  // The second time just the file_id, as JSON
+  const std::string &hit = client.requests[1];
+  CHECK(hit.compare(0, 27, "POST /bot123:abc/sendPhoto ") == 0);
+  CHECK(requestBody(hit) == "{\"chat_id\":\"42\",\"photo\":\"" FILE_ID "\"}");
+  // Headers and body, with a file_id as long as Telegram's: 1% of the upload
+  CHECK_EQUAL(195, hit.size());
+  CHECK_EQUAL(20494, client.requests[0].size());
+  CHECK_EQUAL(hit.size(), bot.lastRequest.bytes_out);
+}
+
+static void testRejectedFileId() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramFileCache cache;
+  static uint8_t data[PHOTO_SIZE];
+
+  photo(data);
+  cache.put(TelegramFileCache::contentHash(data, sizeof(data)), sizeof(data), "AgACexpired");
+  client.handler = [](const std::string &request) {
+    if (request.find("AgACexpired") != std::string::npos)
+      return httpResponse("{\"ok\":false,\"error_code\":400,"
+                          "\"description\":\"Bad Request: wrong file identifier\"}", 400);
+    return photoSent();
+  };
+
+  CHECK(bot.sendPhoto("42", data, sizeof(data), cache));
+  CHECK_EQUAL(2, client.requests.size());
+  CHECK(client.requests[1].find("multipart/form-data") != std::string::npos);
+  CHECK_STRING(FILE_ID, cache.get(TelegramFileCache::contentHash(data, sizeof(data)),
+                                  sizeof(data)));
+}
+
+static void testRestart() {
+  FakeClient client;
+  MemoryStorage storage;
+  static uint8_t data[PHOTO_SIZE];
+
+  photo(data);
+  client.handler = [](const std::string &) { return photoSent(); };
+  {
+    UniversalTelegramBot bot("123:abc", client);
+    TelegramFileCache cache;
+    CHECK(!cache.begin(storage));
+    CHECK(bot.sendPhoto("42", data, sizeof(data), cache));
+  }
+
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramFileCache cache;
+  CHECK(cache.begin(storage));
+  CHECK(bot.sendPhoto("42", data, sizeof(data), cache));
+  CHECK_EQUAL(1, cache.hits);
+  CHECK(client.requests.back().find(FILE_ID) != std::string::npos);
+
+  // A damaged record is ignored
+  storage.record[storage.record.size() / 2] ^= 0x55;
+  TelegramFileCache damaged;
+  CHECK(!damaged.begin(storage));
+  CHECK(damaged.get(TelegramFileCache::contentHash(data, sizeof(data)), sizeof(data)) == NULL);
+}
+
+int main() {
+  testUploadOnce();
+  testRejectedFileId();
+  testRestart();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,216 @@
+/*
+   TelegramInflate on its own: stored, fixed and dynamic Huffman blocks,
+   raw deflate, zlib and gzip, a corrupt or cut stream and an output that
+   does not fit. Then through the bot: a compressed response that would
+   overflow the response buffer, and padding after the compressed data
+   that must be read for the connection to stay in step.
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "MemoryStream.h"
+#include "check.h"
+
+static const char TEXT[] =
+  "{\"ok\":true,\"result\":[{\"update_id\":500,\"message\":{\"message_id\":7,"
+  "\"from\":{\"id\":42,\"is_bot\":false,\"first_name\":\"Ada\"},"
+  "\"chat\":{\"id\":42,\"first_name\":\"Ada\",\"type\":\"private\"},"
+  "\"date\":1700000000,\"text\":\"inflate inflate inflate\"}},"
+  "{\"update_id\":501,\"message\":{\"message_id\":8,"
+  "\"from\":{\"id\":43,\"is_bot\":false,\"first_name\":\"Bob\"},"
+  "\"chat\":{\"id\":43,\"first_name\":\"Bob\",\"type\":\"private\"},"
+  "\"date\":1700000001,\"text\":\"deflate deflate deflate\"}}]}";
+
+// TEXT compressed by zlib 1.2.13: raw deflate with the fixed codes, raw
+// deflate with dynamic codes, and zlib (dynamic codes)
+static const char FIXED[] =
+  "\xab\x56\xca\xcf\x56\xb2\x2a\x29\x2a\x4d\xd5\x51\x2a\x4a\x2d\x2e"
+  "\xcd\x29\x51\xb2\x8a\xae\x56\x2a\x2d\x48\x49\x2c\x49\x8d\xcf\x4c"
+  "\x51\xb2\x32\x35\x30\xd0\x51\xca\x4d\x2d\x2e\x4e\x4c\x4f\x55\xb2"
+  "\xaa\x86\x31\xc1\x72\xe6\x3a\x4a\x69\x45\xf9\xb9\x20\x61\x10\xd7"
+  "\xc4\x48\x47\x29\xb3\x38\x3e\x29\x1f\x68\x48\x5a\x62\x4e\x31\xd0"
+  "\xcc\xb4\xcc\xa2\xe2\x92\xf8\xbc\xc4\x5c\xa0\x5e\x25\xc7\x94\x44"
+  "\xa5\x5a\x1d\xa5\xe4\x8c\xc4\x12\x64\x2d\x18\x6a\x74\x94\x4a\x2a"
+  "\x0b\x40\x9c\x82\xa2\xcc\x32\xa0\x3b\x40\x9a\x40\xee\x51\xb2\x32"
+  "\x34\x37\x80\x02\xa0\x9a\xd4\x0a\xa0\x31\x4a\x99\x79\x69\x39\x40"
+  "\x39\x05\x34\x5a\xa9\xb6\x56\x07\xcd\x1f\x86\x38\xfd\x61\x81\xe6"
+  "\x0f\x63\xfc\xfe\x70\xca\x4f\xc2\xf0\x87\x31\x16\x35\x44\xf8\xc3"
+  "\x10\xee\x8f\x94\x54\x88\xfb\xd1\x68\xa0\x3f\x62\x6b\x01";
+static const char DYNAMIC[] =
+  "\x8d\x8f\xcd\x0e\xc2\x20\x10\x84\x5f\xc5\xcc\x99\x43\xeb\x4f\x6a"
+  "\xb8\xe9\x6b\x18\xd3\x50\x01\x25\xb6\xa5\x01\x6a\x34\x0d\xef\x2e"
+  "\xf8\x17\x43\xd5\xc8\x65\xd9\xdd\x99\xc9\x7e\x03\xf4\x11\xd4\x99"
+  "\x5e\x10\x18\x61\xfb\xda\x81\x6e\x06\xf4\x1d\x67\x4e\x94\x8a\x83"
+  "\x2e\xb2\x8c\xa0\x11\xd6\xb2\xbd\x00\x1d\x9e\xdf\xdb\xae\x20\x90"
+  "\x46\x37\x71\x1c\xdb\xf9\x94\x40\xd9\xb2\xd2\x21\x44\xb2\xda\x86"
+  "\x4c\xa9\x8c\x75\x65\xcb\x9a\xe0\xc5\x8a\x33\x78\x82\xdd\x81\xb9"
+  "\x77\xcb\x48\x43\xe0\x2e\x5d\x6c\x3a\xa3\x4e\xe1\x8e\x68\x8a\xf7"
+  "\x80\xe6\x45\xf6\x78\x41\x23\xce\x21\x06\xaa\x95\x75\xd8\x4d\x92"
+  "\x0a\xef\x49\xc2\x91\x7f\xe5\x58\x26\x1c\xb3\xdf\x1c\x6b\x5d\x8d"
+  "\x38\x66\x1f\x34\x7f\x70\xe4\x2f\x0e\x2e\xee\xf7\x27\x35\x70\x6c"
+  "\xfd\x15";
+static const char ZLIB[] =
+  "\x78\xda\x8d\x8f\xcd\x0e\xc2\x20\x10\x84\x5f\xc5\xcc\x99\x43\xeb"
+  "\x4f\x6a\xb8\xe9\x6b\x18\xd3\x50\x01\x25\xb6\xa5\x01\x6a\x34\x0d"
+  "\xef\x2e\xf8\x17\x43\xd5\xc8\x65\xd9\xdd\x99\xc9\x7e\x03\xf4\x11"
+  "\xd4\x99\x5e\x10\x18\x61\xfb\xda\x81\x6e\x06\xf4\x1d\x67\x4e\x94"
+  "\x8a\x83\x2e\xb2\x8c\xa0\x11\xd6\xb2\xbd\x00\x1d\x9e\xdf\xdb\xae"
+  "\x20\x90\x46\x37\x71\x1c\xdb\xf9\x94\x40\xd9\xb2\xd2\x21\x44\xb2"
+  "\xda\x86\x4c\xa9\x8c\x75\x65\xcb\x9a\xe0\xc5\x8a\x33\x78\x82\xdd"
+  "\x81\xb9\x77\xcb\x48\x43\xe0\x2e\x5d\x6c\x3a\xa3\x4e\xe1\x8e\x68"
+  "\x8a\xf7\x80\xe6\x45\xf6\x78\x41\x23\xce\x21\x06\xaa\x95\x75\xd8"
+  "\x4d\x92\x0a\xef\x49\xc2\x91\x7f\xe5\x58\x26\x1c\xb3\xdf\x1c\x6b"
+  "\x5d\x8d\x38\x66\x1f\x34\x7f\x70\xe4\x2f\x0e\x2e\xee\xf7\x27\x35"
+  "\x70\x6c\xfd\x15\x98\x51\x87\xfd";
+
+static std::string bytes(const char* data, size_t size) {
+  return std::string(data, size - 1);
+}
+
+// data in raw stored blocks of at most size bytes
+static std::string stored(const std::string &data, size_t size) {
+  std::string deflate;
+  size_t start = 0;
+  do {
+    size_t length = std::min(size, data.size() - start);
+    bool last = (start + length == data.size());
+    deflate += (char)(last ? 1 : 0);
+    deflate += (char)(length & 0xFF);
+    deflate += (char)(length >> 8);
+    deflate += (char)(~length & 0xFF);
+    deflate += (char)((~length >> 8) & 0xFF);
+    deflate += data.substr(start, length);
+    start += length;
+  } while (start < data.size());
+  return deflate;
+}
+
+// data gzip encoded, in stored blocks
+static std::string gzip(const std::string &data) {
+  std::string gz("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+  gz += stored(data, 60000);
+  uint32_t crc = crc32Update(0, data.data(), data.size());
+  uint32_t size = data.size();
+  for (int i = 0; i < 4; i++)
+    gz += (char)(crc >> (8 * i));
+  for (int i = 0; i < 4; i++)
+    gz += (char)(size >> (8 * i));
+  return gz;
+}
+
+// Inflated length of data, the output is left in out
+static long inflate(const std::string &data, InflateFormat format, char* out,
+                    size_t out_size, long in_length = -1) {
+  TelegramInflate inflater;
+  MemoryStream in(data);
+  in.chunk = 7;
+  return inflater.inflate(in, in_length, out, out_size, format, 100);
+}
+
+static void checkInflates(const std::string &data, InflateFormat format) {
+  static char out[1024];
+  CHECK_EQUAL(strlen(TEXT), inflate(data, format, out, sizeof(out)));
+  CHECK_STRING(TEXT, out);
+}
+
+static void testBlocks() {
+  checkInflates(stored(TEXT, 150), INFLATE_RAW);
+  checkInflates(bytes(FIXED, sizeof(FIXED)), INFLATE_RAW);
+  checkInflates(bytes(DYNAMIC, sizeof(DYNAMIC)), INFLATE_RAW);
+}
+
+static void testFormats() {
+  checkInflates(bytes(ZLIB, sizeof(ZLIB)), INFLATE_ZLIB);
+  checkInflates(gzip(TEXT), INFLATE_GZIP);
+  // The HTTP "deflate" encoding: zlib, or raw deflate from servers that get
+  // it wrong
+  checkInflates(bytes(ZLIB, sizeof(ZLIB)), INFLATE_DEFLATE);
+  checkInflates(bytes(DYNAMIC, sizeof(DYNAMIC)), INFLATE_DEFLATE);
+  // Raw deflate is not zlib
+  char out[1024];
+  CHECK_EQUAL(-1, inflate(bytes(DYNAMIC, sizeof(DYNAMIC)), INFLATE_ZLIB, out, sizeof(out)));
+}
+
+static void testCorrupt() {
+  char out[1024];
+  std::string zlib = bytes(ZLIB, sizeof(ZLIB));
+  std::string gz = gzip(TEXT);
+
+  // A flipped bit fails the decoding or the checksum
+  for (size_t i = 2; i < zlib.size(); i += 13) {
+    std::string corrupt = zlib;
+    corrupt[i] ^= 0x10;
+    CHECK_EQUAL(-1, inflate(corrupt, INFLATE_ZLIB, out, sizeof(out)));
+  }
+  gz[40] ^= 0x01;
+  CHECK_EQUAL(-1, inflate(gz, INFLATE_GZIP, out, sizeof(out)));
+  // Block type 3 does not exist
+  CHECK_EQUAL(-1, inflate(std::string(1, '\x07'), INFLATE_RAW, out, sizeof(out)));
+  // Cut short, by the end of the input or the length
+  CHECK_EQUAL(-1, inflate(zlib.substr(0, zlib.size() - 10), INFLATE_ZLIB, out, sizeof(out)));
+  CHECK_EQUAL(-1, inflate(zlib, INFLATE_ZLIB, out, sizeof(out), zlib.size() - 1));
+}
+
+static void testOverflow() {
+  char out[1024];
+
+  // The output and its NUL must fit
+  CHECK_EQUAL(-1, inflate(bytes(DYNAMIC, sizeof(DYNAMIC)), INFLATE_RAW, out, strlen(TEXT)));
+  CHECK_EQUAL(strlen(TEXT), inflate(bytes(DYNAMIC, sizeof(DYNAMIC)), INFLATE_RAW, out,
+                                    strlen(TEXT) + 1));
+  CHECK_EQUAL(-1, inflate(stored(TEXT, 150), INFLATE_RAW, out, 200));
+}
+
+static std::string gzipResponse(const std::string &body, const std::string &padding = "") {
+  std::string gz = gzip(body) + padding;
+  return "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: " +
+         std::to_string(gz.size()) + "\r\n\r\n" + gz;
+}
+
+static void testBotOverflow() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string text(MAX_MESSAGE_LENGTH, 'a');
+  std::string big = "{\"ok\":true,\"result\":[{\"update_id\":1,\"message\":{\"text\":\"" +
+                    text + "\"}}]}";
+
+  bot.compressedResponses = true;
+  client.handler = [&](const std::string &) { return gzipResponse(big); };
+
+  CHECK_EQUAL(0, bot.getUpdates(0));
+  CHECK_EQUAL(0, bot.stats.inflated_in);
+  // The rest of the body is still on the connection, so it is not used again
+  bot.getUpdates(0);
+  CHECK_EQUAL(2, client.connects);
+}
+
+static void testPadding() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  // Left on the connection, the line break would end the next headers
+  std::string padding = "\r\n" + std::string(18, '\0');
+
+  bot.compressedResponses = true;
+  client.chunk = 9;
+  client.handler = [&](const std::string &) { return gzipResponse(TEXT, padding); };
+
+  CHECK_EQUAL(1, bot.getUpdates(0));
+  CHECK_EQUAL(gzipResponse(TEXT, padding).size(), bot.lastRequest.bytes_in);
+  // Nothing of the first response is read as the second
+  CHECK_EQUAL(1, bot.getUpdates(501));
+  CHECK_EQUAL(501, bot.last_message_received);
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(2, client.requests.size());
+}
+
+int main() {
+  testBlocks();
+  testFormats();
+  testCorrupt();
+  testOverflow();
+  testBotOverflow();
+  testPadding();
+
+  CHECK_DONE();
+}
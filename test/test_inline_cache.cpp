@@ -0,0 +1,106 @@
+/*
+   Inline query answers through a TelegramInlineCache: a popular query is
+   answered from the cache, entries expire after the ttl (also the
+   cache_time given to Telegram), and a full cache replaces its oldest
+   entry
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramInlineCache.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+static std::string results(const char* query) {
+  return std::string("[{\"type\":\"article\",\"id\":\"1\",\"title\":\"") + query +
+         "\",\"input_message_content\":{\"message_text\":\"" + query + "\"}}]";
+}
+
+static void testHit() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramInlineCache cache(60);
+  int built = 0;
+
+  client.handler = [](const std::string &) {
+    return httpResponse("{\"ok\":true,\"result\":true}");
+  };
+  for (int i = 0; i < 3; i++) {
+    const char* answer = cache.get("temp");
+    if (answer == NULL) {
+      built++;
+      answer = cache.put("temp", results("temp").c_str());
+    }
+    CHECK(bot.answerInlineQuery("q1", answer, cache.ttl()));
+  }
+
+  CHECK_EQUAL(1, built);
+  CHECK_EQUAL(2, cache.hits);
+  CHECK_EQUAL(1, cache.misses);
+  CHECK(requestBody(client.requests[2]).find("\"results\":" + results("temp")) !=
+        std::string::npos);
+  CHECK(requestBody(client.requests[2]).find("\"cache_time\":60") != std::string::npos);
+}
+
+static void testExpiry() {
+  TelegramInlineCache cache(1);
+
+  cache.put("temp", results("temp").c_str());
+  CHECK(cache.get("temp") != NULL);
+  delay(1050);
+  CHECK(cache.get("temp") == NULL);
+  CHECK_EQUAL(1, cache.hits);
+  CHECK_EQUAL(1, cache.misses);
+
+  // An expired entry is taken before the oldest live one
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+    std::string query = "q" + std::to_string(i);
+    cache.put(query.c_str(), results(query.c_str()).c_str());
+    delay(2);
+  }
+  CHECK(cache.get("q0") != NULL);
+}
+
+static void testEvictionOrder() {
+  TelegramInlineCache cache(60);
+
+  for (int i = 0; i < INLINE_CACHE_ENTRIES; i++) {
+    std::string query = "q" + std::to_string(i);
+    cache.put(query.c_str(), results(query.c_str()).c_str());
+    delay(2);
+  }
+  // A hit does not make an entry younger, stored first is replaced first
+  CHECK(cache.get("q0") != NULL);
+  cache.put("new1", results("new1").c_str());
+  CHECK(cache.get("q0") == NULL);
+  CHECK(cache.get("q1") != NULL);
+  delay(2);
+  cache.put("new2", results("new2").c_str());
+  CHECK(cache.get("q1") == NULL);
+  CHECK(cache.get("new1") != NULL);
+  CHECK(cache.get("new2") != NULL);
+
+  // The same query replaces its own entry
+  delay(2);
+  cache.put("new1", "[]");
+  CHECK_STRING("[]", cache.get("new1"));
+  CHECK(cache.get("new2") != NULL);
+}
+
+static void testTooLong() {
+  TelegramInlineCache cache(60);
+  std::string large(INLINE_CACHE_RESULTS_LENGTH, 'x');
+
+  // Answered with the results as given, not cached
+  CHECK(cache.put("temp", large.c_str()) == large.c_str());
+  CHECK(cache.get("temp") == NULL);
+}
+
+int main() {
+  testHit();
+  testExpiry();
+  testEvictionOrder();
+  testTooLong();
+
+  CHECK_DONE();
+}
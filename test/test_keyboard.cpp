@@ -0,0 +1,47 @@
+/*
+   TelegramKeyboard serialization: buttons of inline and reply keyboards,
+   and URL buttons refused on reply keyboards, where Telegram rejects them
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "check.h"
+
+static std::string markup(const TelegramKeyboard &keyboard) {
+  telegramBodySegment segments[MAX_KEYBOARD_SEGMENTS];
+  std::string json;
+  uint8_t count = keyboard.getSegments(segments);
+  for (uint8_t i = 0; i < count; i++)
+    json.append(segments[i].data, segments[i].length);
+  return json;
+}
+
+static void testInlineKeyboard() {
+  TelegramKeyboard keyboard;
+
+  CHECK(keyboard.addUrlButton("Google", "https://www.google.com"));
+  keyboard.addRow();
+  CHECK(keyboard.addButton("Send", "sent"));
+  std::string json = markup(keyboard);
+  CHECK_STRING("{\"inline_keyboard\":[[{\"text\":\"Google\",\"url\":\"https://www.google.com\"}],"
+               "[{\"text\":\"Send\",\"callback_data\":\"sent\"}]]}",
+               json.c_str());
+}
+
+static void testReplyKeyboard() {
+  TelegramKeyboard keyboard(false);
+
+  CHECK(keyboard.addButton("status"));
+  CHECK(!keyboard.addUrlButton("Google", "https://www.google.com"));
+  keyboard.setResize(true);
+  std::string json = markup(keyboard);
+  CHECK_STRING("{\"keyboard\":[[\"status\"]],\"resize_keyboard\":true}",
+               json.c_str());
+}
+
+int main() {
+  testInlineKeyboard();
+  testReplyKeyboard();
+
+  CHECK_DONE();
+}
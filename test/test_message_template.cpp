@@ -0,0 +1,126 @@
+/*
+   Messages sent from a TelegramMessageTemplate: the body is the same as a
+   message built each time, values are escaped, missing ones are empty, a
+   template that does not fit is not sent, and broadcast() sends it to
+   every chat
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramKeyboard.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+static std::string sent() {
+  return httpResponse("{\"ok\":true,\"result\":{\"message_id\":1}}");
+}
+
+static void testValues() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramMessageTemplate message;
+  const char* values[] = { "21.5", "4\"0" };
+
+  client.handler = [](const std::string &) { return sent(); };
+  CHECK(message.begin("Temperature: {} C\n\"humidity\": {} %", "Markdown", true));
+  CHECK_EQUAL(2, message.placeholders());
+
+  CHECK(bot.sendMessage("42", message, values, 2));
+  std::string body = requestBody(client.requests[0]);
+  CHECK(body == "{\"chat_id\":\"42\",\"parse_mode\":\"Markdown\",\"disable_notification\":true,"
+                "\"text\":\"Temperature: 21.5 C\\n\\\"humidity\\\": 4\\\"0 %\"}");
+  CHECK(client.requests[0].find("Content-Length:" + std::to_string(body.size()) + "\r\n") !=
+        std::string::npos);
+
+  // Missing values are sent empty
+  const char* one[] = { NULL };
+  CHECK(bot.sendMessage("42", message, one, 1));
+  body = requestBody(client.requests[1]);
+  CHECK(body.find("\"text\":\"Temperature:  C\\n\\\"humidity\\\":  %\"}") != std::string::npos);
+}
+
+// The template sends what the plain sendMessage() sends
+static void testSameAsSendMessage() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramMessageTemplate message;
+  const char* values[] = { "on" };
+
+  client.handler = [](const std::string &) { return sent(); };
+  CHECK(message.begin("Lamp is {}"));
+  CHECK(bot.sendMessage("42", message, values, 1));
+  CHECK(bot.sendMessage("42", "Lamp is on"));
+  CHECK(requestBody(client.requests[0]) == requestBody(client.requests[1]));
+}
+
+static void testKeyboard() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramMessageTemplate message;
+  TelegramKeyboard keyboard;
+
+  client.handler = [](const std::string &) { return sent(); };
+  keyboard.addButton("Off", "ledoff");
+  CHECK(message.begin("Lamp is on"));
+  message.setKeyboard(keyboard);
+  CHECK(bot.sendMessage("42", message));
+  CHECK(requestBody(client.requests[0]) ==
+        "{\"chat_id\":\"42\",\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"Off\","
+        "\"callback_data\":\"ledoff\"}]]},\"text\":\"Lamp is on\"}");
+}
+
+static void testTooLong() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramMessageTemplate message;
+  std::string text(MAX_TEMPLATE_LENGTH, 'x');
+
+  client.handler = [](const std::string &) { return sent(); };
+  CHECK(!message.begin(text.c_str()));
+  CHECK(!bot.sendMessage("42", message));
+  CHECK_EQUAL(0, client.requests.size());
+
+  // Placeholders past the last one are sent as text
+  std::string many;
+  for (int i = 0; i <= MAX_TEMPLATE_PLACEHOLDERS; i++)
+    many += "{}";
+  CHECK(message.begin(many.c_str()));
+  CHECK_EQUAL(MAX_TEMPLATE_PLACEHOLDERS, message.placeholders());
+  CHECK(bot.sendMessage("42", message));
+  CHECK(requestBody(client.requests[0]).find("\"text\":\"{}\"}") != std::string::npos);
+}
+
+static const char* chats[] = { "11", "22", "33" };
+static size_t nextChat = 0;
+
+static const char* nextChatId() {
+  return (nextChat < 3) ? chats[nextChat++] : NULL;
+}
+
+static void testBroadcast() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramMessageTemplate message;
+  const char* values[] = { "21.5" };
+
+  client.handler = [](const std::string &) { return sent(); };
+  bot.broadcastInterval = 0;
+  CHECK(message.begin("Temperature: {} C"));
+  CHECK_EQUAL(3, bot.broadcast(message, nextChatId, NULL, values, 1));
+  CHECK_EQUAL(3, client.requests.size());
+  for (size_t i = 0; i < 3; i++)
+    CHECK(requestBody(client.requests[i]) == std::string("{\"chat_id\":\"") + chats[i] +
+                                                 "\",\"text\":\"Temperature: 21.5 C\"}");
+  // On one connection
+  CHECK_EQUAL(1, client.connects);
+}
+
+int main() {
+  testValues();
+  testSameAsSendMessage();
+  testKeyboard();
+  testTooLong();
+  testBroadcast();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,175 @@
+/*
+   TelegramOutbox: a burst of updates to a slot is coalesced into its
+   latest value, edits in place, an edit refused as "message is not
+   modified" or of a deleted message, and the hold after a 429
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramOutbox.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+static std::string sent(long message_id) {
+  return httpResponse("{\"ok\":true,\"result\":{\"message_id\":" +
+                      std::to_string(message_id) + ",\"chat\":{\"id\":42}}}");
+}
+
+static std::string refused(int status, const char* description) {
+  return httpResponse("{\"ok\":false,\"error_code\":" + std::to_string(status) +
+                      ",\"description\":\"" + description + "\"}", status);
+}
+
+static bool has(const std::string &request, const char* text) {
+  return request.find(text) != std::string::npos;
+}
+
+static void testCoalescing() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramOutbox outbox(bot);
+
+  client.handler = [](const std::string &) { return sent(5); };
+  outbox.setInterval(0);
+  CHECK(outbox.post("42", 0, "21.0 C"));
+  CHECK(outbox.post("42", 0, "21.5 C"));
+  CHECK(outbox.post("42", 0, "22.0 C"));
+  CHECK(outbox.post("42", 1, "40 %"));
+  CHECK_EQUAL(4, outbox.stats.posted);
+  CHECK_EQUAL(2, outbox.stats.coalesced);
+  CHECK_EQUAL(2, outbox.pending());
+
+  CHECK_EQUAL(2, outbox.flush());
+  CHECK_EQUAL(2, client.requests.size());
+  CHECK(has(client.requests[0], "/sendMessage "));
+  CHECK(has(client.requests[0], "\"text\":\"22.0 C\""));
+  CHECK(has(client.requests[1], "\"text\":\"40 %\""));
+  CHECK_EQUAL(2, outbox.stats.sent);
+
+  // What the message already shows is not sent again
+  CHECK(outbox.post("42", 0, "22.0 C"));
+  CHECK_EQUAL(0, outbox.pending());
+  CHECK_EQUAL(1, outbox.stats.unchanged);
+}
+
+static void testEditInPlace() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramOutbox outbox(bot);
+
+  client.handler = [](const std::string &) { return sent(5); };
+  outbox.setInterval(0);
+  outbox.post("42", 0, "21.0 C");
+  CHECK(outbox.loop());
+  outbox.post("42", 0, "21.5 C");
+  CHECK(outbox.loop());
+
+  CHECK(has(client.requests[1], "/editMessageText "));
+  CHECK(has(client.requests[1], "\"message_id\":5,\"text\":\"21.5 C\""));
+  CHECK_EQUAL(1, outbox.stats.sent);
+  CHECK_EQUAL(1, outbox.stats.edited);
+}
+
+static void testNotModified() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramOutbox outbox(bot);
+  bool lost = false;
+
+  client.handler = [&](const std::string &request) {
+    if (has(request, "/editMessageText ") && lost)
+      return refused(400, "Bad Request: message is not modified: specified new message "
+                          "content and reply markup are exactly the same");
+    return sent(5);
+  };
+  outbox.setInterval(0);
+  outbox.post("42", 0, "21.0 C");
+  outbox.loop();
+
+  // The edit went through, but its answer was lost: sent again, refused
+  outbox.post("42", 0, "21.5 C");
+  lost = true;
+  CHECK(outbox.loop());
+  CHECK_EQUAL(0, outbox.pending());
+  CHECK_EQUAL(1, outbox.stats.unchanged);
+  CHECK_EQUAL(1, outbox.stats.sent);
+  CHECK_EQUAL(2, client.requests.size());
+
+  // Still the same message
+  lost = false;
+  outbox.post("42", 0, "22.0 C");
+  CHECK(outbox.loop());
+  CHECK(has(client.requests[2], "\"message_id\":5,"));
+}
+
+static void testDeletedMessage() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramOutbox outbox(bot);
+  long message_id = 5;
+
+  client.handler = [&](const std::string &request) {
+    if (has(request, "/editMessageText "))
+      return refused(400, "Bad Request: message to edit not found");
+    return sent(message_id);
+  };
+  outbox.setInterval(0);
+  outbox.post("42", 0, "21.0 C");
+  outbox.loop();
+
+  // A new message, whose message_id is kept for the next edits
+  message_id = 9;
+  outbox.post("42", 0, "21.5 C");
+  CHECK(outbox.loop());
+  CHECK_EQUAL(3, client.requests.size());
+  CHECK(has(client.requests[2], "/sendMessage "));
+  CHECK_EQUAL(2, outbox.stats.sent);
+  outbox.post("42", 0, "22.0 C");
+  outbox.loop();
+  CHECK(has(client.requests[3], "\"message_id\":9,"));
+}
+
+static void testRateLimited() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramOutbox outbox(bot);
+  bool limited = true;
+
+  client.handler = [&](const std::string &) {
+    if (limited)
+      return httpResponse("{\"ok\":false,\"error_code\":429,\"description\":\"Too Many "
+                          "Requests: retry after 1\",\"parameters\":{\"retry_after\":1}}", 429);
+    return sent(5);
+  };
+  outbox.setInterval(0);
+  outbox.post("42", 0, "21.0 C");
+  outbox.post("42", 1, "40 %");
+
+  // A single attempt, then nothing until retry_after is over
+  unsigned long start = millis();
+  CHECK(!outbox.loop());
+  CHECK(millis() - start < 500);
+  CHECK_EQUAL(1, outbox.stats.rate_limited);
+  limited = false;
+  while (millis() - start < 800)
+    CHECK(!outbox.loop());
+  CHECK_EQUAL(0, outbox.flush());
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK_EQUAL(2, outbox.pending());
+
+  while (millis() - start < 1050)
+    delay(10);
+  CHECK_EQUAL(2, outbox.flush());
+  CHECK_EQUAL(3, client.requests.size());
+  CHECK_EQUAL(0, outbox.pending());
+}
+
+int main() {
+  testCoalescing();
+  testEditInPlace();
+  testNotModified();
+  testDeletedMessage();
+  testRateLimited();
+
+  CHECK_DONE();
+}
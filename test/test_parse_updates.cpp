@@ -0,0 +1,136 @@
+/*
+   parseUpdates() against the recorded getUpdates responses, with the
+   default HANDLE_MESSAGES (1) and with whole pages (100)
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "FakeClient.h"
+#include "check.h"
+#include "corpus.h"
+
+// Parsed in a copy, as parseUpdates() modifies the response
+static int parse(UniversalTelegramBot &bot, const char* name) {
+  std::string corpus = loadCorpus(name);
+  std::vector<char> response(corpus.begin(), corpus.end());
+  response.push_back('\0');
+  return bot.parseUpdates(response.data());
+}
+
+static int expected(int updates) {
+  return std::min(updates, HANDLE_MESSAGES);
+}
+
+static void testSingleMessage() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  CHECK_EQUAL(1, parse(bot, "updates_1.json"));
+  CHECK_STRING("message", bot.messages[0].type);
+  CHECK_STRING("/status", bot.messages[0].text);
+  CHECK_STRING("123456789", bot.messages[0].chat_id);
+  CHECK_STRING("1700000000", bot.messages[0].date);
+  CHECK_EQUAL(CORPUS_FIRST_UPDATE, bot.messages[0].update_id);
+  CHECK_EQUAL(CORPUS_FIRST_UPDATE, bot.last_message_received);
+
+  // The same update again (i.e. after a restart) is not handled twice
+  CHECK_EQUAL(0, parse(bot, "updates_1.json"));
+}
+
+// Updates beyond messages[] are left for the next getUpdates
+static void testPages() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  CHECK_EQUAL(expected(10), parse(bot, "updates_10.json"));
+  CHECK_EQUAL(CORPUS_FIRST_UPDATE + expected(10) - 1, bot.last_message_received);
+
+  UniversalTelegramBot page("123:abc", client);
+  CHECK_EQUAL(expected(100), parse(page, "updates_100.json"));
+  CHECK_EQUAL(CORPUS_FIRST_UPDATE + expected(100) - 1, page.last_message_received);
+  CHECK_STRING("/start", page.messages[0].text);
+  if (HANDLE_MESSAGES >= 100)
+    CHECK_STRING("/ledoff", page.messages[99].text);
+}
+
+static void testMaxLengthText() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string line = "2023-11-14 22:13:20 sensor=kitchen temp=21.5 hum=45 ok\n";
+  std::string text;
+  while (text.size() < 4096)
+    text += line;
+  text.resize(4096);
+
+  CHECK_EQUAL(1, parse(bot, "updates_max_text.json"));
+  CHECK_EQUAL(4096, strlen(bot.messages[0].text));
+  CHECK(text == bot.messages[0].text);
+}
+
+// \uXXXX escapes, surrogate pairs included, arrive as UTF-8
+static void testUnicode() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  CHECK_EQUAL(expected(10), parse(bot, "updates_unicode.json"));
+  CHECK_STRING("Привет, как дела? Температура 21°C", bot.messages[0].text);
+  if (HANDLE_MESSAGES >= 6) {
+    CHECK_STRING("温度は21度です。湿度は45%です。", bot.messages[1].text);
+    CHECK_STRING("🌡️ 21°C 💧 45% 🔋 87% ✅", bot.messages[3].text);
+    CHECK_STRING("👨‍👩‍👧‍👦 family 🏳️‍🌈 flags 🇩🇪🇯🇵", bot.messages[5].text);
+  }
+}
+
+static void testCallbackQueries() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  CHECK_EQUAL(expected(10), parse(bot, "updates_callback.json"));
+  CHECK_STRING("callback_query", bot.messages[0].type);
+  CHECK_STRING("4000000000000000000", bot.messages[0].query_id);
+  CHECK_STRING("ledon", bot.messages[0].text);
+  CHECK_STRING("123456789", bot.messages[0].from_id);
+  CHECK_STRING("Ada", bot.messages[0].from_name);
+  CHECK_STRING("123456789", bot.messages[0].chat_id);
+  if (HANDLE_MESSAGES >= 2)
+    CHECK_STRING("ledoff", bot.messages[1].text);
+}
+
+static void testEmptyAndBroken() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  char broken[] = "{\"ok\":true,\"result\":[{\"update_id\":1,";
+
+  CHECK_EQUAL(0, parse(bot, "updates_empty.json"));
+  CHECK_EQUAL(-1, bot.parseUpdates(broken));
+  CHECK_EQUAL(1, bot.stats.parse_failures);
+  CHECK_EQUAL(0, bot.last_message_received);
+}
+
+// Through getUpdates(), the response read from the client
+static void testGetUpdates() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string response = loadCorpus("updates_1.json");
+
+  client.handler = [&](const std::string &) { return response; };
+  CHECK_EQUAL(1, bot.getUpdates(bot.last_message_received + 1));
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK(client.requests[0].find("getUpdates?offset=1&limit=") != std::string::npos);
+  CHECK_STRING("/status", bot.messages[0].text);
+}
+
+int main() {
+  printf("HANDLE_MESSAGES %d\n", HANDLE_MESSAGES);
+  testSingleMessage();
+  testPages();
+  testMaxLengthText();
+  testUnicode();
+  testCallbackQueries();
+  testEmptyAndBroken();
+  testGetUpdates();
+  CHECK_DONE();
+}
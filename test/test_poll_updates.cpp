@@ -0,0 +1,84 @@
+/*
+   Update pipeline (setPollClient() + pollUpdates()): the prefetch is a long
+   poll even with longPoll 0, and errors back off instead of asking again
+   right away
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "check.h"
+#include "corpus.h"
+
+static size_t count(const std::vector<std::string> &requests, const char* text) {
+  size_t n = 0;
+  for (const std::string &request : requests)
+    if (request.find(text) != std::string::npos)
+      n++;
+  return n;
+}
+
+static void testPrefetchIsLongPoll() {
+  FakeClient client;
+  FakeClient pollClient;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string updates = httpResponse(loadCorpus("updates_1.json"));
+
+  pollClient.handler = [&](const std::string &) { return updates; };
+  bot.setPollClient(pollClient);
+  CHECK_EQUAL(0, bot.longPoll);
+
+  CHECK_EQUAL(0, bot.pollUpdates());
+  CHECK_EQUAL(1, bot.pollUpdates());
+  // The next batch is asked for at once, as a long poll
+  CHECK_EQUAL(2, pollClient.requests.size());
+  CHECK_EQUAL(2, count(pollClient.requests, "&timeout=30 "));
+
+  bot.longPoll = 10;
+  bot.pollUpdates();
+  CHECK_EQUAL(1, count(pollClient.requests, "&timeout=10 "));
+  CHECK_EQUAL(0, client.requests.size());
+}
+
+static void testErrorsBackOff() {
+  FakeClient client;
+  FakeClient pollClient;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string unauthorized =
+      httpResponse("{\"ok\":false,\"error_code\":401,\"description\":\"Unauthorized\"}", 401);
+
+  pollClient.handler = [&](const std::string &) { return unauthorized; };
+  bot.setPollClient(pollClient);
+
+  CHECK_EQUAL(0, bot.pollUpdates());
+  CHECK_EQUAL(0, bot.pollUpdates()); // Reads the 401
+  for (int i = 0; i < 100; i++)
+    bot.pollUpdates();
+  CHECK_EQUAL(1, pollClient.requests.size());
+
+  // Asked again once the first interval is over, then twice as long
+  delay(POLL_RETRY_INTERVAL + 100);
+  bot.pollUpdates();
+  CHECK_EQUAL(2, pollClient.requests.size());
+  bot.pollUpdates();
+  delay(POLL_RETRY_INTERVAL + 100);
+  bot.pollUpdates();
+  CHECK_EQUAL(2, pollClient.requests.size());
+
+  // So does a server that cannot be reached
+  FakeClient downClient;
+  UniversalTelegramBot down("123:abc", client);
+  downClient.refuse = true;
+  down.setPollClient(downClient);
+  for (int i = 0; i < 100; i++)
+    down.pollUpdates();
+  CHECK_EQUAL(0, downClient.connects);
+  CHECK_EQUAL(1, down.stats.requests);
+}
+
+int main() {
+  testPrefetchIsLongPoll();
+  testErrorsBackOff();
+
+  CHECK_DONE();
+}
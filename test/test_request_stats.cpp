@@ -0,0 +1,113 @@
+/*
+   Per request statistics (lastRequest, and the sink given each request):
+   bytes and times of a request that was answered, of one that got no
+   answer and of one whose headers were cut short
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+const unsigned long LATENCY_MS = 20;
+
+// FakeClient whose responses arrive LATENCY_MS after the request
+class SlowClient : public FakeClient {
+public:
+  unsigned long ready = 0;
+
+  int available() { return (millis() >= ready) ? FakeClient::available() : 0; }
+};
+
+static int reported = 0;
+static telegramRequestStats last;
+
+static void sink(const telegramRequestStats &request, const telegramStats &) {
+  reported++;
+  last = request;
+}
+
+static void testAnswered() {
+  SlowClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string response = httpResponse("{\"ok\":true,\"result\":{\"message_id\":3}}");
+
+  reported = 0;
+  bot.setStatsSink(sink);
+  client.handler = [&](const std::string &) {
+    client.ready = millis() + LATENCY_MS;
+    return response;
+  };
+
+  CHECK(bot.sendMessage("42", "hello"));
+  CHECK_STRING("sendMessage", bot.lastRequest.method);
+  CHECK(bot.lastRequest.ok);
+  CHECK(bot.lastRequest.connected);
+  CHECK_EQUAL(200, bot.lastRequest.http_status);
+  CHECK_EQUAL(client.requests[0].size(), bot.lastRequest.bytes_out);
+  CHECK_EQUAL(response.size(), bot.lastRequest.bytes_in);
+  CHECK(bot.lastRequest.first_byte_us >= (LATENCY_MS - 1) * 1000); // millis() steps
+  CHECK(bot.lastRequest.body_us >= bot.lastRequest.first_byte_us);
+  CHECK(bot.lastRequest.write_us < LATENCY_MS * 1000);
+  CHECK_EQUAL(1, reported);
+  CHECK_EQUAL(bot.lastRequest.bytes_in, last.bytes_in);
+  CHECK_EQUAL(1, bot.stats.requests);
+  CHECK_EQUAL(0, bot.stats.failures);
+  CHECK_EQUAL(response.size(), bot.stats.bytes_in);
+}
+
+static void testNoAnswer() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  reported = 0;
+  bot.setStatsSink(sink);
+  bot.waitForResponse = 100;
+  client.handler = [](const std::string &) { return std::string(); };
+
+  unsigned long start = millis();
+  CHECK_EQUAL(SEND_OFFLINE, bot.trySendMessage("42", "hello"));
+  CHECK(millis() - start >= 100);
+  CHECK_STRING("sendMessage", bot.lastRequest.method);
+  CHECK(!bot.lastRequest.ok);
+  CHECK_EQUAL(0, bot.lastRequest.http_status);
+  CHECK_EQUAL(client.requests[0].size(), bot.lastRequest.bytes_out);
+  CHECK_EQUAL(0, bot.lastRequest.bytes_in);
+  CHECK_EQUAL(0, bot.lastRequest.first_byte_us);
+  CHECK_EQUAL(1, bot.stats.timeouts);
+  CHECK_EQUAL(1, bot.stats.failures);
+  CHECK_EQUAL(1, reported);
+
+  // The same for a bare GET
+  CHECK_EQUAL(0, bot.getUpdates(0));
+  CHECK_STRING("getUpdates", bot.lastRequest.method);
+  CHECK_EQUAL(client.requests[1].size(), bot.lastRequest.bytes_out);
+  CHECK_EQUAL(0, bot.lastRequest.bytes_in);
+  CHECK_EQUAL(2, bot.stats.timeouts);
+  CHECK_EQUAL(2, reported);
+}
+
+static void testCutShort() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string response = httpResponse("{\"ok\":true,\"result\":{\"message_id\":3}}");
+
+  // The status line, then nothing
+  bot.waitForResponse = 100;
+  client.handler = [&](const std::string &) { return response.substr(0, 20); };
+
+  CHECK_EQUAL(SEND_RETRY, bot.trySendMessage("42", "hello"));
+  CHECK(!bot.lastRequest.ok);
+  CHECK_EQUAL(200, bot.lastRequest.http_status);
+  CHECK_EQUAL(20, bot.lastRequest.bytes_in);
+  CHECK(bot.lastRequest.first_byte_us > 0);
+  CHECK_EQUAL(1, bot.stats.timeouts);
+}
+
+int main() {
+  testAnswered();
+  testNoAnswer();
+  testCutShort();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,90 @@
+/*
+   sendMessage() of texts longer than MESSAGE_TEXT_LIMIT: the parts are
+   sent in order over a single connection, each within the limit, and put
+   back together (with the line break or space of each cut) they are the
+   text
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramStringCodec.h>
+
+#include <vector>
+
+#include "FakeClient.h"
+#include "check.h"
+
+// Unescaped text of each sendMessage request
+static std::vector<std::string> sentTexts(const FakeClient &client) {
+  std::vector<std::string> texts;
+  for (const std::string &request : client.requests) {
+    std::string body = requestBody(request);
+    size_t start = body.find("\"text\":\"") + 8;
+    size_t end = body.rfind("\"}");
+    std::vector<char> text(end - start + 1);
+    size_t length = jsonUnescape(text.data(), text.size(), body.data() + start, end - start);
+    texts.push_back(std::string(text.data(), length));
+  }
+  return texts;
+}
+
+static void respond(FakeClient &client) {
+  client.handler = [&client](const std::string &) {
+    return httpResponse("{\"ok\":true,\"result\":{\"message_id\":" +
+                        std::to_string(100 + client.requests.size()) + "}}");
+  };
+}
+
+static void testLongText() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string text;
+
+  respond(client);
+  for (int line = 0; text.size() < 47 * 1024; line++)
+    text += "Line " + std::to_string(line) + ": \"sensor\" reading within range\n";
+
+  CHECK(bot.sendMessage("42", text.c_str()));
+  CHECK(bot.lastSplit.parts >= 12);
+  CHECK_EQUAL(bot.lastSplit.parts, bot.lastSplit.sent);
+  CHECK_EQUAL(101, bot.lastSplit.first_message_id);
+  CHECK_EQUAL(100 + bot.lastSplit.parts, bot.lastSplit.last_message_id);
+  // All the parts over the same connection
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(bot.lastSplit.parts, client.requests.size());
+
+  std::vector<std::string> texts = sentTexts(client);
+  size_t offset = 0;
+  for (size_t i = 0; i < texts.size(); i++) {
+    CHECK(texts[i].size() <= MESSAGE_TEXT_LIMIT);
+    CHECK(text.compare(offset, texts[i].size(), texts[i]) == 0);
+    offset += texts[i].size();
+    if (i + 1 < texts.size()) {
+      CHECK(text[offset] == '\n');
+      offset++;
+    }
+  }
+  CHECK_EQUAL(text.size(), offset);
+}
+
+static void testSingleSeparator() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  std::string text = std::string(MESSAGE_TEXT_LIMIT - 6, 'a') + "\n  indented\n\nnext";
+
+  respond(client);
+  CHECK(bot.sendMessage("42", text.c_str()));
+  CHECK_EQUAL(2, bot.lastSplit.parts);
+
+  std::vector<std::string> texts = sentTexts(client);
+  CHECK_EQUAL(2, texts.size());
+  CHECK_EQUAL(MESSAGE_TEXT_LIMIT - 6, texts[0].size());
+  // Only the line break of the cut is left out, the indentation stays
+  CHECK_STRING("  indented\n\nnext", texts[1].c_str());
+}
+
+int main() {
+  testLongText();
+  testSingleSeparator();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,194 @@
+/*
+   TelegramSpool over a RAM log: progress is recorded only when messages
+   were consumed, dropping the oldest message is persistent or does not
+   happen, and the single attempt API of the bot it sends with. Over a file
+   log: a rewrite cut by a reset is recovered by begin().
+ */
+
+#include <UniversalTelegramBot.h>
+#include <TelegramSpool.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+// A log whose discard() can be made to fail, like a full flash file system
+class FlakyLog : public TelegramMemoryLog {
+public:
+  bool failDiscard = false;
+
+  FlakyLog(uint8_t* buffer, size_t size) : TelegramMemoryLog(buffer, size) {}
+  bool discard(size_t length) {
+    return failDiscard ? false : TelegramMemoryLog::discard(length);
+  }
+};
+
+static std::string sent() {
+  return httpResponse("{\"ok\":true,\"result\":{\"message_id\":1}}");
+}
+
+static std::string text(const std::string &request) {
+  std::string body = requestBody(request);
+  size_t start = body.find("\"text\":\"") + 8;
+  return body.substr(start, body.find('"', start) - start);
+}
+
+static void testTrySendMessage() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  int status = 200;
+
+  client.handler = [&](const std::string &) {
+    if (status == 200)
+      return sent();
+    return httpResponse("{\"ok\":false,\"error_code\":" + std::to_string(status) +
+                        ",\"description\":\"X\",\"parameters\":{\"retry_after\":7}}", status);
+  };
+
+  bot.beginBatch();
+  CHECK_EQUAL(SEND_OK, bot.trySendMessage("42", "one"));
+  status = 400;
+  CHECK_EQUAL(SEND_REJECTED, bot.trySendMessage("42", "two"));
+  // Both on the same connection, a rejection does not close it
+  CHECK_EQUAL(1, client.connects);
+  status = 429;
+  CHECK_EQUAL(SEND_RETRY, bot.trySendMessage("42", "three"));
+  CHECK_EQUAL(7, bot.retryAfter());
+  status = 500;
+  CHECK_EQUAL(SEND_RETRY, bot.trySendMessage("42", "four"));
+  client.refuse = true;
+  CHECK_EQUAL(SEND_OFFLINE, bot.trySendMessage("42", "five"));
+  bot.endBatch();
+  // A single attempt each
+  CHECK_EQUAL(4, client.requests.size());
+}
+
+static void testDoneOnlyOnProgress() {
+  static uint8_t buffer[2048];
+  TelegramMemoryLog log(buffer, sizeof(buffer));
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramSpool spool(bot, log);
+  int accepted = 1;
+
+  client.handler = [&](const std::string &) {
+    if (accepted-- > 0)
+      return sent();
+    return httpResponse("{\"ok\":false,\"error_code\":502,\"description\":\"X\"}", 502);
+  };
+  spool.setRetryInterval(0);
+  CHECK(spool.sendMessage("42", "first"));
+  CHECK(spool.sendMessage("42", "second"));
+  CHECK(spool.sendMessage("42", "third"));
+
+  CHECK_EQUAL(1, spool.loop());
+  CHECK_EQUAL(2, spool.pending());
+  size_t size = log.size();
+  // Failed drains consume nothing, so they write nothing
+  for (int i = 0; i < 5; i++)
+    CHECK_EQUAL(0, spool.loop());
+  client.refuse = true;
+  spool.loop();
+  CHECK_EQUAL(size, log.size());
+
+  // After a reset only the unsent messages are left
+  TelegramSpool restarted(bot, log);
+  CHECK_EQUAL(2, restarted.begin());
+  client.refuse = false;
+  accepted = 2;
+  size_t before = client.requests.size();
+  CHECK_EQUAL(2, restarted.loop());
+  CHECK_EQUAL(0, restarted.pending());
+  CHECK(text(client.requests[before]) == "second");
+  CHECK(text(client.requests[before + 1]) == "third");
+  CHECK_EQUAL(0, log.size());
+}
+
+static void testDropOldest() {
+  // Room for two messages
+  static uint8_t buffer[2 * (sizeof(telegramSpoolHeader) + 12) + 4];
+  FlakyLog log(buffer, sizeof(buffer));
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+  TelegramSpool spool(bot, log, SPOOL_DROP_OLDEST);
+
+  client.handler = [](const std::string &) { return sent(); };
+  CHECK(spool.sendMessage("42", "message1"));
+  CHECK(spool.sendMessage("42", "message2"));
+
+  // The oldest cannot be dropped for good, so the new one is
+  log.failDiscard = true;
+  CHECK(!spool.sendMessage("42", "message3"));
+  CHECK_EQUAL(2, spool.pending());
+  CHECK_EQUAL(1, spool.stats.dropped);
+  TelegramSpool restarted(bot, log, SPOOL_DROP_OLDEST);
+  CHECK_EQUAL(2, restarted.begin());
+
+  log.failDiscard = false;
+  CHECK(restarted.sendMessage("42", "message3"));
+  CHECK_EQUAL(2, restarted.pending());
+  CHECK_EQUAL(1, restarted.stats.dropped);
+  // Dropped after a reset too
+  TelegramSpool again(bot, log, SPOOL_DROP_OLDEST);
+  CHECK_EQUAL(2, again.begin());
+  CHECK_EQUAL(2, again.loop());
+  CHECK_EQUAL(2, client.requests.size());
+  CHECK(text(client.requests[0]) == "message2");
+  CHECK(text(client.requests[1]) == "message3");
+}
+
+// A reset in the middle of the rewrite of a log left its temporary file:
+// the whole log if the log itself was already removed, else an unfinished
+// copy
+static void testInterruptedRewrite() {
+  const char* directory = getenv("TMPDIR");
+  std::string path = std::string(directory ? directory : "/tmp") + "/telegram_spool." +
+                     std::to_string(getpid());
+  std::string tmp_path = path + ".tmp";
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  unlink(path.c_str());
+  client.handler = [](const std::string &) { return sent(); };
+  {
+    TelegramFileLog log(path.c_str(), 4096);
+    TelegramSpool spool(bot, log);
+    CHECK_EQUAL(0, spool.begin());
+    CHECK(spool.sendMessage("42", "first"));
+    CHECK(spool.sendMessage("42", "second"));
+  }
+  CHECK_EQUAL(0, rename(path.c_str(), tmp_path.c_str()));
+  {
+    TelegramFileLog log(path.c_str(), 4096);
+    TelegramSpool spool(bot, log);
+    CHECK_EQUAL(2, spool.begin());
+    CHECK(access(tmp_path.c_str(), F_OK) != 0);
+    CHECK(spool.sendMessage("42", "third"));
+  }
+
+  FILE* partial = fopen(tmp_path.c_str(), "wb");
+  fputs("cut", partial);
+  fclose(partial);
+  {
+    TelegramFileLog log(path.c_str(), 4096);
+    TelegramSpool spool(bot, log);
+    CHECK_EQUAL(3, spool.begin());
+    CHECK(access(tmp_path.c_str(), F_OK) != 0);
+    CHECK_EQUAL(3, spool.loop());
+    CHECK_EQUAL(3, client.requests.size());
+    CHECK(text(client.requests.front()) == "first");
+    CHECK(text(client.requests.back()) == "third");
+  }
+  unlink(path.c_str());
+}
+
+int main() {
+  testTrySendMessage();
+  testDoneOnlyOnProgress();
+  testDropOldest();
+  testInterruptedRewrite();
+
+  CHECK_DONE();
+}
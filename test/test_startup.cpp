@@ -0,0 +1,171 @@
+/*
+   Start of a bot waking from deep sleep: getMe(cache) asks Telegram once
+   and is then answered from the storage, warmUp() makes the connection of
+   the first poll, and the startup record tells what was restored and how
+   long the first update took
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include "FakeClient.h"
+#include "MemoryStorage.h"
+#include "check.h"
+
+static const char ME[] =
+  "{\"ok\":true,\"result\":{\"id\":1234,\"is_bot\":true,\"first_name\":\"Weather\","
+  "\"username\":\"weather_bot\"}}";
+static const char NO_UPDATES[] = "{\"ok\":true,\"result\":[]}";
+
+// Bare GETs (getMe, getUpdates) are answered without headers
+static std::string respond(const std::string &request) {
+  if (request.find("/getMe") != std::string::npos)
+    return ME;
+  return NO_UPDATES;
+}
+
+static size_t count(const std::vector<std::string> &requests, const char* text) {
+  size_t n = 0;
+  for (const std::string &request : requests)
+    if (request.find(text) != std::string::npos)
+      n++;
+  return n;
+}
+
+static void testIdentityCache() {
+  FakeClient client;
+  MemoryStorage cache;
+
+  client.handler = respond;
+  {
+    // Nothing cached yet: asked, and saved
+    UniversalTelegramBot bot("123:abc", client);
+    CHECK(bot.getMe(cache));
+    CHECK_STRING("Weather", bot.name);
+    CHECK_STRING("weather_bot", bot.userName);
+    CHECK(!bot.startup.identity_cached);
+    CHECK_EQUAL(1, count(client.requests, "/getMe"));
+    CHECK_EQUAL(1, cache.saves);
+  }
+  {
+    // After a restart, from the cache
+    UniversalTelegramBot bot("123:abc", client);
+    CHECK(bot.getMe(cache));
+    CHECK_STRING("Weather", bot.name);
+    CHECK_STRING("weather_bot", bot.userName);
+    CHECK(bot.startup.identity_cached);
+    CHECK_EQUAL(1, count(client.requests, "/getMe"));
+  }
+  {
+    // Another token is another bot
+    UniversalTelegramBot bot("456:def", client);
+    CHECK(bot.getMe(cache));
+    CHECK(!bot.startup.identity_cached);
+    CHECK_EQUAL(2, count(client.requests, "/getMe"));
+  }
+}
+
+static void testCorruptCache() {
+  FakeClient client;
+  MemoryStorage cache;
+
+  client.handler = respond;
+  UniversalTelegramBot first("123:abc", client);
+  CHECK(first.getMe(cache));
+  cache.record[12] ^= 0x01;
+
+  UniversalTelegramBot bot("123:abc", client);
+  CHECK(bot.getMe(cache));
+  CHECK(!bot.startup.identity_cached);
+  CHECK_STRING("Weather", bot.name);
+  CHECK_EQUAL(2, count(client.requests, "/getMe"));
+}
+
+static void testNotAnswered() {
+  FakeClient client;
+  MemoryStorage cache;
+  UniversalTelegramBot bot("123:abc", client);
+
+  client.refuse = true;
+  CHECK(!bot.getMe(cache));
+  CHECK(!bot.startup.identity_cached);
+  CHECK_EQUAL(0, cache.saves);
+}
+
+static void testWarmUp() {
+  FakeClient client;
+  UniversalTelegramBot bot("123:abc", client);
+
+  client.handler = respond;
+  CHECK(bot.warmUp());
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(0, client.requests.size());
+
+  // The first poll goes on that connection
+  CHECK_EQUAL(0, bot.getUpdates(0));
+  CHECK_EQUAL(1, client.connects);
+  CHECK(bot.startup.warm_connection);
+
+  client.refuse = true;
+  UniversalTelegramBot offline("123:abc", client);
+  CHECK(!offline.warmUp());
+}
+
+static void testColdStart() {
+  FakeClient client;
+  MemoryStorage cache;
+  MemoryStorage offsets;
+  UniversalTelegramBot bot("123:abc", client);
+
+  client.handler = respond;
+  CHECK(bot.getMe(cache));
+  CHECK(!bot.beginOffsetStore(offsets));
+  CHECK_EQUAL(0, bot.getUpdates(bot.last_message_received + 1));
+
+  CHECK(!bot.startup.identity_cached);
+  CHECK(!bot.startup.offset_restored);
+  CHECK(!bot.startup.warm_connection);
+  CHECK_EQUAL(2, client.connects);
+}
+
+// Woken with everything kept: the only request is the first poll, on the
+// connection made by warmUp(), from the saved offset
+static void testWarmStart() {
+  FakeClient client;
+  MemoryStorage cache;
+  MemoryStorage offsets;
+
+  client.handler = respond;
+  {
+    UniversalTelegramBot bot("123:abc", client);
+    CHECK(bot.getMe(cache));
+    bot.beginOffsetStore(offsets);
+    bot.last_message_received = 700;
+    CHECK(bot.saveOffset(true));
+  }
+  client.requests.clear();
+  client.connects = 0;
+
+  UniversalTelegramBot bot("123:abc", client);
+  CHECK(bot.getMe(cache));
+  CHECK(bot.beginOffsetStore(offsets));
+  CHECK(bot.warmUp());
+  CHECK_EQUAL(0, bot.getUpdates(bot.last_message_received + 1));
+
+  CHECK(bot.startup.identity_cached);
+  CHECK(bot.startup.offset_restored);
+  CHECK(bot.startup.warm_connection);
+  CHECK_EQUAL(1, client.connects);
+  CHECK_EQUAL(1, client.requests.size());
+  CHECK(client.requests[0].find("/getUpdates?offset=701") != std::string::npos);
+}
+
+int main() {
+  testIdentityCache();
+  testCorruptCache();
+  testNotAnswered();
+  testWarmUp();
+  testColdStart();
+  testWarmStart();
+
+  CHECK_DONE();
+}
@@ -0,0 +1,105 @@
+/*
+   Host storage backends (TelegramFileStorage, TelegramFileLog,
+   TelegramMemoryLog) and the update offset store on top of them
+ */
+
+#include <UniversalTelegramBot.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "FakeClient.h"
+#include "check.h"
+
+static std::string tempPath(const char* name) {
+  const char* directory = getenv("TMPDIR");
+  std::string path = std::string(directory ? directory : "/tmp") + "/" + name + "." +
+                     std::to_string(getpid());
+  unlink(path.c_str());
+  return path;
+}
+
+static void testFileStorage() {
+  std::string path = tempPath("telegram_storage");
+  TelegramFileStorage storage(path.c_str());
+  char record[16] = "saved record";
+  char loaded[16];
+
+  CHECK(!storage.load(loaded, sizeof(loaded)));
+  CHECK(storage.save(record, sizeof(record)));
+  CHECK(storage.load(loaded, sizeof(loaded)));
+  CHECK_STRING("saved record", loaded);
+  unlink(path.c_str());
+}
+
+static void testOffsetStore() {
+  std::string path = tempPath("telegram_offset");
+  TelegramFileStorage storage(path.c_str());
+  FakeClient client;
+
+  UniversalTelegramBot bot("123:abc", client);
+  CHECK(!bot.beginOffsetStore(storage));
+  bot.last_message_received = 4711;
+  CHECK(bot.saveOffset(true));
+
+  UniversalTelegramBot restarted("123:abc", client);
+  CHECK(restarted.beginOffsetStore(storage));
+  CHECK_EQUAL(4711, restarted.last_message_received);
+  CHECK(restarted.startup.offset_restored);
+
+  // A damaged record is not restored
+  FILE* file = fopen(path.c_str(), "r+b");
+  fseek(file, 5, SEEK_SET);
+  fputc(0x55, file);
+  fclose(file);
+  UniversalTelegramBot damaged("123:abc", client);
+  CHECK(!damaged.beginOffsetStore(storage));
+  CHECK_EQUAL(0, damaged.last_message_received);
+  unlink(path.c_str());
+}
+
+static void testLog(TelegramLogStorage &log) {
+  char data[8];
+
+  CHECK_EQUAL(0, log.size());
+  CHECK(log.append("first,", 6));
+  CHECK(log.append("second,", 7));
+  CHECK(log.append("third", 5));
+  CHECK_EQUAL(18, log.size());
+  CHECK(log.read(6, data, 7));
+  CHECK(memcmp(data, "second,", 7) == 0);
+  CHECK(!log.read(15, data, 5)); // Past the end
+
+  CHECK(log.discard(6));
+  CHECK_EQUAL(12, log.size());
+  CHECK(log.read(0, data, 7));
+  CHECK(memcmp(data, "second,", 7) == 0);
+  CHECK(log.truncate(7));
+  CHECK_EQUAL(7, log.size());
+
+  // Bounded by the capacity
+  char big[64];
+  memset(big, 'x', sizeof(big));
+  CHECK(!log.append(big, log.capacity() - log.size() + 1));
+  CHECK(log.append(big, log.capacity() - log.size()));
+  CHECK_EQUAL(log.capacity(), log.size());
+
+  CHECK(log.discard(log.size()));
+  CHECK_EQUAL(0, log.size());
+}
+
+int main() {
+  testFileStorage();
+  testOffsetStore();
+
+  uint8_t buffer[40];
+  TelegramMemoryLog memory(buffer, sizeof(buffer));
+  testLog(memory);
+
+  std::string path = tempPath("telegram_log");
+  TelegramFileLog file(path.c_str(), 40);
+  testLog(file);
+  unlink(path.c_str());
+
+  CHECK_DONE();
+}
@@ -0,0 +1,107 @@
+/*
+   JSON string codec: escaping and unescaping into buffers of every size
+   stop on the same boundaries as the whole text (never in the middle of an
+   escape sequence or an UTF-8 character)
+ */
+
+#include <TelegramStringCodec.h>
+
+#include <string>
+
+#include "check.h"
+
+// Long clean runs (word at a time), short ones between escapes, 2, 3 and 4
+// bytes UTF-8 characters
+static const char* const texts[] = {
+  "Temperature in the living room is 21.5 C, humidity 40%.",
+  "<b>\"Door\"</b>\topen\nback\\door\x01 closed",
+  "\xd0\xa2\xd0\xb5\xd0\xbc\xd0\xbf\xd0\xb5\xd1\x80\xd0\xb0\xd1\x82\xd1\x83\xd1\x80\xd0\xb0 "
+  "21.5 \xe2\x84\x83 \xf0\x9f\x8c\xa1\xf0\x9f\x8c\xa1\n\"\xf0\x9f\x92\xa7\" 40%",
+};
+
+static bool utf8Boundary(const std::string &s, size_t position) {
+  return (position >= s.size()) || (((uint8_t)s[position] & 0xC0) != 0x80);
+}
+
+static void testEscape(const char* text) {
+  size_t length = strlen(text);
+  std::string full(jsonEscapedLength(text, length) + 1, '\0');
+  full.resize(jsonEscape(&full[0], full.size(), text, length));
+  CHECK_EQUAL(jsonEscapedLength(text, length), full.size());
+
+  for (size_t dst_size = 1; dst_size <= full.size() + 1; dst_size++) {
+    // Expected: the escaped form of the longest prefix that fits
+    std::string expected;
+    for (size_t k = 0; k <= length; k++) {
+      if (!utf8Boundary(text, k))
+        continue;
+      std::string prefix(jsonEscapedLength(text, k) + 1, '\0');
+      prefix.resize(jsonEscape(&prefix[0], prefix.size(), text, k));
+      if (prefix.size() < dst_size)
+        expected = prefix;
+    }
+
+    std::string dst(dst_size, 'x');
+    size_t written = jsonEscape(&dst[0], dst_size, text, length);
+    CHECK_EQUAL(expected.size(), written);
+    CHECK_STRING(expected.c_str(), dst.c_str());
+  }
+}
+
+static void testUnescape(const char* text) {
+  size_t text_length = strlen(text);
+  std::string escaped(jsonEscapedLength(text, text_length) + 1, '\0');
+  escaped.resize(jsonEscape(&escaped[0], escaped.size(), text, text_length));
+  // ... with the non ASCII characters also as \uXXXX escapes, as the Bot
+  // API sends them
+  std::string ascii;
+  for (size_t i = 0; i < text_length;) {
+    uint8_t c = (uint8_t)text[i];
+    if (c < 0x80) {
+      char seq[8];
+      ascii.append(seq, jsonEscape(seq, sizeof(seq), text + i, 1));
+      i++;
+      continue;
+    }
+    size_t n = (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : 4;
+    uint32_t cp = c & (0x7F >> n);
+    for (size_t j = 1; j < n; j++)
+      cp = (cp << 6) | (text[i + j] & 0x3F);
+    i += n;
+    char seq[16];
+    if (cp >= 0x10000)
+      snprintf(seq, sizeof(seq), "\\u%04x\\u%04X", 0xD800 + ((cp - 0x10000) >> 10),
+               0xDC00 + ((cp - 0x10000) & 0x3FF));
+    else
+      snprintf(seq, sizeof(seq), "\\u%04x", cp);
+    ascii += seq;
+  }
+
+  const std::string* inputs[] = { &escaped, &ascii };
+  for (const std::string* input : inputs) {
+    std::string full(text_length + 1, '\0');
+    full.resize(jsonUnescape(&full[0], full.size(), input->c_str(), input->size()));
+    CHECK_STRING(text, full.c_str());
+
+    for (size_t dst_size = 1; dst_size <= full.size() + 1; dst_size++) {
+      size_t k = dst_size - 1;
+      while (!utf8Boundary(full, k))
+        k--;
+      std::string expected = full.substr(0, k);
+
+      std::string dst(dst_size, 'x');
+      size_t written = jsonUnescape(&dst[0], dst_size, input->c_str(), input->size());
+      CHECK_EQUAL(expected.size(), written);
+      CHECK_STRING(expected.c_str(), dst.c_str());
+    }
+  }
+}
+
+int main() {
+  for (const char* text : texts) {
+    testEscape(text);
+    testUnescape(text);
+  }
+
+  CHECK_DONE();
+}